@@ -8,8 +8,13 @@ LOCAL_CFLAGS    := -Werror -DJNI_WRAPPER \
                 -I../../include \
                 -I../../tiff-3.8.2-1/include
 LOCAL_SRC_FILES := gl_code.cpp ../../src/RenderState.cpp ../../src/RenderStateGL1.cpp \
+                ../../src/GLStateCache.cpp \
                 ../../src/Mesh.cpp  ../../src/MeshGL1.cpp ../../src/Material.cpp \
-                ../../src/Vertex.cpp ../../src/Scene.cpp ../../src/Dragon.cpp
+                ../../src/MaterialGL.cpp \
+                ../../src/Vertex.cpp ../../src/Scene.cpp ../../src/Dragon.cpp \
+                ../../src/MeshOptimizer.cpp ../../src/GltfWriter.cpp ../../src/RenderStateCapture.cpp \
+                ../../src/MeshCapture.cpp ../../src/VertexPacker.cpp ../../src/AnimationCache.cpp \
+                ../../src/Platform.cpp
 LOCAL_LDLIBS    := -llog -lGLESv1_CM \
                 -L/opt/android-ndk/sources/cxx-stl/stlport/libs/armeabi -lstlport_static \
                 -L../../tiff-3.8.2-1/armeabi -ltiff -ltiffdecoder
@@ -0,0 +1,121 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_ANIMATION_CACHE_H
+#define INITIALS_ANIMATION_CACHE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include "Vertex.h"
+
+using namespace std;
+
+class Mesh;
+class TaskPool;
+class AnimationFrameTask;
+
+// Animation caches hold the geometry of a mesh at a series of times. The
+// topology and texture coordinates are stored once. Every few frames are
+// stored in full, the others as quantized differences to the previous frame.
+
+class AnimationCacheWriter
+{
+public:
+    // Frames are written on a background thread. Up to maxPendingFrames frames
+    // wait to be written before addFrame blocks. Every keyInterval-th frame is
+    // stored in full.
+    AnimationCacheWriter(uint32_t maxPendingFrames = 4, uint32_t keyInterval = 30);
+    ~AnimationCacheWriter();
+
+    bool open(string path);
+    // The first frame sets the groups of the animation. The groups of the
+    // other frames must have the same mode and size.
+    bool addFrame(float time, const Mesh *m);
+    // Wait for the frames to be written and finish the file.
+    bool close();
+
+private:
+    friend class AnimationFrameTask;
+    bool writeTopology(const Mesh *m);
+    bool writeFrame(float time, const vector<vec3> &positions, const vector<vec3> &normals);
+    void collectFrame(AnimationFrameTask *task);
+
+    string m_path;
+    FILE *m_file;
+    TaskPool *m_pool;
+    uint32_t m_maxPending;
+    uint32_t m_keyInterval;
+    vector<AnimationFrameTask *> m_freeTasks;
+    vector<uint32_t> m_groupModes;
+    vector<uint32_t> m_groupSizes;
+    uint32_t m_vertexCount;
+    uint64_t m_texCoordsOffset;
+    bool m_failed;
+    // only used on the writer thread until the file is closed
+    uint64_t m_offset;
+    bool m_writeFailed;
+    vector<float> m_frameTimes;
+    vector<uint32_t> m_frameTypes;
+    vector<uint64_t> m_frameOffsets;
+    vector<vec3> m_previous;
+    vector<int16_t> m_deltas;
+    vector<uint16_t> m_packedNormals;
+};
+
+class AnimationCacheReader
+{
+public:
+    AnimationCacheReader();
+    ~AnimationCacheReader();
+
+    // The file is mapped in memory until it is closed.
+    bool open(string path);
+    void close();
+
+    uint32_t frameCount() const;
+    float frameTime(uint32_t frame) const;
+
+    // Create groups with the topology and texture coordinates of the animation.
+    void createGroups(vector<VertexGroup *> &groups) const;
+    // Set the positions and normals of groups made by createGroups to the ones
+    // of the frame. Reading frames in order only decodes their differences.
+    bool readFrame(uint32_t frame, const vector<VertexGroup *> &groups);
+
+private:
+    bool decodePositions(uint32_t frame);
+
+    const char *m_data;
+    size_t m_size;
+    uint32_t m_groupCount;
+    uint32_t m_vertexCount;
+    uint32_t m_frameCount;
+    uint64_t m_texCoordsOffset;
+    uint64_t m_frameTableOffset;
+    int64_t m_current;
+    vector<vec3> m_positions;
+    vector<vec3> m_normals;
+};
+
+#endif
@@ -80,13 +80,18 @@ public:
 
 private:
     Kind m_kind;
-    uint32_t m_jointParts;
-    uint32_t m_chestParts;
-    uint32_t m_tailEndParts;
+    int m_lod;                  // LOD of the meshes, 0 for the full meshes
     Material m_tongueMaterial;
     Material m_scalesMaterial;
     Material m_wingMaterial;
     Material m_membraneMaterial;
+    MeshHandle m_headMesh;
+    MeshHandle m_jointMesh;
+    MeshHandle m_chestMesh;
+    MeshHandle m_membraneMesh;
+    MeshHandle m_tailEndMesh;
+    MeshHandle m_letterAMesh;
+    MeshHandle m_letterSMesh;
     float theta_jaw;
     float theta_head_z;
     float theta_head_y;
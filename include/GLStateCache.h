@@ -0,0 +1,89 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_GL_STATE_CACHE_H
+#define INITIALS_GL_STATE_CACHE_H
+
+#include <inttypes.h>
+
+// Keeps the OpenGL state that was set through it, so that setting a value that
+// is already current does not call into GL. Anything else that changes the
+// state (Qt, glPopAttrib) must be followed by invalidate().
+class GLStateCache
+{
+public:
+    GLStateCache();
+
+    // forget the current state, the next call to every function reaches GL
+    void invalidate();
+
+    void setEnabled(uint32_t cap, bool enabled);
+    void setClientState(uint32_t array, bool enabled);
+    void activeTexture(uint32_t unit);
+    // bind a texture to the active unit
+    void bindTexture(uint32_t target, uint32_t texture);
+    void bindBuffer(uint32_t target, uint32_t buffer);
+    // GL unbinds deleted objects, so should the cache
+    void deleteTexture(uint32_t texture);
+    void deleteBuffer(uint32_t buffer);
+#ifndef JNI_WRAPPER
+    void useProgram(uint32_t program);
+    // arrays of missing attributes (negative indices) are ignored
+    void setVertexAttribArray(int index, bool enabled);
+    void disableVertexAttribArrays();
+#endif
+
+    // number of calls made to GL since the counters were reset, and of calls
+    // skipped because the state was already set
+    uint32_t calls() const;
+    uint32_t skippedCalls() const;
+    void resetCounters();
+
+private:
+    static const int MAX_FLAGS = 16;
+    static const int MAX_TEXTURE_UNITS = 8;
+    static const int MAX_VERTEX_ATTRIBS = 32;
+
+    // return true if the flag has to be changed in GL
+    bool changeFlag(uint32_t *names, int8_t *values, int &count,
+                    uint32_t name, bool enabled);
+    bool change(uint32_t &current, uint32_t value);
+
+    uint32_t m_flagNames[MAX_FLAGS];
+    int8_t m_flagValues[MAX_FLAGS];
+    int m_flagCount;
+    uint32_t m_clientStateNames[MAX_FLAGS];
+    int8_t m_clientStateValues[MAX_FLAGS];
+    int m_clientStateCount;
+    uint32_t m_activeTexture;
+    uint32_t m_textures[MAX_TEXTURE_UNITS];
+    uint32_t m_arrayBuffer;
+    uint32_t m_elementArrayBuffer;
+    uint32_t m_program;
+    uint32_t m_attribsEnabled;      // one bit per vertex attribute
+    uint32_t m_attribsKnown;
+    uint32_t m_calls;
+    uint32_t m_skippedCalls;
+};
+
+#endif
@@ -0,0 +1,65 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_GLTF_WRITER_H
+#define INITIALS_GLTF_WRITER_H
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include "Vertex.h"
+#include "Material.h"
+
+using namespace std;
+
+// Writes meshes to binary glTF (.glb) files. Vertices are stored interleaved
+// with indices, in one binary chunk, with one primitive per material.
+class GltfWriter
+{
+public:
+    GltfWriter();
+    ~GltfWriter();
+
+    // Add the triangles of a group drawn with the material. The texture is read
+    // from the path when saving and embedded as PNG. Groups with the same
+    // material are merged.
+    void addGroup(const VertexGroupView &vg, const Material &material, string texturePath = string());
+    // Returns false if the file could not be written or there are no triangles.
+    bool save(string path) const;
+
+private:
+    class Primitive
+    {
+    public:
+        Material material;
+        string texturePath;
+        vector<VertexData> vertices;
+        vector<uint32_t> indices;
+    };
+
+    Primitive * findPrimitive(const Material &material, string texturePath);
+
+    vector<Primitive *> m_primitives;
+};
+
+#endif
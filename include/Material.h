@@ -54,6 +54,12 @@ public:
     static uint32_t textureFromTIFFImage(string path, bool mipmaps = false);
     static uint32_t textureFromTIFFImage(const char *data, size_t size, bool mipmaps = false);
 
+    // decoding does not use GL and can be done on any thread
+    static uint32_t * decodeTIFFImage(string path, uint32_t &width, uint32_t &height);
+    static uint32_t * decodeTIFFImage(const char *data, size_t size, uint32_t &width, uint32_t &height);
+    static void freeTIFFImage(uint32_t *pixels);
+    static uint32_t textureFromPixels(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps = false);
+
 private:
     vec4 m_ambient;
     vec4 m_diffuse;
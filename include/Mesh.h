@@ -27,8 +27,10 @@
 #include <cstdio>
 #include <string>
 #include <iostream>
+#include <vector>
 #include <inttypes.h>
 #include "Vertex.h"
+#include "VertexPacker.h"
 
 using namespace std;
 
@@ -43,8 +45,23 @@ public:
     virtual int groupCount() const = 0;
     virtual uint32_t groupMode(int index) const = 0;
     virtual uint32_t groupSize(int index) const = 0;
+    virtual uint32_t groupIndexCount(int index) const = 0;
     virtual void addGroup(VertexGroup *vg) = 0;
-    virtual bool copyGroupTo(int index, VertexGroup *vg) const = 0;
+    // Add the group without copying it when possible. The mesh takes ownership.
+    virtual void takeGroup(VertexGroup *vg);
+    // Read the vertices and indices of the group where the mesh keeps them.
+    virtual bool groupView(int index, VertexGroupView &view) const = 0;
+    virtual bool copyGroupTo(int index, VertexGroup *vg) const;
+    // Layout of the vertices uploaded to the GPU. Only Float is supported by default.
+    virtual VertexPacker::Format vertexFormat() const;
+    virtual bool setVertexFormat(VertexPacker::Format format);
+
+    // Simplified versions of the mesh, each with about half the triangles of the
+    // previous one. Level 0 is the mesh itself; the coarsest mesh is returned for
+    // levels past the last one. The mesh takes ownership of the LODs.
+    int lodCount() const;
+    Mesh * lod(int level);
+    void addLod(Mesh *lod);
 
     enum OutputMode
     {
@@ -56,20 +73,34 @@ public:
     // Show normal vectors for every vertex in the mesh, for debugging purposes
     virtual void drawNormals(RenderState *s);
     virtual void saveStl(string path) const;
-    virtual void saveObj(string path) const;
+    virtual bool saveObj(string path) const;
+    virtual bool saveBinary(string path) const;
 
-    static VertexGroup * loadStl(string path, bool computeNormals = false);
+    // Binary and ASCII STL files are supported. Normals are computed when asked to
+    // or when the file leaves them out. Large files are decoded on several threads.
+    static VertexGroup * loadStl(string path, bool computeNormals = false, int threads = 0);
+    static VertexGroup * loadStlData(const char *data, size_t size, bool computeNormals = false,
+                                     int threads = 0);
     static VertexGroup * loadObj(string path);
     static VertexGroup * loadObj(istream &s);
+    // Large buffers are parsed on several threads, one per core when threads is zero.
+    static VertexGroup * loadObj(const char *data, size_t size, int threads = 0);
+    // Stream the triangles of the file to the sink, reading it in chunks.
+    static bool loadObj(string path, VertexSink *sink);
+    static void loadObj(istream &s, VertexSink *sink);
+    static bool loadBinary(string path, vector<VertexGroup *> &groups);
+    static bool loadBinary(const char *data, size_t size, vector<VertexGroup *> &groups);
     static void saveStl(string path, VertexGroup **vg, int groups);
-    static void saveObj(string path, VertexGroup **vg, int groups);
+    static void saveStl(string path, const VertexGroupView *views, int groups);
+    // Identical positions, texture coordinates and normals are written once.
+    // The file is formatted in chunks on several threads.
+    static bool saveObj(string path, VertexGroup **vg, int groups);
+    static bool saveObj(string path, const VertexGroupView *views, int groups);
+    static bool saveBinary(string path, VertexGroup **vg, int groups);
+    static bool saveBinary(string path, const VertexGroupView *views, int groups);
 
-private:
-    static void saveObjIndicesTri(FILE *f, VertexGroup *vg, uint32_t &offset);
-    static void saveObjIndicesQuad(FILE *f, VertexGroup *vg, uint32_t &offset);
-    static void saveObjIndicesTriStrip(FILE *f, VertexGroup *vg, uint32_t &offset);
-    static void saveObjFace(FILE *f, uint32_t ind1, uint32_t ind2, uint32_t ind3);
-    static void saveObjIndice(FILE *f, uint32_t indice);
+protected:
+    vector<Mesh *> m_lods;
 };
 
 #endif
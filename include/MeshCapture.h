@@ -0,0 +1,55 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_MESH_CAPTURE_H
+#define INITIALS_MESH_CAPTURE_H
+
+#include <vector>
+#include <inttypes.h>
+#include "Mesh.h"
+#include "Vertex.h"
+
+class RenderState;
+
+// Mesh that is only kept in memory. Drawing it to a mesh transforms its
+// vertices on the CPU, drawing it to the screen does nothing.
+class MeshCapture : public Mesh
+{
+public:
+    MeshCapture();
+    virtual ~MeshCapture();
+
+    virtual int groupCount() const;
+    virtual uint32_t groupMode(int index) const;
+    virtual uint32_t groupSize(int index) const;
+    virtual uint32_t groupIndexCount(int index) const;
+    virtual void addGroup(VertexGroup *vg);
+    virtual void takeGroup(VertexGroup *vg);
+    virtual bool groupView(int index, VertexGroupView &view) const;
+    virtual void draw(OutputMode mode, RenderState *s, Mesh *output = 0);
+
+private:
+    std::vector<VertexGroup *> m_groups;
+};
+
+#endif
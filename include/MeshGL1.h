@@ -28,25 +28,31 @@
 #include <inttypes.h>
 #include "Mesh.h"
 
+class RenderStateGL1;
+
 typedef struct
 {
     uint32_t mode;
     int count;
     int offset;   // location of the face vertices in the mesh's indices array
+    int indexCount;
+    int indexOffset;        // location of the face indices in m_shortIndices or m_indices
+    uint32_t indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
     bool draw;
 } Face;
 
 class MeshGL1 : public Mesh
 {
 public:
-    MeshGL1();
+    MeshGL1(const RenderStateGL1 *state);
     virtual ~MeshGL1();
 
     virtual int groupCount() const;
     virtual uint32_t groupMode(int index) const;
     virtual uint32_t groupSize(int index) const;
+    virtual uint32_t groupIndexCount(int index) const;
     virtual void addGroup(VertexGroup *vg);
-    virtual bool copyGroupTo(int index, VertexGroup *vg) const;
+    virtual bool groupView(int index, VertexGroupView &view) const;
     void addFace(uint32_t mode, int vertexCount, int offset, bool draw = true);
 
     virtual void draw(OutputMode mode, RenderState *s, Mesh *output = 0);
@@ -54,14 +60,21 @@ public:
     virtual void drawNormals(RenderState *s);
 
 private:
+    void addSplitGroup(VertexGroup *vg);
+    void addVertex(const VertexData &v);
     void drawVertexList();
+    void setVertexPointers(int offset, bool normals, bool texCoords);
+    uint32_t faceIndex(const Face &f, int i) const;
     void drawToMesh(Mesh *m, RenderState *s);
     VertexGroup * drawFaceToMeshCopy(RenderState *s, Face f);
 
     std::vector<vec3> m_vertices;
     std::vector<vec3> m_normals;
     std::vector<vec2> m_texCoords;
+    std::vector<uint16_t> m_shortIndices;
+    std::vector<uint32_t> m_indices;
     std::vector<Face> m_faces;
+    const RenderStateGL1 *m_state;
 };
 
 #endif
@@ -41,17 +41,30 @@ public:
     virtual int groupCount() const;
     virtual uint32_t groupMode(int index) const;
     virtual uint32_t groupSize(int index) const;
+    virtual uint32_t groupIndexCount(int index) const;
     virtual void addGroup(VertexGroup *vg);
-    virtual bool copyGroupTo(int index, VertexGroup *vg) const;
+    virtual void takeGroup(VertexGroup *vg);
+    virtual bool groupView(int index, VertexGroupView &view) const;
+    virtual VertexPacker::Format vertexFormat() const;
+    virtual bool setVertexFormat(VertexPacker::Format format);
     virtual void draw(OutputMode mode, RenderState *s, Mesh *output = 0);
 
 private:
     void drawToScreen();
-    void drawArray(VertexGroup *vg, int position, int normal, int texCoords);
-    void drawVBO(VertexGroup *vg, int position, int normal, int texCoords);
+    void drawToMesh(Mesh *output, RenderState *s);
+    void drawArray(VertexGroup *vg, int indexOffset, int position, int normal, int texCoords);
+    void drawVBO(VertexGroup *vg, const PackedRange &range, int position, int normal, int texCoords);
+    void uploadVertices(VertexGroup *vg, const PackedRange &range);
+    void setVertexPointers(int position, int normal, int texCoords);
+    void addShortIndices(const VertexGroup *vg);
 
     const RenderStateGL2 *m_state;
     std::vector<VertexGroup *> m_groups;
+    std::vector<PackedRange> m_ranges;
+    // 16-bit copy of the indices of the groups drawn from memory, -1 for the others
+    std::vector<uint16_t> m_shortIndices;
+    std::vector<int> m_shortIndexOffsets;
+    VertexPacker::Format m_format;
 };
 
 #endif
@@ -0,0 +1,82 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_MESH_OPTIMIZER_H
+#define INITIALS_MESH_OPTIMIZER_H
+
+#include <vector>
+#include <inttypes.h>
+#include "Vertex.h"
+
+class MeshOptimizer
+{
+public:
+    // Merge identical vertices and turn the group into an indexed one.
+    // Groups that already have indices or would not get smaller are left untouched.
+    static void weld(VertexGroup *vg);
+
+    // Weld, then run the optimizations below in order.
+    static void optimize(VertexGroup *vg);
+    // Reorder the triangles of an indexed group so that vertices are reused from
+    // the post-transform cache as much as possible (Forsyth's algorithm).
+    static void optimizeVertexCache(VertexGroup *vg);
+    // Draw clusters of triangles facing outwards first to reduce overdraw. Clusters
+    // are split so that the cache miss ratio grows at most by the threshold factor.
+    static void optimizeOverdraw(VertexGroup *vg, float threshold = 1.05f);
+    // Store the vertices of an indexed group in the order they are first used.
+    static void optimizeVertexFetch(VertexGroup *vg);
+
+    // Simulate a FIFO post-transform cache of triangle lists. Returns the average
+    // number of cache misses per triangle (ACMR) and per vertex (ATVR).
+    static void analyzeVertexCache(const VertexGroup *vg, uint32_t cacheSize,
+                                   float &acmr, float &atvr);
+
+    // Create a simplified copy of a triangle group by collapsing edges, cheapest
+    // first according to their quadric error, until the group has at most
+    // targetIndexCount indices or collapsing would move the surface further than
+    // maxError (relative to the diagonal of the bounds). Seams and borders are kept.
+    // The error of the result is returned in the same unit.
+    static VertexGroup * simplify(const VertexGroup *vg, uint32_t targetIndexCount,
+                                  float maxError, float *error = 0);
+};
+
+// Welds vertices as they are received, so that large meshes are never held in
+// memory unwelded. The groups it creates are the same as welded ones.
+class WeldingVertexSink : public VertexSink
+{
+public:
+    WeldingVertexSink();
+
+    virtual void addVertices(const VertexData *vertices, uint32_t count);
+    virtual VertexGroup * createGroup(uint32_t mode);
+
+private:
+    uint32_t addVertex(const VertexData &v);
+    void resizeTable(uint32_t size);
+
+    std::vector<VertexData> m_vertices;
+    std::vector<uint32_t> m_indices;
+    std::vector<uint32_t> m_table;
+};
+
+#endif
@@ -39,9 +39,75 @@
 #define  LOGE(...) fprintf(stderr, __VA_ARGS__);
 #endif
 
+// defined with the GL state cache, the command-line tools do not link it
 void checkGlError(const char* op);
 bool loadFileBlob(std::string path, std::string &blob);
 char *loadFileData(std::string path);
 void freeFileData(char *data);
+// Map a file on disk in memory for reading. Returns 0 if it could not be mapped.
+const char *mapFileData(std::string path, size_t &size);
+void unmapFileData(const char *data, size_t size);
+// Return true if the file exists and was modified after (or at the same time as) the other one.
+bool isFileNewer(std::string path, std::string other);
+// Path of the file where data derived from the given file can be cached, with
+// the extension replaced. Returns an empty string if there is nowhere to write it.
+std::string cacheFilePath(std::string path, std::string extension);
+// Path of a temporary file next to the given one, unique to this process.
+std::string temporaryFilePath(std::string path);
+// Move a file over another one, replacing it.
+bool replaceFile(std::string from, std::string to);
+
+class FileReaderPrivate;
+
+// Reads a file sequentially, a chunk at a time.
+class FileReader
+{
+public:
+    FileReader();
+    ~FileReader();
+
+    bool open(std::string path);
+    void close();
+    // Read up to size bytes. Returns 0 at the end of the file or on error.
+    size_t read(char *buffer, size_t size);
+
+private:
+    FileReaderPrivate *d;
+};
+
+// Unit of work that can be run on a worker thread.
+class Task
+{
+public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+};
+
+class TaskPoolPrivate;
+
+// Runs tasks on worker threads. Finished tasks are queued until the thread that
+// started them collects them, which is where GL calls can be made.
+class TaskPool
+{
+public:
+    // Use one thread per core when threads is zero.
+    TaskPool(int threads = 0);
+    ~TaskPool();
+
+    int threadCount() const;
+    int pendingCount() const;
+
+    // Queue the task. The pool does not take ownership of it.
+    void start(Task *task);
+    // Return the next finished task, or 0 if none has finished yet.
+    Task * nextFinished();
+    // Wait for the next task to finish. Returns 0 if no task is pending.
+    Task * waitForNext();
+    // Wait for all tasks to finish. They still have to be collected.
+    void waitForDone();
+
+private:
+    TaskPoolPrivate *d;
+};
 
 #endif
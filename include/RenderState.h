@@ -26,12 +26,30 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "Mesh.h"
 #include "Material.h"
 #include "Vertex.h"
 
 using namespace std;
 
+class AssetLoadTask;
+
+// Small integer standing for the name of a mesh, see RenderState::meshHandle().
+class MeshHandle
+{
+public:
+    inline MeshHandle() : id(0)
+    {
+    }
+
+    inline explicit MeshHandle(uint32_t id) : id(id)
+    {
+    }
+
+    uint32_t id;        // 0 when no name was resolved
+};
+
 class RenderState
 {
 public:
@@ -49,10 +67,24 @@ public:
 
     // mesh operations
     virtual void drawMesh(Mesh *m) = 0;
-    virtual void drawMesh(string name);
+    // draw the mesh with the given name, or one of its LODs
+    virtual void drawMesh(string name, int lod = 0);
+    virtual void drawMesh(MeshHandle handle, int lod = 0);
+    // Resolve the name of a mesh, which does not need to be loaded yet, to a
+    // handle that finds the mesh without looking the name up. The handle is also
+    // valid for the states the assets are copied to.
+    MeshHandle meshHandle(string name);
+    // mesh loaded with the name of the handle, if any
+    Mesh * mesh(MeshHandle handle) const;
 
     virtual void beginExportMesh(string path);
-    virtual void endExportMesh();
+    // Write the meshes drawn since beginExportMesh. Returns false if the file
+    // could not be written.
+    virtual bool endExportMesh();
+    // Capture the meshes drawn until the end of the capture in a new mesh,
+    // transformed by the matrices they were drawn with.
+    virtual void beginCaptureMesh();
+    virtual Mesh * endCaptureMesh();
 
     virtual map<string, Mesh *> & meshes();
     virtual const map<string, Mesh *> & meshes() const;
@@ -61,13 +93,28 @@ public:
     virtual Mesh * loadMeshFromFile(string name, string path);
     virtual Mesh * loadMeshFromData(string name, const char *data, size_t size);
     virtual Mesh * loadMeshFromGroup(string name, VertexGroup *vg);
+    virtual Mesh * loadMeshFromGroups(string name, const vector<VertexGroup *> &groups);
     virtual void freeMeshes();
+    // Copy the meshes and their LODs to another state, such as one used on
+    // another thread, which should have no assets yet. Texture names and IDs
+    // are shared, not copied.
+    void copyAssetsTo(RenderState *target) const;
 
     virtual uint32_t loadTextureFromFile(string name, string path, bool mipmaps = false);
     virtual uint32_t loadTextureFromData(string name, const char *data, size_t size, bool mipmaps = false);
     virtual uint32_t texture(string name) const;
+    // path of the file a texture was loaded from, if any
+    virtual string texturePath(uint32_t texID) const;
+    void addTexture(string name, uint32_t texID, string path = string());
+    // create a texture from decoded pixels, which can be null if decoding failed
+    virtual uint32_t createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps) = 0;
     virtual void freeTextures() = 0;
 
+    // assets can be queued and loaded together, decoding them on worker threads
+    virtual void queueMeshFromFile(string name, string path);
+    virtual void queueTextureFromFile(string name, string path, bool mipmaps = false);
+    virtual void loadQueuedAssets(int threads = 0);
+
     // matrix operations
 
     enum MatrixMode
@@ -80,6 +127,8 @@ public:
     virtual void setMatrixMode(MatrixMode newMode) = 0;
 
     virtual void loadIdentity() = 0;
+    // the model-view matrix must stay affine, only the projection matrix can
+    // be multiplied by a perspective projection
     virtual void multiplyMatrix(const matrix4 &m) = 0;
     virtual void pushMatrix() = 0;
     virtual void popMatrix() = 0;
@@ -99,8 +148,13 @@ public:
 
     virtual void pushMaterial(const Material &m) = 0;
     virtual void popMaterial() = 0;
+    // material on top of the stack, or the default material
+    Material currentMaterial() const;
 
 protected:
+    // record the material drawn with the groups added to the export mesh
+    void addExportMaterials();
+
     Mesh::OutputMode m_output;
     bool m_drawNormals;
     bool m_projection;
@@ -108,11 +162,17 @@ protected:
     vec4 m_bgColor;
     Mesh *m_meshOutput;
     map<string, uint32_t> m_textures;
+    map<uint32_t, string> m_texturePaths;
+    vector<Material> m_materialStack;
     map<string, Mesh *> m_meshes;
+    map<string, uint32_t> m_meshIDs;
+    vector<Mesh *> m_meshesByID;        // indexed by handle, 0 is no mesh
+    vector<AssetLoadTask *> m_queuedAssets;
 
     // exporting
     bool m_exporting;
     string m_exportPath;
+    vector<Material> m_exportMaterials;
     Mesh::OutputMode m_oldOutput;
 };
 
@@ -121,16 +181,21 @@ class StateObject
 public:
     StateObject(RenderState *s);
 
+    void setState(RenderState *s);
+
     void loadIdentity();
     void pushMatrix();
     void popMatrix();
 
+    void multiplyMatrix(const matrix4 &m);
     void translate(float dx, float dy, float dz);
     void rotate(float angle, float rx, float ry, float rz);
     void scale(float sx, float sy, float sz);
 
     void drawMesh(Mesh *m);
-    void drawMesh(string name);
+    void drawMesh(string name, int lod = 0);
+    void drawMesh(MeshHandle handle, int lod = 0);
+    MeshHandle meshHandle(string name);
 
     void pushMaterial(const Material &m);
     void popMaterial();
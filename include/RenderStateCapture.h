@@ -0,0 +1,80 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_RENDER_STATE_CAPTURE_H
+#define INITIALS_RENDER_STATE_CAPTURE_H
+
+#include <vector>
+#include "RenderState.h"
+
+// Render state that does not use GL and only captures meshes, which makes it
+// usable on any thread. Matrices are computed on the CPU.
+class RenderStateCapture : public RenderState
+{
+public:
+    RenderStateCapture();
+    virtual ~RenderStateCapture();
+
+    virtual Mesh * createMesh() const;
+    virtual void drawMesh(Mesh *m);
+    // textures are only given an ID and a path, they are not decoded
+    virtual uint32_t loadTextureFromFile(string name, string path, bool mipmaps = false);
+    virtual uint32_t loadTextureFromData(string name, const char *data, size_t size, bool mipmaps = false);
+    virtual void queueTextureFromFile(string name, string path, bool mipmaps = false);
+    virtual uint32_t createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps);
+    virtual void freeTextures();
+
+    // matrix operations
+    virtual void setMatrixMode(MatrixMode newMode);
+
+    virtual void loadIdentity();
+    virtual void multiplyMatrix(const matrix4 &m);
+    virtual void pushMatrix();
+    virtual void popMatrix();
+
+    virtual void translate(float dx, float dy, float dz);
+    virtual void rotate(float angle, float rx, float ry, float rz);
+    virtual void scale(float sx, float sy, float sz);
+
+    virtual matrix4 currentMatrix() const;
+
+    // general state operations
+    virtual void beginFrame(int width, int heigth);
+    virtual void setupViewport(int width, int heigth);
+    virtual void endFrame();
+
+    // material operations
+    virtual void pushMaterial(const Material &m);
+    virtual void popMaterial();
+
+private:
+    RenderState::MatrixMode m_matrixMode;
+    // the model-view matrix is affine, the other ones are kept in m_matrix
+    affine3x4 m_modelView;
+    std::vector<affine3x4> m_modelViewStack;
+    matrix4 m_matrix[3];
+    std::vector<matrix4> m_matrixStack[3];
+    uint32_t m_nextTexture;
+};
+
+#endif
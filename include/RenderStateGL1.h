@@ -26,6 +26,7 @@
 
 #include <vector>
 #include "RenderState.h"
+#include "GLStateCache.h"
 
 class RenderStateGL1 : public RenderState
 {
@@ -34,6 +35,7 @@ public:
 
     virtual Mesh * createMesh() const;
     virtual void drawMesh(Mesh *m);
+    virtual uint32_t createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps);
     virtual void freeTextures();
 
     // matrix operations
@@ -59,15 +61,17 @@ public:
     virtual void pushMaterial(const Material &m);
     virtual void popMaterial();
 
+    // state shared by the meshes drawn with this state, valid during a frame
+    GLStateCache * glState() const;
+
 private:
     void beginApplyMaterial(const Material &m);
-    void endApplyMaterial(const Material &m);
 
     vec4 m_ambient0;
     vec4 m_diffuse0;
     vec4 m_specular0;
     vec4 m_light0_pos;
-    std::vector<Material> m_materialStack;
+    mutable GLStateCache m_glState;
 };
 
 #endif
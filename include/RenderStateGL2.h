@@ -28,6 +28,8 @@
 #include <string>
 #include <inttypes.h>
 #include "RenderState.h"
+#include "VertexPacker.h"
+#include "GLStateCache.h"
 
 class RenderStateGL2 : public RenderState
 {
@@ -39,6 +41,7 @@ public:
 
     virtual Mesh * createMesh() const;
     virtual void drawMesh(Mesh *m);
+    virtual uint32_t createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps);
     virtual void freeTextures();
 
     // matrix operations
@@ -67,30 +70,77 @@ public:
     int positionAttr() const;
     int normalAttr() const;
     int texCoordsAttr() const;
+    // set how the vertex shader decodes the vertices of the next draw calls
+    void setVertexRange(const PackedRange &range, bool octNormals) const;
+    void resetVertexRange() const;
+    // number of uniform values uploaded since the current frame began, and of
+    // uploads skipped because the uniform already had the value
+    uint32_t uniformUploads() const;
+    uint32_t skippedUniformUploads() const;
+    // state shared by the meshes drawn with this state, valid during a frame
+    GLStateCache * glState() const;
 
 private:
+    // uniforms of the shader program, whose locations are resolved when linking
+    enum Uniform
+    {
+        U_MODELVIEW_ROWS,
+        U_PROJECTION_MATRIX,
+        U_POSITION_OFFSET,
+        U_POSITION_SCALE,
+        U_TEXCOORDS_OFFSET,
+        U_TEXCOORDS_SCALE,
+        U_OCT_NORMALS,
+        U_LIGHT_AMBIENT,
+        U_LIGHT_DIFFUSE,
+        U_LIGHT_SPECULAR,
+        U_LIGHT_POS,
+        U_MATERIAL_AMBIENT,
+        U_MATERIAL_DIFFUSE,
+        U_MATERIAL_SPECULAR,
+        U_MATERIAL_SHINE,
+        U_MATERIAL_TEXTURE,
+        U_HAS_TEXTURE,
+        UNIFORM_COUNT
+    };
+
+    // location of a uniform and the last value uploaded to it
+    class UniformSlot
+    {
+    public:
+        int location;
+        bool valid;
+        uint32_t value[16];
+    };
+
     void beginApplyMaterial(const Material &m);
-    void endApplyMaterial(const Material &m);
     uint32_t loadShader(string path, uint32_t type) const;
     bool loadShaders();
     void initShaders();
-    void setUniformValue(string name, const vec4 &v);
-    void setUniformValue(string name, float f);
-    void setUniformValue(string name, int i);
+    void resolveUniforms();
+    // upload the value to the uniform unless it already has it
+    void setUniformValue(Uniform u, const void *value) const;
+    void setUniformValue(Uniform u, const vec4 &v) const;
+    void setUniformValue(Uniform u, float f) const;
+    void setUniformValue(Uniform u, int i) const;
 
     vec4 m_ambient0;
     vec4 m_diffuse0;
     vec4 m_specular0;
     vec4 m_light0_pos;
-    std::vector<Material> m_materialStack;
     RenderState::MatrixMode m_matrixMode;
+    // the model-view matrix is affine, the other ones are kept in m_matrix
+    affine3x4 m_modelView;
+    std::vector<affine3x4> m_modelViewStack;
     matrix4 m_matrix[3];
     std::vector<matrix4> m_matrixStack[3];
     uint32_t m_vertexShader;
     uint32_t m_pixelShader;
     uint32_t m_program;
-    int m_modelViewMatrixLoc;
-    int m_projMatrixLoc;
+    mutable UniformSlot m_uniforms[UNIFORM_COUNT];
+    mutable uint32_t m_uniformUploads;
+    mutable uint32_t m_skippedUniformUploads;
+    mutable GLStateCache m_glState;
     int m_positionAttr;
     int m_normalAttr;
     int m_texCoordsAttr;
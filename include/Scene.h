@@ -29,6 +29,7 @@
 #include "Vertex.h"
 
 class Dragon;
+class TaskPool;
 
 class Scene : public StateObject
 {
@@ -70,6 +71,10 @@ public:
     Camera camera() const;
     void setCamera(Camera c);
 
+    // level of detail of the dragons, from 1 (lowest) to 4 (highest)
+    int detailLevel() const;
+    void setDetailLevel(int level);
+
     enum Item
     {
         SCENE,
@@ -94,18 +99,35 @@ public:
         LAST = DRAGON_TAIL_END
     };
 
-    void exportCurrentItem();
-    void exportItem(Item item, string path);
+    // Export the selected item the next time it is drawn, as OBJ or binary glTF
+    // (.glb). The item is exported in the background as it was when drawn.
+    void exportCurrentItem(string extension = ".obj");
+    // Returns false if the file could not be written.
+    bool exportItem(Item item, string path);
+    // Pose the scene at each time and record the item in an animation cache.
+    bool exportAnimation(Item item, string path, const vector<double> &times);
+    // transformed copy of the item as it would be drawn, owned by the caller
+    Mesh * captureItem(Item item);
+    // describe the export in progress or the last one to finish, if recent
+    string exportStatus() const;
     void animate();
+    // pose the dragons as they are t seconds after the animation started
+    void animate(double t);
+    static string itemText(Item item);
+
+    // Copy the state needed to draw the scene, drawing with another render
+    // state. The copy can be drawn on another thread with a capture state.
+    Scene(const Scene &source, RenderState *state);
 
 private:
+    void startExport(Item item, string path);
+    void finishExport();
     void drawItem(Item item);
     void drawScene();
     void drawFloor();
     void drawDragonHoldingA(Dragon *d);
     void drawDragonHoldingP(Dragon *d);
     void drawDragonHoldingS(Dragon *d);
-    static string itemText(Item item);
 
     double m_started;
     int m_selected;
@@ -117,7 +139,16 @@ private:
     vec3 m_thetaCamera;
     Dragon *m_debugDragon;
     std::vector<Dragon *> m_dragons;
+    MeshHandle m_floorMesh;
+    MeshHandle m_letterPMesh;
+    MeshHandle m_letterAMesh;
+    MeshHandle m_letterSMesh;
     bool m_exportQueued;
+    string m_exportExtension;
+    TaskPool *m_exportPool;
+    RenderState *m_exportState;
+    string m_exportStatus;
+    double m_exportFinished;
     bool m_loaded;
 };
 
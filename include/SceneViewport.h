@@ -67,6 +67,7 @@ private slots:
 
 private:
     void paintFPS(QPainter *p, float fps);
+    void paintStatus(QPainter *p, QString text);
     void startFPS();
     void updateAnimationState();
     void toggleAnimation();
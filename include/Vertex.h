@@ -65,6 +65,13 @@ public:
     }
 
     static vec3 normal(const vec3 &a, const vec3 &b, const vec3 &c);
+    // Compute the normals of count triangles like normal(), reading the corners
+    // stride bytes apart from a, b and c and writing outStride bytes apart.
+    static void normals(const vec3 *a, const vec3 *b, const vec3 *c, uint32_t stride,
+                        vec3 *out, uint32_t outStride, uint32_t count);
+    // compute the axis-aligned bounding box of count points read stride bytes apart
+    static bool bounds(const vec3 *points, uint32_t stride, uint32_t count,
+                       vec3 &minPos, vec3 &maxPos);
 };
 
 vec3 operator+(const vec3 &a, const vec3 &b);
@@ -91,6 +98,9 @@ public:
     }
 };
 
+class VertexData;
+
+// 4x4 matrix stored column by column, like OpenGL matrices.
 class matrix4
 {
 public:
@@ -99,10 +109,28 @@ public:
     matrix4();
 
     vec3 map(const vec3 &v) const;
+    // transform and normalize a normal, using the upper 3x3 matrix only
     vec3 mapNormal(const vec3 &v) const;
+    // matrix that transforms normals like this matrix transforms positions
+    matrix4 normalMatrix() const;
+    // Like map() and mapNormal() for count elements, read and written the given
+    // number of bytes apart (at least sizeof(vec3)). The output can be the input.
+    void mapPoints(const vec3 *in, uint32_t inStride, vec3 *out, uint32_t outStride,
+                   uint32_t count) const;
+    void mapNormals(const vec3 *in, uint32_t inStride, vec3 *out, uint32_t outStride,
+                    uint32_t count) const;
+    // Transform positions with the matrix and normals with its normal matrix.
+    // The output can be the same array as the input.
+    void mapVertices(const VertexData *vertices, VertexData *out, uint32_t count) const;
 
     void clear();
     void setIdentity();
+    // Multiply the matrix in place by translate(), rotate() or scale(), updating
+    // only the columns that change. These match operator* exactly. The other
+    // columns are kept, where operator* can turn a negative zero into zero.
+    void translateBy(float dx, float dy, float dz);
+    void rotateBy(float angle, float rx, float ry, float rz);
+    void scaleBy(float sx, float sy, float sz);
 
     void dump() const;
 
@@ -114,6 +142,42 @@ public:
 };
 
 matrix4 operator*(const matrix4 &a, const matrix4 &b);
+// The products operator* can be built on, which give the same results. It uses
+// the scalar one, DragonBench compares them.
+matrix4 multiplyScalar(const matrix4 &a, const matrix4 &b);
+#ifdef __SSE__
+matrix4 multiplySSE(const matrix4 &a, const matrix4 &b);
+#endif
+
+// Affine transform, i.e. a 4x4 matrix whose last row is (0, 0, 0, 1). Unlike
+// matrix4 it is stored row by row, so each row can be used as a vec4. Its
+// products and in-place operations give the same results as matrix4.
+class affine3x4
+{
+public:
+    float d[12];
+
+    affine3x4();
+    // the upper three rows of the matrix, which should be affine
+    explicit affine3x4(const matrix4 &m);
+
+    matrix4 toMatrix4() const;
+    vec3 map(const vec3 &v) const;
+    // transform and normalize a normal, using the upper 3x3 matrix only
+    vec3 mapNormal(const vec3 &v) const;
+    // inverse transform, the zero matrix if the transform cannot be inverted
+    affine3x4 inverse() const;
+    // transform for normals, without translation
+    affine3x4 normalMatrix() const;
+
+    void clear();
+    void setIdentity();
+    void translateBy(float dx, float dy, float dz);
+    void rotateBy(float angle, float rx, float ry, float rz);
+    void scaleBy(float sx, float sy, float sz);
+};
+
+affine3x4 operator*(const affine3x4 &a, const affine3x4 &b);
 
 class VertexData
 {
@@ -126,14 +190,202 @@ public:
 class VertexGroup
 {
 public:
-    VertexGroup(uint32_t mode, uint32_t count);
+    VertexGroup(uint32_t mode, uint32_t count, uint32_t indexCount = 0);
     VertexGroup(uint32_t mode, const std::vector<VertexData> &data);
+    // Take the vertices from the vector without copying them, leaving it empty.
+    VertexGroup(uint32_t mode, std::vector<VertexData> *data);
     virtual ~VertexGroup();
 
+    // Replace the vertices by an array allocated with new [], taking ownership of it.
+    void setData(VertexData *data, uint32_t count);
+
+    // number of vertices to draw, i.e. the number of indices for indexed groups
+    inline uint32_t elementCount() const
+    {
+        return indices ? indexCount : count;
+    }
+
+    // index of the vertex at the given position in the draw order
+    inline uint32_t vertexIndex(uint32_t i) const
+    {
+        return indices ? indices[i] : i;
+    }
+
+    // compute the axis-aligned bounding box of the vertex positions
+    bool bounds(vec3 &minPos, vec3 &maxPos) const;
+
     uint32_t mode;
     uint32_t count;
     VertexData *data;
+    uint32_t indexCount;
+    uint32_t *indices;      // optional, null when the vertices are drawn in order
     uint32_t id;
+    uint32_t indexId;
+    uint32_t lod;           // level of detail, 0 for the full-resolution group
+
+private:
+    std::vector<VertexData> m_storage;  // holds the vertices when taken from a vector
+};
+
+// Read-only view of elements stored stride bytes apart, such as one attribute
+// of an array of VertexData. The view does not own the elements.
+template<typename T>
+class StridedView
+{
+public:
+    inline StridedView() : m_data(0), m_count(0), m_stride(sizeof(T))
+    {
+    }
+
+    inline StridedView(const T *data, uint32_t count, uint32_t stride = sizeof(T))
+        : m_data((const char *)data), m_count(count), m_stride(stride)
+    {
+    }
+
+    inline uint32_t size() const
+    {
+        return m_count;
+    }
+
+    inline bool empty() const
+    {
+        return m_count == 0;
+    }
+
+    inline const T * data() const
+    {
+        return (const T *)m_data;
+    }
+
+    inline uint32_t stride() const
+    {
+        return m_stride;
+    }
+
+    inline const T & operator[](uint32_t i) const
+    {
+        return *(const T *)(m_data + (size_t)i * m_stride);
+    }
+
+private:
+    const char *m_data;
+    uint32_t m_count;
+    uint32_t m_stride;
+};
+
+// Read-only view of 16-bit or 32-bit vertex indices.
+class IndexView
+{
+public:
+    inline IndexView() : m_data(0), m_count(0), m_size(sizeof(uint32_t))
+    {
+    }
+
+    inline IndexView(const uint32_t *indices, uint32_t count)
+        : m_data(indices), m_count(count), m_size(sizeof(uint32_t))
+    {
+    }
+
+    inline IndexView(const uint16_t *indices, uint32_t count)
+        : m_data(indices), m_count(count), m_size(sizeof(uint16_t))
+    {
+    }
+
+    inline uint32_t size() const
+    {
+        return m_count;
+    }
+
+    inline bool empty() const
+    {
+        return m_count == 0;
+    }
+
+    // size of one index in bytes, 2 or 4
+    inline uint32_t indexSize() const
+    {
+        return m_size;
+    }
+
+    inline const void * data() const
+    {
+        return m_data;
+    }
+
+    inline uint32_t operator[](uint32_t i) const
+    {
+        if(m_size == sizeof(uint16_t))
+            return ((const uint16_t *)m_data)[i];
+        else
+            return ((const uint32_t *)m_data)[i];
+    }
+
+private:
+    const void *m_data;
+    uint32_t m_count;
+    uint32_t m_size;
+};
+
+// Vertices and indices of a group, read where the mesh keeps them. Normals and
+// texture coordinates are empty when the mesh has none. The view is valid until
+// the mesh is changed or destroyed.
+class VertexGroupView
+{
+public:
+    VertexGroupView();
+    VertexGroupView(const VertexGroup *vg);
+
+    inline uint32_t count() const
+    {
+        return positions.size();
+    }
+
+    inline uint32_t elementCount() const
+    {
+        return indices.empty() ? count() : indices.size();
+    }
+
+    inline uint32_t vertexIndex(uint32_t i) const
+    {
+        return indices.empty() ? i : indices[i];
+    }
+
+    // vertex with zero normal and texture coordinates when they are missing
+    VertexData vertex(uint32_t i) const;
+    // the vertices when they are stored as an array of VertexData, 0 otherwise
+    const VertexData * vertexData() const;
+    bool bounds(vec3 &minPos, vec3 &maxPos) const;
+    // copy the vertices and indices to a group at least as large as the view
+    bool copyTo(VertexGroup *vg) const;
+
+    uint32_t mode;
+    StridedView<vec3> positions;
+    StridedView<vec3> normals;
+    StridedView<vec2> texCoords;
+    IndexView indices;      // empty when the vertices are drawn in order
+    uint32_t lod;
+};
+
+// Receives the vertices of a mesh while it is being loaded, three per triangle.
+class VertexSink
+{
+public:
+    virtual ~VertexSink() {}
+    virtual void addVertices(const VertexData *vertices, uint32_t count) = 0;
+    // Create a group from the vertices received so far and start a new one.
+    virtual VertexGroup * createGroup(uint32_t mode) = 0;
+};
+
+// Keeps every vertex it receives, in order.
+class VertexArraySink : public VertexSink
+{
+public:
+    void reserve(uint32_t count);
+    virtual void addVertices(const VertexData *vertices, uint32_t count);
+    virtual VertexGroup * createGroup(uint32_t mode);
+
+private:
+    std::vector<VertexData> m_vertices;
 };
 
 #endif
@@ -0,0 +1,80 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef INITIALS_VERTEX_PACKER_H
+#define INITIALS_VERTEX_PACKER_H
+
+#include <inttypes.h>
+#include "Vertex.h"
+
+// Maps the normalized values of packed vertices back to the original range,
+// i.e. value * scale + offset.
+class PackedRange
+{
+public:
+    vec3 positionOffset;
+    vec3 positionScale;
+    vec2 texCoordsOffset;
+    vec2 texCoordsScale;
+};
+
+// Difference between the original vertices and the packed ones once decoded.
+class PackingError
+{
+public:
+    float maxPosition;      // relative to the diagonal of the bounds
+    float meanPosition;
+    float maxNormalAngle;   // in degrees
+    float meanNormalAngle;
+    float maxTexCoords;     // in texture space
+    float meanTexCoords;
+};
+
+class VertexPacker
+{
+public:
+    enum Format
+    {
+        // 32 bytes, VertexData
+        Float,
+        // 16 bytes: 16-bit position (padded to four), 2x16-bit octahedral normal, 2x16-bit UV
+        Packed16,
+        // 12 bytes: 16-bit position, 2x8-bit octahedral normal, 2x16-bit UV
+        Packed12
+    };
+
+    static uint32_t vertexSize(Format format);
+    // Positions and texture coordinates are packed relative to the bounds of the group.
+    static PackedRange range(const VertexGroup *vg);
+    static void pack(const VertexData *vertices, uint32_t count, Format format,
+                     const PackedRange &range, void *out);
+    // Decode packed vertices the way the vertex shader does.
+    static void unpack(const void *data, uint32_t count, Format format,
+                       const PackedRange &range, VertexData *out);
+    static PackingError measureError(const VertexGroup *vg, Format format);
+    // Octahedral normals with 16 bits per component, as used by Packed16.
+    static void encodeNormals(const vec3 *normals, uint32_t count, uint16_t *out);
+    static void decodeNormals(const uint16_t *data, uint32_t count, vec3 *out);
+};
+
+#endif
@@ -0,0 +1,604 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstring>
+#include "AnimationCache.h"
+#include "Mesh.h"
+#include "Platform.h"
+#include "VertexPacker.h"
+
+#define ANIMATION_FILE_MAGIC 0x4d4e4144     // 'DANM'
+#define ANIMATION_FILE_VERSION 1
+#define ANIMATION_FILE_ALIGNMENT 16
+
+#define ANIMATION_KEY_FRAME 0
+#define ANIMATION_DELTA_FRAME 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t groups;
+    uint32_t vertexCount;
+    uint32_t frames;
+    uint32_t keyInterval;
+    uint64_t texCoordsOffset;
+    uint64_t frameTableOffset;
+} AnimationFileHeader;
+
+typedef struct
+{
+    uint32_t mode;
+    uint32_t count;
+    uint32_t indexCount;
+    uint32_t reserved;
+    uint64_t indexOffset;
+} AnimationFileGroup;
+
+// Key frames hold float positions followed by packed normals. Delta frames hold
+// a scale followed by quantized position differences and packed normals.
+typedef struct
+{
+    float time;
+    uint32_t type;
+    uint64_t offset;
+} AnimationFileFrame;
+
+typedef struct
+{
+    vec3 scale;
+    uint32_t reserved;
+} AnimationFileDelta;
+
+static uint64_t alignAnimationFileOffset(uint64_t offset)
+{
+    return (offset + ANIMATION_FILE_ALIGNMENT - 1) & ~(uint64_t)(ANIMATION_FILE_ALIGNMENT - 1);
+}
+
+static bool writeAnimationFilePadding(FILE *f, uint64_t &offset)
+{
+    static const char zeros[ANIMATION_FILE_ALIGNMENT] = {0};
+    uint64_t aligned = alignAnimationFileOffset(offset);
+    size_t padding = (size_t)(aligned - offset);
+    offset = aligned;
+    return (padding == 0) || (fwrite(zeros, padding, 1, f) == 1);
+}
+
+static uint64_t animationFrameSize(uint32_t type, uint32_t vertexCount)
+{
+    uint64_t size = (type == ANIMATION_KEY_FRAME)
+        ? (uint64_t)vertexCount * sizeof(vec3)
+        : sizeof(AnimationFileDelta) + (uint64_t)vertexCount * 3 * sizeof(int16_t);
+    return alignAnimationFileOffset(size) + (uint64_t)vertexCount * 2 * sizeof(uint16_t);
+}
+
+// Shared by the writer and the reader so that both reconstruct the same positions.
+static void applyPositionDeltas(vec3 *positions, const int16_t *deltas, vec3 scale, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        positions[i].x += deltas[i * 3 + 0] * scale.x;
+        positions[i].y += deltas[i * 3 + 1] * scale.y;
+        positions[i].z += deltas[i * 3 + 2] * scale.z;
+    }
+}
+
+static int16_t quantizeDelta(float d, float scale)
+{
+    if(scale == 0.0f)
+        return 0;
+    float q = floor(d / scale + 0.5f);
+    return (int16_t)max(-32767.0f, min(32767.0f, q));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class AnimationFrameTask : public Task
+{
+public:
+    AnimationFrameTask(AnimationCacheWriter *writer) : m_writer(writer), m_time(0.0f), m_written(false)
+    {
+    }
+
+    virtual void run()
+    {
+        m_written = m_writer->writeFrame(m_time, m_positions, m_normals);
+    }
+
+    AnimationCacheWriter *m_writer;
+    float m_time;
+    bool m_written;
+    vector<vec3> m_positions;
+    vector<vec3> m_normals;
+};
+
+AnimationCacheWriter::AnimationCacheWriter(uint32_t maxPendingFrames, uint32_t keyInterval)
+{
+    m_file = 0;
+    m_pool = new TaskPool(1);
+    m_maxPending = max(maxPendingFrames, 1u);
+    m_keyInterval = max(keyInterval, 1u);
+    m_vertexCount = 0;
+    m_texCoordsOffset = 0;
+    m_offset = 0;
+    m_failed = false;
+    m_writeFailed = false;
+}
+
+AnimationCacheWriter::~AnimationCacheWriter()
+{
+    close();
+    delete m_pool;
+    for(uint32_t i = 0; i < m_freeTasks.size(); i++)
+        delete m_freeTasks[i];
+}
+
+bool AnimationCacheWriter::open(string path)
+{
+    close();
+    m_file = fopen(path.c_str(), "wb");
+    if(m_file == 0)
+    {
+        fprintf(stderr, "Could not open file '%s' for writing.\n", path.c_str());
+        return false;
+    }
+    m_path = path;
+    for(uint32_t i = 0; i < m_freeTasks.size(); i++)
+        delete m_freeTasks[i];
+    m_freeTasks.clear();
+    m_groupModes.clear();
+    m_groupSizes.clear();
+    m_vertexCount = 0;
+    m_texCoordsOffset = 0;
+    m_offset = 0;
+    m_failed = false;
+    m_writeFailed = false;
+    m_frameTimes.clear();
+    m_frameTypes.clear();
+    m_frameOffsets.clear();
+    return true;
+}
+
+bool AnimationCacheWriter::writeTopology(const Mesh *m)
+{
+    int groups = m->groupCount();
+    vector<AnimationFileGroup> table(groups);
+    vector<VertexGroupView> views(groups);
+    uint64_t offset = sizeof(AnimationFileHeader) + groups * sizeof(AnimationFileGroup);
+    m_vertexCount = 0;
+    for(int i = 0; i < groups; i++)
+    {
+        m->groupView(i, views[i]);
+        AnimationFileGroup &entry = table[i];
+        entry.mode = views[i].mode;
+        entry.count = views[i].count();
+        entry.indexCount = views[i].indices.size();
+        entry.reserved = 0;
+        entry.indexOffset = offset = alignAnimationFileOffset(offset);
+        offset += (uint64_t)entry.indexCount * sizeof(uint32_t);
+        m_groupModes.push_back(entry.mode);
+        m_groupSizes.push_back(entry.count);
+        m_groupSizes.push_back(entry.indexCount);
+        m_vertexCount += entry.count;
+    }
+    m_texCoordsOffset = alignAnimationFileOffset(offset);
+
+    // the header is written again with the frame table offset when closing
+    AnimationFileHeader header;
+    memset(&header, 0, sizeof(AnimationFileHeader));
+    bool written = (fwrite(&header, sizeof(AnimationFileHeader), 1, m_file) == 1);
+    if(groups > 0)
+        written = written && (fwrite(&table[0], sizeof(AnimationFileGroup), groups, m_file) == (size_t)groups);
+    m_offset = sizeof(AnimationFileHeader) + groups * sizeof(AnimationFileGroup);
+    vector<uint32_t> indices;
+    for(int i = 0; written && (i < groups); i++)
+    {
+        uint32_t indexCount = table[i].indexCount;
+        indices.resize(indexCount);
+        for(uint32_t j = 0; j < indexCount; j++)
+            indices[j] = views[i].indices[j];
+        written = writeAnimationFilePadding(m_file, m_offset);
+        if(indexCount > 0)
+            written = written && (fwrite(&indices[0], sizeof(uint32_t), indexCount, m_file) == indexCount);
+        m_offset += (uint64_t)indexCount * sizeof(uint32_t);
+    }
+    vector<vec2> texCoords;
+    texCoords.reserve(m_vertexCount);
+    for(int i = 0; i < groups; i++)
+    {
+        for(uint32_t j = 0; j < views[i].count(); j++)
+            texCoords.push_back(views[i].vertex(j).texCoords);
+    }
+    written = written && writeAnimationFilePadding(m_file, m_offset);
+    if(m_vertexCount > 0)
+        written = written && (fwrite(&texCoords[0], sizeof(vec2), m_vertexCount, m_file) == m_vertexCount);
+    m_offset += (uint64_t)m_vertexCount * sizeof(vec2);
+    m_previous.resize(m_vertexCount);
+    m_deltas.resize(m_vertexCount * 3);
+    m_packedNormals.resize(m_vertexCount * 2);
+    return written;
+}
+
+bool AnimationCacheWriter::addFrame(float time, const Mesh *m)
+{
+    if(!m_file || !m || m_failed)
+        return false;
+    if(m_texCoordsOffset == 0)
+    {
+        if(!writeTopology(m))
+        {
+            m_failed = true;
+            return false;
+        }
+    }
+    int groups = m->groupCount();
+    if((size_t)groups != m_groupModes.size())
+        return false;
+    vector<VertexGroupView> views(groups);
+    for(int i = 0; i < groups; i++)
+    {
+        if(!m->groupView(i, views[i]) || (views[i].mode != m_groupModes[i]) ||
+            (views[i].count() != m_groupSizes[i * 2]) || (views[i].indices.size() != m_groupSizes[i * 2 + 1]))
+            return false;
+    }
+
+    // reuse the buffers of a written frame when too many frames are pending
+    AnimationFrameTask *task = 0;
+    if(m_freeTasks.size() > 0)
+    {
+        task = m_freeTasks.back();
+        m_freeTasks.pop_back();
+    }
+    else if(m_pool->pendingCount() >= (int)m_maxPending)
+    {
+        task = (AnimationFrameTask *)m_pool->waitForNext();
+        m_failed = m_failed || !task->m_written;
+    }
+    else
+    {
+        task = new AnimationFrameTask(this);
+        task->m_positions.resize(m_vertexCount);
+        task->m_normals.resize(m_vertexCount);
+    }
+
+    // only the positions and normals change between frames
+    task->m_time = time;
+    uint32_t v = 0;
+    for(int i = 0; i < groups; i++)
+    {
+        const VertexGroupView &g = views[i];
+        for(uint32_t j = 0; j < g.count(); j++, v++)
+        {
+            task->m_positions[v] = g.positions[j];
+            task->m_normals[v] = g.normals.empty() ? vec3(0.0f, 0.0f, 1.0f) : g.normals[j];
+        }
+    }
+    m_pool->start(task);
+
+    // collect the frames that have been written in the meantime
+    Task *finished = 0;
+    while((finished = m_pool->nextFinished()) != 0)
+        collectFrame((AnimationFrameTask *)finished);
+    return !m_failed;
+}
+
+void AnimationCacheWriter::collectFrame(AnimationFrameTask *task)
+{
+    m_failed = m_failed || !task->m_written;
+    m_freeTasks.push_back(task);
+}
+
+bool AnimationCacheWriter::writeFrame(float time, const vector<vec3> &positions,
+                                      const vector<vec3> &normals)
+{
+    if(m_writeFailed)
+        return false;
+    uint32_t frame = m_frameOffsets.size();
+    uint32_t type = ((frame % m_keyInterval) == 0) ? ANIMATION_KEY_FRAME : ANIMATION_DELTA_FRAME;
+    bool written = writeAnimationFilePadding(m_file, m_offset);
+    uint64_t start = m_offset;
+    if(type == ANIMATION_KEY_FRAME)
+    {
+        m_previous = positions;
+        if(m_vertexCount > 0)
+            written = written && (fwrite(&m_previous[0], sizeof(vec3), m_vertexCount, m_file) == m_vertexCount);
+        m_offset += (uint64_t)m_vertexCount * sizeof(vec3);
+    }
+    else
+    {
+        // the differences are taken against the positions the reader will
+        // reconstruct, so that quantization errors do not add up
+        AnimationFileDelta delta;
+        vec3 maxDelta(0.0f, 0.0f, 0.0f);
+        for(uint32_t i = 0; i < m_vertexCount; i++)
+        {
+            vec3 d = positions[i] - m_previous[i];
+            maxDelta.x = max(maxDelta.x, (float)fabs(d.x));
+            maxDelta.y = max(maxDelta.y, (float)fabs(d.y));
+            maxDelta.z = max(maxDelta.z, (float)fabs(d.z));
+        }
+        delta.scale = vec3(maxDelta.x / 32767.0f, maxDelta.y / 32767.0f, maxDelta.z / 32767.0f);
+        delta.reserved = 0;
+        for(uint32_t i = 0; i < m_vertexCount; i++)
+        {
+            vec3 d = positions[i] - m_previous[i];
+            m_deltas[i * 3 + 0] = quantizeDelta(d.x, delta.scale.x);
+            m_deltas[i * 3 + 1] = quantizeDelta(d.y, delta.scale.y);
+            m_deltas[i * 3 + 2] = quantizeDelta(d.z, delta.scale.z);
+        }
+        if(m_vertexCount > 0)
+            applyPositionDeltas(&m_previous[0], &m_deltas[0], delta.scale, m_vertexCount);
+        written = written && (fwrite(&delta, sizeof(AnimationFileDelta), 1, m_file) == 1);
+        if(m_vertexCount > 0)
+            written = written && (fwrite(&m_deltas[0], sizeof(int16_t), m_vertexCount * 3, m_file) == m_vertexCount * 3);
+        m_offset += sizeof(AnimationFileDelta) + (uint64_t)m_vertexCount * 3 * sizeof(int16_t);
+    }
+
+    written = written && writeAnimationFilePadding(m_file, m_offset);
+    if(m_vertexCount > 0)
+    {
+        VertexPacker::encodeNormals(&normals[0], m_vertexCount, &m_packedNormals[0]);
+        written = written && (fwrite(&m_packedNormals[0], sizeof(uint16_t), m_vertexCount * 2, m_file) == m_vertexCount * 2);
+    }
+    m_offset += (uint64_t)m_vertexCount * 2 * sizeof(uint16_t);
+    if(!written)
+    {
+        m_writeFailed = true;
+        return false;
+    }
+    m_frameTimes.push_back(time);
+    m_frameTypes.push_back(type);
+    m_frameOffsets.push_back(start);
+    return true;
+}
+
+bool AnimationCacheWriter::close()
+{
+    if(!m_file)
+        return false;
+    m_pool->waitForDone();
+    Task *finished = 0;
+    while((finished = m_pool->nextFinished()) != 0)
+        collectFrame((AnimationFrameTask *)finished);
+
+    bool written = !m_failed && !m_writeFailed;
+    if(written && (m_texCoordsOffset == 0))
+    {
+        // no frame was added, reserve space for the header only
+        AnimationFileHeader empty;
+        memset(&empty, 0, sizeof(AnimationFileHeader));
+        written = (fwrite(&empty, sizeof(AnimationFileHeader), 1, m_file) == 1);
+        m_texCoordsOffset = m_offset = sizeof(AnimationFileHeader);
+    }
+
+    AnimationFileHeader header;
+    memset(&header, 0, sizeof(AnimationFileHeader));
+    header.magic = ANIMATION_FILE_MAGIC;
+    header.version = ANIMATION_FILE_VERSION;
+    header.groups = m_groupModes.size();
+    header.vertexCount = m_vertexCount;
+    header.frames = m_frameOffsets.size();
+    header.keyInterval = m_keyInterval;
+    header.texCoordsOffset = m_texCoordsOffset;
+    written = written && writeAnimationFilePadding(m_file, m_offset);
+    header.frameTableOffset = m_offset;
+    for(uint32_t i = 0; written && (i < header.frames); i++)
+    {
+        AnimationFileFrame entry;
+        entry.time = m_frameTimes[i];
+        entry.type = m_frameTypes[i];
+        entry.offset = m_frameOffsets[i];
+        written = (fwrite(&entry, sizeof(AnimationFileFrame), 1, m_file) == 1);
+    }
+    written = written && (fseek(m_file, 0, SEEK_SET) == 0) &&
+        (fwrite(&header, sizeof(AnimationFileHeader), 1, m_file) == 1);
+    written = (fclose(m_file) == 0) && written;
+    m_file = 0;
+    if(!written)
+        fprintf(stderr, "Could not write animation file '%s'.\n", m_path.c_str());
+    return written;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+AnimationCacheReader::AnimationCacheReader()
+{
+    m_data = 0;
+    m_size = 0;
+    m_groupCount = 0;
+    m_vertexCount = 0;
+    m_frameCount = 0;
+    m_texCoordsOffset = 0;
+    m_frameTableOffset = 0;
+    m_current = -1;
+}
+
+AnimationCacheReader::~AnimationCacheReader()
+{
+    close();
+}
+
+bool AnimationCacheReader::open(string path)
+{
+    close();
+    size_t size = 0;
+    const char *data = mapFileData(path, size);
+    if(!data)
+        return false;
+
+    // check that every table and frame lies within the file
+    AnimationFileHeader header;
+    bool valid = (size >= sizeof(AnimationFileHeader));
+    if(valid)
+    {
+        memcpy(&header, data, sizeof(AnimationFileHeader));
+        valid = (header.magic == ANIMATION_FILE_MAGIC) && (header.version == ANIMATION_FILE_VERSION);
+    }
+    uint64_t tableSize = valid ? (uint64_t)header.groups * sizeof(AnimationFileGroup) : 0;
+    valid = valid && (tableSize <= (size - sizeof(AnimationFileHeader)));
+    uint64_t vertexCount = 0;
+    for(uint32_t i = 0; valid && (i < header.groups); i++)
+    {
+        const AnimationFileGroup *g = (const AnimationFileGroup *)(data + sizeof(AnimationFileHeader)) + i;
+        uint64_t indexSize = (uint64_t)g->indexCount * sizeof(uint32_t);
+        valid = (g->indexOffset <= size) && (indexSize <= (size - g->indexOffset));
+        const uint32_t *indices = (const uint32_t *)(data + g->indexOffset);
+        for(uint32_t j = 0; valid && (j < g->indexCount); j++)
+            valid = (indices[j] < g->count);
+        vertexCount += g->count;
+    }
+    valid = valid && (vertexCount == header.vertexCount) &&
+        (header.texCoordsOffset <= size) && (vertexCount * sizeof(vec2) <= (size - header.texCoordsOffset)) &&
+        (header.frameTableOffset <= size) &&
+        ((uint64_t)header.frames * sizeof(AnimationFileFrame) <= (size - header.frameTableOffset));
+    for(uint32_t i = 0; valid && (i < header.frames); i++)
+    {
+        const AnimationFileFrame *f = (const AnimationFileFrame *)(data + header.frameTableOffset) + i;
+        uint64_t frameSize = animationFrameSize(f->type, header.vertexCount);
+        valid = ((f->type == ANIMATION_KEY_FRAME) || ((f->type == ANIMATION_DELTA_FRAME) && (i > 0))) &&
+            (f->offset <= size) && (frameSize <= (size - f->offset));
+    }
+    if(!valid)
+    {
+        unmapFileData(data, size);
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_groupCount = header.groups;
+    m_vertexCount = header.vertexCount;
+    m_frameCount = header.frames;
+    m_texCoordsOffset = header.texCoordsOffset;
+    m_frameTableOffset = header.frameTableOffset;
+    m_current = -1;
+    m_positions.resize(m_vertexCount);
+    m_normals.resize(m_vertexCount);
+    return true;
+}
+
+void AnimationCacheReader::close()
+{
+    if(m_data)
+        unmapFileData(m_data, m_size);
+    m_data = 0;
+    m_size = 0;
+    m_groupCount = 0;
+    m_vertexCount = 0;
+    m_frameCount = 0;
+    m_current = -1;
+}
+
+uint32_t AnimationCacheReader::frameCount() const
+{
+    return m_frameCount;
+}
+
+float AnimationCacheReader::frameTime(uint32_t frame) const
+{
+    if(frame >= m_frameCount)
+        return 0.0f;
+    return ((const AnimationFileFrame *)(m_data + m_frameTableOffset))[frame].time;
+}
+
+void AnimationCacheReader::createGroups(vector<VertexGroup *> &groups) const
+{
+    const AnimationFileGroup *table = (const AnimationFileGroup *)(m_data + sizeof(AnimationFileHeader));
+    const vec2 *texCoords = (const vec2 *)(m_data + m_texCoordsOffset);
+    for(uint32_t i = 0; i < m_groupCount; i++)
+    {
+        const AnimationFileGroup &g = table[i];
+        VertexGroup *vg = new VertexGroup(g.mode, g.count, g.indexCount);
+        if(g.indexCount > 0)
+            memcpy(vg->indices, m_data + g.indexOffset, g.indexCount * sizeof(uint32_t));
+        for(uint32_t j = 0; j < g.count; j++)
+        {
+            vg->data[j].position = vec3(0.0f, 0.0f, 0.0f);
+            vg->data[j].normal = vec3(0.0f, 0.0f, 1.0f);
+            vg->data[j].texCoords = texCoords[j];
+        }
+        texCoords += g.count;
+        groups.push_back(vg);
+    }
+}
+
+bool AnimationCacheReader::decodePositions(uint32_t frame)
+{
+    const AnimationFileFrame *frames = (const AnimationFileFrame *)(m_data + m_frameTableOffset);
+    if((int64_t)frame == m_current)
+        return true;
+
+    // start from the closest key frame, unless the current frame is closer
+    uint32_t first = frame;
+    while(frames[first].type != ANIMATION_KEY_FRAME)
+        first--;
+    if((m_current >= (int64_t)first) && (m_current < (int64_t)frame))
+        first = (uint32_t)m_current + 1;
+    for(uint32_t i = first; i <= frame; i++)
+    {
+        const char *data = m_data + frames[i].offset;
+        if(frames[i].type == ANIMATION_KEY_FRAME)
+        {
+            memcpy(&m_positions[0], data, m_vertexCount * sizeof(vec3));
+        }
+        else
+        {
+            AnimationFileDelta delta;
+            memcpy(&delta, data, sizeof(AnimationFileDelta));
+            const int16_t *deltas = (const int16_t *)(data + sizeof(AnimationFileDelta));
+            applyPositionDeltas(&m_positions[0], deltas, delta.scale, m_vertexCount);
+        }
+    }
+    m_current = frame;
+    return true;
+}
+
+bool AnimationCacheReader::readFrame(uint32_t frame, const vector<VertexGroup *> &groups)
+{
+    if((frame >= m_frameCount) || (groups.size() != m_groupCount))
+        return false;
+    for(uint32_t i = 0; i < groups.size(); i++)
+    {
+        if(groups[i]->count != ((const AnimationFileGroup *)(m_data + sizeof(AnimationFileHeader)))[i].count)
+            return false;
+    }
+    if((m_vertexCount == 0) || !decodePositions(frame))
+        return (m_vertexCount == 0);
+
+    const AnimationFileFrame *f = (const AnimationFileFrame *)(m_data + m_frameTableOffset) + frame;
+    uint64_t normalsOffset = f->offset + animationFrameSize(f->type, m_vertexCount) -
+        (uint64_t)m_vertexCount * 2 * sizeof(uint16_t);
+    VertexPacker::decodeNormals((const uint16_t *)(m_data + normalsOffset), m_vertexCount, &m_normals[0]);
+    uint32_t v = 0;
+    for(uint32_t i = 0; i < groups.size(); i++)
+    {
+        VertexGroup *g = groups[i];
+        for(uint32_t j = 0; j < g->count; j++, v++)
+        {
+            g->data[j].position = m_positions[v];
+            g->data[j].normal = m_normals[v];
+        }
+    }
+    return true;
+}
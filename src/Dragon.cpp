@@ -26,6 +26,45 @@
 #include "RenderState.h"
 #include "Scene.h"
 
+// Runs of constant transforms in the dragon hierarchy, folded into one matrix
+// each so that only the animated joints are evaluated when drawing.
+static const matrix4 TAIL_BASE = matrix4::translate(-1.0, 0.0, 0.0)
+    * matrix4::rotate(180.0, 0.0, 0.0, 1.0) * matrix4::rotate(90.0, 1.0, 0.0, 0.0)
+    * matrix4::scale(2.0, 3.0, 3.0);
+static const matrix4 JAW = matrix4::rotate(90.0, 1.0, 0.0, 0.0)
+    * matrix4::scale(1.0, 0.75, 0.5);
+static const matrix4 TONGUE = matrix4::translate(0.47, 0.0, 0.0)
+    * matrix4::scale(1.1, 0.275, 1.1) * matrix4::rotate(180.0, 1.0, 0.0, 0.0);
+static const matrix4 PAWS = matrix4::translate(0.0, -0.3, 0.0)
+    * matrix4::scale(1.3, 1.3, 1.3);
+static const matrix4 WING_FLIP = matrix4::rotate(180.0, 0.0, 1.0, 0.0);
+static const matrix4 WING_BASE = matrix4::rotate(90.0, 0.0, 1.0, 0.0)
+    * matrix4::scale(3.0, 3.0, 3.0);
+static const matrix4 WING_BONE = matrix4::rotate(90.0, 1.0, 0.0, 0.0)
+    * matrix4::scale(1.0, 2.6, 0.20);
+static const matrix4 MEMBRANE_INNER = matrix4::translate(0.25, 0.0, 0.0)
+    * matrix4::scale(0.26, 0.2, 0.2);
+static const matrix4 MEMBRANE_LEFT = matrix4::translate(0.70, 0.0, 0.3)
+    * matrix4::scale(0.3, 0.2, 0.27);
+static const matrix4 MEMBRANE_RIGHT = matrix4::translate(0.70, 0.0, -0.3)
+    * matrix4::scale(0.3, 0.2, 0.27);
+static const matrix4 MEMBRANE_OUTER = matrix4::translate(1.00, 0.0, 0.0)
+    * matrix4::rotate(180.0, 0.0, 1.0, 0.0) * matrix4::scale(0.3, 0.2, 0.27);
+static const matrix4 WING_OUTER = matrix4::translate(1.0, 0.0, 0.0)
+    * matrix4::rotate(180.0, 0.0, 0.0, 1.0);
+static const matrix4 FRONT_LEFT_PAW = matrix4::rotate(10.0, 0.0, 1.0, 0.0)
+    * matrix4::scale(0.8, 0.8, 0.8);
+static const matrix4 FRONT_RIGHT_PAW = matrix4::rotate(-10.0, 0.0, 1.0, 0.0)
+    * matrix4::scale(0.8, 0.8, 0.8);
+static const matrix4 HIND_LEFT_PAW = matrix4::rotate(10.0, 0.0, 1.0, 0.0)
+    * matrix4::scale(1.2, 1.2, 1.2);
+static const matrix4 HIND_RIGHT_PAW = matrix4::rotate(-10.0, 0.0, 1.0, 0.0)
+    * matrix4::scale(1.2, 1.2, 1.2);
+static const matrix4 CLAW = matrix4::rotate(90.0, 1.0, 0.0, 0.0)
+    * matrix4::scale(0.5, 0.5, 0.5);
+static const matrix4 TAIL_END = matrix4::translate(2.4, 0.0, 0.0)
+    * matrix4::rotate(180.0, 0.0, 1.0, 0.0) * matrix4::scale(2.4, 1.8, 1.8);
+
 Dragon::Dragon(Kind kind, RenderState *state) : StateObject(state)
 {
     m_kind = kind;
@@ -49,6 +88,13 @@ Dragon::Dragon(Kind kind, RenderState *state) : StateObject(state)
         vec4(1.0, 1.0, 1.0, 1.0), vec4(1.0, 1.0, 1.0, 1.0), 20.0);
     m_membraneMaterial = Material(vec4(0.1, 0.0, 0.0, 1.0),
         vec4(0.6, 0.0, 0.0, 1.0), vec4(0.2, 0.2, 0.2, 1.0), 20.0);
+    m_headMesh = meshHandle("dragon_head");
+    m_jointMesh = meshHandle("joint");
+    m_chestMesh = meshHandle("dragon_chest");
+    m_membraneMesh = meshHandle("wing_membrane");
+    m_tailEndMesh = meshHandle("dragon_tail_end");
+    m_letterAMesh = meshHandle("letter_a");
+    m_letterSMesh = meshHandle("letter_s");
     setDetailLevel(4);
 }
 
@@ -79,28 +125,21 @@ void Dragon::setBeta(float v)
 
 void Dragon::setDetailLevel(int level)
 {
+    // each level below the highest one halves the triangle count
     switch(level)
     {
         case 1:
-            m_jointParts = 1;
-            m_chestParts = 2;
-            m_tailEndParts = 1;
+            m_lod = 3;
             break;
         case 2:
-            m_jointParts = 2;
-            m_chestParts = 4;
-            m_tailEndParts = 2;
+            m_lod = 2;
             break;
         default:
         case 3:
-            m_jointParts = 4;
-            m_chestParts = 8;
-            m_tailEndParts = 4;
+            m_lod = 1;
             break;
         case 4:
-            m_jointParts = 8;
-            m_chestParts = 16;
-            m_tailEndParts = 8;
+            m_lod = 0;
             break;
     }
 }
@@ -143,10 +182,7 @@ void Dragon::draw()
         popMatrix();
 
         pushMatrix();
-            translate(-1.0, 0.0, 0.0);
-            rotate(180.0, 0.0, 0.0, 1.0);
-            rotate(90.0, 1.0, 0.0, 0.0);
-            scale(2.0, 3.0, 3.0);
+            multiplyMatrix(TAIL_BASE);
             drawTail();
         popMatrix();
     popMatrix();
@@ -173,7 +209,7 @@ void Dragon::drawUpper()
 void Dragon::drawHead()
 {
     pushMatrix();
-        drawMesh("dragon_head");
+        drawMesh(m_headMesh, m_lod);
         // tongue
         pushMatrix();
             pushMaterial(m_tongueMaterial);
@@ -186,9 +222,8 @@ void Dragon::drawHead()
         // jaw
         pushMatrix();
             rotate(-theta_jaw, 0.0, 0.0, 1.0);
-            rotate(90.0, 1.0, 0.0, 0.0);
-            scale(1.0, 0.75, 0.5);
-            drawMesh("letter_a");
+            multiplyMatrix(JAW);
+            drawMesh(m_letterAMesh);
         popMatrix();
     popMatrix();
 }
@@ -196,16 +231,14 @@ void Dragon::drawHead()
 void Dragon::drawTongue()
 {
     pushMatrix();
-        translate(0.47, 0.0, 0.0);
-        scale(1.1, 0.275, 1.1);
-        rotate(180.0, 1.0, 0.0, 0.0);
-        drawMesh("letter_s");
+        multiplyMatrix(TONGUE);
+        drawMesh(m_letterSMesh);
     popMatrix();
 }
 
 void Dragon::drawJoint()
 {
-    drawMesh("joint");
+    drawMesh(m_jointMesh, m_lod);
 }
 
 void Dragon::drawBody()
@@ -218,8 +251,7 @@ void Dragon::drawBody()
         popMatrix();
         
         pushMatrix();
-            translate(0.0, -0.3, 0.0);
-            scale(1.3, 1.3, 1.3);
+            multiplyMatrix(PAWS);
             drawPaws();
         popMatrix();
         
@@ -227,17 +259,15 @@ void Dragon::drawBody()
         pushMaterial(m_wingMaterial);
         pushMatrix();
             rotate(theta_wing, 1.0, 0.0, 0.0);
-            rotate(90.0, 0.0, 1.0, 0.0);
-            scale(3.0, 3.0, 3.0);
+            multiplyMatrix(WING_BASE);
             drawWing();
         popMatrix();
         
         // right wing
         pushMatrix();
-            rotate(180.0, 0.0, 1.0, 0.0);
+            multiplyMatrix(WING_FLIP);
             rotate(theta_wing, 1.0, 0.0, 0.0);
-            rotate(90.0, 0.0, 1.0, 0.0);
-            scale(3.0, 3.0, 3.0);
+            multiplyMatrix(WING_BASE);
             drawWing();
         popMatrix();
         popMaterial();
@@ -246,7 +276,7 @@ void Dragon::drawBody()
 
 void Dragon::drawChest()
 {
-    drawMesh("dragon_chest");
+    drawMesh(m_chestMesh, m_lod);
 }
 
 void Dragon::drawWing()
@@ -266,30 +296,24 @@ void Dragon::drawWing()
 void Dragon::drawWingPart()
 {
     pushMatrix();
-        rotate(90.0, 1.0, 0.0, 0.0);
-        scale(1.0, 2.6, 0.20);
-        drawMesh("letter_a");
+        multiplyMatrix(WING_BONE);
+        drawMesh(m_letterAMesh);
     popMatrix();
     pushMaterial(m_membraneMaterial);
     pushMatrix();
-        translate(0.25, 0.0, 0.0);
-        scale(0.26, 0.2, 0.2);
+        multiplyMatrix(MEMBRANE_INNER);
         drawWingMembrane();
     popMatrix();
     pushMatrix();
-        translate(0.70, 0.0, 0.3);
-        scale(0.3, 0.2, 0.27);
+        multiplyMatrix(MEMBRANE_LEFT);
         drawWingMembrane();
     popMatrix();
     pushMatrix();
-        translate(0.70, 0.0, -0.3);
-        scale(0.3, 0.2, 0.27);
+        multiplyMatrix(MEMBRANE_RIGHT);
         drawWingMembrane();
     popMatrix();
     pushMatrix();
-        translate(1.00, 0.0, 0.0);
-        rotate(180.0, 0.0, 1.0, 0.0);
-        scale(0.3, 0.2, 0.27);
+        multiplyMatrix(MEMBRANE_OUTER);
         drawWingMembrane();
     popMatrix();
     popMaterial();
@@ -297,14 +321,13 @@ void Dragon::drawWingPart()
 
 void Dragon::drawWingMembrane()
 {
-    drawMesh("wing_membrane");
+    drawMesh(m_membraneMesh);
 }
 
 void Dragon::drawWingOuter()
 {
     pushMatrix();
-        translate(1.0, 0.0, 0.0);
-        rotate(180.0, 0.0, 0.0, 1.0);
+        multiplyMatrix(WING_OUTER);
         drawWingPart();
     popMatrix();
 }
@@ -317,8 +340,7 @@ void Dragon::drawPaws()
         pushMatrix();
             translate(0.5, 0.0, -0.15);
             rotate(-theta_front_legs, 0.0, 0.0, 1.0);
-            rotate(10.0, 0.0, 1.0, 0.0);
-            scale(0.8, 0.8, 0.8);
+            multiplyMatrix(FRONT_LEFT_PAW);
             drawPaw();
         popMatrix();
         
@@ -326,8 +348,7 @@ void Dragon::drawPaws()
         pushMatrix();
             translate(0.5, 0.0, 0.15);
             rotate(-theta_front_legs, 0.0, 0.0, 1.0);
-            rotate(-10.0, 0.0, 1.0, 0.0);
-            scale(0.8, 0.8, 0.8);
+            multiplyMatrix(FRONT_RIGHT_PAW);
             drawPaw();
         popMatrix();
         
@@ -335,8 +356,7 @@ void Dragon::drawPaws()
         pushMatrix();
             translate(-0.5, 0.0, -0.15);
             rotate(-theta_back_legs, 0.0, 0.0, 1.0);
-            rotate(10.0, 0.0, 1.0, 0.0);
-            scale(1.2, 1.2, 1.2);
+            multiplyMatrix(HIND_LEFT_PAW);
             drawPaw();
         popMatrix();
         
@@ -344,8 +364,7 @@ void Dragon::drawPaws()
         pushMatrix();
             translate(-0.5, 0.0, 0.15);
             rotate(-theta_back_legs, 0.0, 0.0, 1.0);
-            rotate(-10.0, 0.0, 1.0, 0.0);
-            scale(1.2, 1.2, 1.2);
+            multiplyMatrix(HIND_RIGHT_PAW);
             drawPaw();
         popMatrix();
     popMatrix();
@@ -356,9 +375,8 @@ void Dragon::drawPaw()
     pushMatrix();
         translate(0.5, 0.0, 0.0);
         rotate(theta_paw, 0.0, 0.0, 1.0);
-        rotate(90.0, 1.0, 0.0, 0.0);
-        scale(0.5, 0.5, 0.5);
-        drawMesh("letter_a");
+        multiplyMatrix(CLAW);
+        drawMesh(m_letterAMesh);
     popMatrix();
     pushMatrix();
         scale(0.6, 0.5, 0.5);
@@ -401,9 +419,7 @@ void Dragon::drawTail()
                 scale(f, f, f);
                 drawJoint();
             }
-            translate(2.4, 0.0, 0.0);
-            rotate(180.0, 0.0, 1.0, 0.0);
-            scale(2.4, 1.8, 1.8);
+            multiplyMatrix(TAIL_END);
             drawTailEnd();
         popMatrix();
     popMatrix();
@@ -411,7 +427,7 @@ void Dragon::drawTail()
 
 void Dragon::drawTailEnd()
 {
-    drawMesh("dragon_tail_end");
+    drawMesh(m_tailEndMesh, m_lod);
 }
 
 void Dragon::animate(float t)
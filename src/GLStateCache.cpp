@@ -0,0 +1,232 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "Platform.h"
+#include "GLStateCache.h"
+
+void checkGlError(const char* op)
+{
+    for(GLint error = glGetError(); error; error = glGetError())
+        LOGI("after %s() glError (0x%x)\n", op, error);
+}
+
+// value of state that has not been set through the cache yet
+static const uint32_t UNKNOWN = 0xffffffff;
+
+GLStateCache::GLStateCache()
+{
+    invalidate();
+    resetCounters();
+}
+
+void GLStateCache::invalidate()
+{
+    m_flagCount = 0;
+    m_clientStateCount = 0;
+    m_activeTexture = UNKNOWN;
+    for(int i = 0; i < MAX_TEXTURE_UNITS; i++)
+        m_textures[i] = UNKNOWN;
+    m_arrayBuffer = UNKNOWN;
+    m_elementArrayBuffer = UNKNOWN;
+    m_program = UNKNOWN;
+    m_attribsEnabled = 0;
+    m_attribsKnown = 0;
+}
+
+bool GLStateCache::changeFlag(uint32_t *names, int8_t *values, int &count,
+                              uint32_t name, bool enabled)
+{
+    int i = 0;
+    while((i < count) && (names[i] != name))
+        i++;
+    if(i == count)
+    {
+        // flags that do not fit are not cached
+        if(count == MAX_FLAGS)
+        {
+            m_calls++;
+            return true;
+        }
+        names[i] = name;
+        values[i] = -1;
+        count++;
+    }
+    if(values[i] == (enabled ? 1 : 0))
+    {
+        m_skippedCalls++;
+        return false;
+    }
+    values[i] = enabled ? 1 : 0;
+    m_calls++;
+    return true;
+}
+
+bool GLStateCache::change(uint32_t &current, uint32_t value)
+{
+    if(current == value)
+    {
+        m_skippedCalls++;
+        return false;
+    }
+    current = value;
+    m_calls++;
+    return true;
+}
+
+void GLStateCache::setEnabled(uint32_t cap, bool enabled)
+{
+    if(!changeFlag(m_flagNames, m_flagValues, m_flagCount, cap, enabled))
+        return;
+    if(enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void GLStateCache::setClientState(uint32_t array, bool enabled)
+{
+    if(!changeFlag(m_clientStateNames, m_clientStateValues, m_clientStateCount, array, enabled))
+        return;
+    if(enabled)
+        glEnableClientState(array);
+    else
+        glDisableClientState(array);
+}
+
+void GLStateCache::activeTexture(uint32_t unit)
+{
+    if(change(m_activeTexture, unit))
+        glActiveTexture(unit);
+}
+
+void GLStateCache::bindTexture(uint32_t target, uint32_t texture)
+{
+    uint32_t unit = m_activeTexture - GL_TEXTURE0;
+    if((target == GL_TEXTURE_2D) && (unit < MAX_TEXTURE_UNITS))
+    {
+        if(change(m_textures[unit], texture))
+            glBindTexture(target, texture);
+        return;
+    }
+    // the unit is not known, so neither is any binding after this one
+    if(target == GL_TEXTURE_2D)
+    {
+        for(int i = 0; i < MAX_TEXTURE_UNITS; i++)
+            m_textures[i] = UNKNOWN;
+    }
+    m_calls++;
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::bindBuffer(uint32_t target, uint32_t buffer)
+{
+    uint32_t *current = 0;
+    if(target == GL_ARRAY_BUFFER)
+        current = &m_arrayBuffer;
+    else if(target == GL_ELEMENT_ARRAY_BUFFER)
+        current = &m_elementArrayBuffer;
+    if(current && !change(*current, buffer))
+        return;
+    if(!current)
+        m_calls++;
+    glBindBuffer(target, buffer);
+}
+
+void GLStateCache::deleteTexture(uint32_t texture)
+{
+    for(int i = 0; i < MAX_TEXTURE_UNITS; i++)
+    {
+        if(m_textures[i] == texture)
+            m_textures[i] = 0;
+    }
+}
+
+void GLStateCache::deleteBuffer(uint32_t buffer)
+{
+    if(m_arrayBuffer == buffer)
+        m_arrayBuffer = 0;
+    if(m_elementArrayBuffer == buffer)
+        m_elementArrayBuffer = 0;
+}
+
+#ifndef JNI_WRAPPER
+void GLStateCache::useProgram(uint32_t program)
+{
+    if(change(m_program, program))
+        glUseProgram(program);
+}
+
+void GLStateCache::setVertexAttribArray(int index, bool enabled)
+{
+    if(index < 0)
+        return;
+    if(index >= MAX_VERTEX_ATTRIBS)
+    {
+        m_calls++;
+    }
+    else
+    {
+        uint32_t bit = 1u << index;
+        if((m_attribsKnown & bit) && (((m_attribsEnabled & bit) != 0) == enabled))
+        {
+            m_skippedCalls++;
+            return;
+        }
+        m_attribsKnown |= bit;
+        if(enabled)
+            m_attribsEnabled |= bit;
+        else
+            m_attribsEnabled &= ~bit;
+        m_calls++;
+    }
+    if(enabled)
+        glEnableVertexAttribArray(index);
+    else
+        glDisableVertexAttribArray(index);
+}
+
+void GLStateCache::disableVertexAttribArrays()
+{
+    for(int i = 0; i < MAX_VERTEX_ATTRIBS; i++)
+    {
+        if(m_attribsEnabled & (1u << i))
+            setVertexAttribArray(i, false);
+    }
+}
+#endif
+
+uint32_t GLStateCache::calls() const
+{
+    return m_calls;
+}
+
+uint32_t GLStateCache::skippedCalls() const
+{
+    return m_skippedCalls;
+}
+
+void GLStateCache::resetCounters()
+{
+    m_calls = 0;
+    m_skippedCalls = 0;
+}
@@ -0,0 +1,502 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include "GltfWriter.h"
+#include "MeshOptimizer.h"
+#include "Platform.h"
+
+// OpenGL ES has no quads but meshes loaded elsewhere may still use them
+#ifndef GL_QUADS
+#define GL_QUADS                    0x0007
+#endif
+
+// Values from the glTF 2.0 specification. Like the binary mesh files, the
+// chunks are written in the byte order of the machine (little-endian).
+#define GLB_MAGIC 0x46546c67            // 'glTF'
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4e4f534a       // 'JSON'
+#define GLB_CHUNK_BIN 0x004e4942        // 'BIN\0'
+#define GLTF_ARRAY_BUFFER 34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+
+static bool sameMaterial(const Material &a, const Material &b)
+{
+    return (memcmp(&a.ambient(), &b.ambient(), sizeof(vec4)) == 0) &&
+        (memcmp(&a.diffuse(), &b.diffuse(), sizeof(vec4)) == 0) &&
+        (memcmp(&a.specular(), &b.specular(), sizeof(vec4)) == 0) &&
+        (a.shine() == b.shine()) && (a.texture() == b.texture());
+}
+
+static void writeJsonVec(ostream &s, const float *v, int count)
+{
+    s << "[";
+    for(int i = 0; i < count; i++)
+        s << (i ? "," : "") << v[i];
+    s << "]";
+}
+
+static void writeJsonString(ostream &s, const string &text)
+{
+    s << "\"";
+    for(uint32_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if((c == '"') || (c == '\\'))
+            s << '\\';
+        s << c;
+    }
+    s << "\"";
+}
+
+static uint32_t alignGlbSize(uint32_t size)
+{
+    return (size + 3) & ~3u;
+}
+
+// Encodes RGBA images as PNG. The image data is stored in uncompressed deflate
+// blocks, which every PNG decoder reads and which needs no zlib.
+class PngEncoder
+{
+public:
+    PngEncoder()
+    {
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            m_crcTable[i] = c;
+        }
+    }
+
+    // The pixels are packed like TIFFReadRGBAImage returns them, bottom row first.
+    void encode(const uint32_t *pixels, uint32_t width, uint32_t height, vector<char> &png) const
+    {
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        png.assign(signature, signature + 8);
+
+        vector<unsigned char> header;
+        appendBigEndian(header, width);
+        appendBigEndian(header, height);
+        header.push_back(8);            // bits per channel
+        header.push_back(6);            // RGBA
+        header.push_back(0);            // deflate
+        header.push_back(0);            // adaptive filtering
+        header.push_back(0);            // not interlaced
+        writeChunk(png, "IHDR", header);
+
+        // every row starts with its filter type, none here
+        vector<unsigned char> raw;
+        raw.reserve((size_t)height * (width * 4 + 1));
+        for(uint32_t y = height; y > 0; y--)
+        {
+            raw.push_back(0);
+            const uint32_t *row = pixels + (size_t)(y - 1) * width;
+            for(uint32_t x = 0; x < width; x++)
+            {
+                raw.push_back(row[x] & 0xff);
+                raw.push_back((row[x] >> 8) & 0xff);
+                raw.push_back((row[x] >> 16) & 0xff);
+                raw.push_back((row[x] >> 24) & 0xff);
+            }
+        }
+
+        // zlib stream made of stored blocks of at most 65535 bytes
+        vector<unsigned char> data;
+        data.push_back(0x78);
+        data.push_back(0x01);
+        size_t offset = 0;
+        do
+        {
+            uint32_t size = (uint32_t)min(raw.size() - offset, (size_t)0xffff);
+            bool last = (offset + size) == raw.size();
+            data.push_back(last ? 1 : 0);
+            data.push_back(size & 0xff);
+            data.push_back(size >> 8);
+            data.push_back(~size & 0xff);
+            data.push_back((~size >> 8) & 0xff);
+            data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+            offset += size;
+        } while(offset < raw.size());
+        uint32_t a = 1, b = 0;
+        for(size_t i = 0; i < raw.size(); i++)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(data, (b << 16) | a);
+        writeChunk(png, "IDAT", data);
+        writeChunk(png, "IEND", vector<unsigned char>());
+    }
+
+private:
+    static void appendBigEndian(vector<unsigned char> &data, uint32_t value)
+    {
+        data.push_back(value >> 24);
+        data.push_back((value >> 16) & 0xff);
+        data.push_back((value >> 8) & 0xff);
+        data.push_back(value & 0xff);
+    }
+
+    void writeChunk(vector<char> &png, const char *type, const vector<unsigned char> &data) const
+    {
+        vector<unsigned char> chunk;
+        appendBigEndian(chunk, data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        // the CRC covers the type and the data
+        uint32_t crc = 0xffffffff;
+        for(size_t i = 4; i < chunk.size(); i++)
+            crc = m_crcTable[(crc ^ chunk[i]) & 0xff] ^ (crc >> 8);
+        appendBigEndian(chunk, crc ^ 0xffffffff);
+        png.insert(png.end(), chunk.begin(), chunk.end());
+    }
+
+    uint32_t m_crcTable[256];
+};
+
+// Decode a TIFF texture and encode it as PNG, which glTF allows.
+static bool textureToPng(string path, vector<char> &png)
+{
+    uint32_t width = 0, height = 0;
+    uint32_t *pixels = Material::decodeTIFFImage(path, width, height);
+    if(!pixels)
+    {
+        fprintf(stderr, "Could not decode texture '%s', it is left out.\n", path.c_str());
+        return false;
+    }
+    PngEncoder().encode(pixels, width, height, png);
+    Material::freeTIFFImage(pixels);
+    return true;
+}
+
+GltfWriter::GltfWriter()
+{
+}
+
+GltfWriter::~GltfWriter()
+{
+    for(uint32_t i = 0; i < m_primitives.size(); i++)
+        delete m_primitives[i];
+}
+
+GltfWriter::Primitive * GltfWriter::findPrimitive(const Material &material, string texturePath)
+{
+    for(uint32_t i = 0; i < m_primitives.size(); i++)
+    {
+        Primitive *p = m_primitives[i];
+        if(sameMaterial(p->material, material) && (p->texturePath == texturePath))
+            return p;
+    }
+    Primitive *p = new Primitive();
+    p->material = material;
+    p->texturePath = texturePath;
+    m_primitives.push_back(p);
+    return p;
+}
+
+// Append the vertex indices of every triangle of the group.
+static void triangleIndices(const VertexGroupView &vg, vector<uint32_t> &indices)
+{
+    uint32_t elements = vg.elementCount();
+    switch(vg.mode)
+    {
+    case GL_TRIANGLES:
+        for(uint32_t i = 0; (i + 2) < elements; i += 3)
+        {
+            indices.push_back(vg.vertexIndex(i));
+            indices.push_back(vg.vertexIndex(i + 1));
+            indices.push_back(vg.vertexIndex(i + 2));
+        }
+        break;
+    case GL_QUADS:
+        for(uint32_t i = 0; (i + 3) < elements; i += 4)
+        {
+            uint32_t a = vg.vertexIndex(i), b = vg.vertexIndex(i + 1);
+            uint32_t c = vg.vertexIndex(i + 2), d = vg.vertexIndex(i + 3);
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+            indices.push_back(a);
+            indices.push_back(c);
+            indices.push_back(d);
+        }
+        break;
+    case GL_TRIANGLE_STRIP:
+        for(uint32_t i = 0; (i + 2) < elements; i++)
+        {
+            // every other triangle of a strip has the opposite winding
+            uint32_t a = vg.vertexIndex(i), b = vg.vertexIndex(i + 1), c = vg.vertexIndex(i + 2);
+            if(i % 2)
+                swap(a, b);
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+        break;
+    }
+}
+
+void GltfWriter::addGroup(const VertexGroupView &group, const Material &material, string texturePath)
+{
+    if(group.count() == 0)
+        return;
+    vector<uint32_t> indices;
+    triangleIndices(group, indices);
+    if(indices.size() == 0)
+        return;
+
+    // groups drawn without indices repeat shared vertices, weld them first
+    VertexGroup *welded = 0;
+    VertexGroupView vg = group;
+    if(group.indices.empty())
+    {
+        WeldingVertexSink sink;
+        for(uint32_t i = 0; i < indices.size(); i++)
+        {
+            VertexData v = group.vertex(indices[i]);
+            sink.addVertices(&v, 1);
+        }
+        welded = sink.createGroup(GL_TRIANGLES);
+        vg = VertexGroupView(welded);
+        indices.clear();
+        triangleIndices(vg, indices);
+    }
+
+    Primitive *p = findPrimitive(material, texturePath);
+    uint32_t base = p->vertices.size();
+    const VertexData *data = vg.vertexData();
+    if(data)
+    {
+        p->vertices.insert(p->vertices.end(), data, data + vg.count());
+    }
+    else
+    {
+        for(uint32_t i = 0; i < vg.count(); i++)
+            p->vertices.push_back(vg.vertex(i));
+    }
+    // glTF puts the origin of texture coordinates at the top left of the image
+    for(uint32_t i = base; i < p->vertices.size(); i++)
+        p->vertices[i].texCoords.y = 1.0f - p->vertices[i].texCoords.y;
+    for(uint32_t i = 0; i < indices.size(); i++)
+        p->indices.push_back(base + indices[i]);
+    delete welded;
+}
+
+bool GltfWriter::save(string path) const
+{
+    // lay out the binary chunk: the vertices then the indices of every primitive
+    vector<const Primitive *> primitives;
+    for(uint32_t i = 0; i < m_primitives.size(); i++)
+    {
+        if(m_primitives[i]->indices.size() > 0)
+            primitives.push_back(m_primitives[i]);
+    }
+    // glTF needs at least one primitive, accessor and buffer view
+    if(primitives.empty())
+        return false;
+    uint32_t binSize = 0;
+    vector<uint32_t> vertexOffsets, indexOffsets, indexSizes;
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        const Primitive *p = primitives[i];
+        vertexOffsets.push_back(binSize);
+        binSize += p->vertices.size() * sizeof(VertexData);
+        indexOffsets.push_back(binSize);
+        // the largest value of the index type is reserved for primitive restart
+        indexSizes.push_back((p->vertices.size() < 0x10000) ? 2 : 4);
+        binSize = alignGlbSize(binSize + p->indices.size() * indexSizes.back());
+    }
+
+    // the textures are embedded after the geometry, once each
+    vector<string> imagePaths, missingPaths;
+    vector< vector<char> > images;
+    vector<uint32_t> imageOffsets;
+    vector<int> primitiveImages(primitives.size(), -1);
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        string texturePath = primitives[i]->texturePath;
+        if(texturePath.empty() || (find(missingPaths.begin(), missingPaths.end(), texturePath) != missingPaths.end()))
+            continue;
+        uint32_t image = find(imagePaths.begin(), imagePaths.end(), texturePath) - imagePaths.begin();
+        if(image == imagePaths.size())
+        {
+            vector<char> png;
+            if(!textureToPng(texturePath, png))
+            {
+                missingPaths.push_back(texturePath);
+                continue;
+            }
+            imagePaths.push_back(texturePath);
+            images.push_back(png);
+            imageOffsets.push_back(binSize);
+            binSize = alignGlbSize(binSize + png.size());
+        }
+        primitiveImages[i] = image;
+    }
+
+    // describe the scene: one node with one mesh made of every primitive
+    stringstream json;
+    json.precision(9);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"dragon-demo\"},";
+    json << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],";
+    json << "\"meshes\":[{\"primitives\":[";
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        json << (i ? "," : "") << "{\"attributes\":{\"POSITION\":" << (i * 4)
+             << ",\"NORMAL\":" << (i * 4 + 1) << ",\"TEXCOORD_0\":" << (i * 4 + 2)
+             << "},\"indices\":" << (i * 4 + 3) << ",\"material\":" << i << "}";
+    }
+    json << "]}],\"materials\":[";
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        // the original parameters are kept as extras, glTF materials are physically based
+        const Material &m = primitives[i]->material;
+        float roughness = sqrt(2.0f / (m.shine() + 2.0f));
+        json << (i ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":";
+        writeJsonVec(json, &m.diffuse().x, 4);
+        json << ",\"metallicFactor\":0,\"roughnessFactor\":" << roughness;
+        if(primitiveImages[i] >= 0)
+            json << ",\"baseColorTexture\":{\"index\":" << primitiveImages[i] << "}";
+        json << "},\"extras\":{\"ambient\":";
+        writeJsonVec(json, &m.ambient().x, 4);
+        json << ",\"diffuse\":";
+        writeJsonVec(json, &m.diffuse().x, 4);
+        json << ",\"specular\":";
+        writeJsonVec(json, &m.specular().x, 4);
+        json << ",\"shine\":" << m.shine() << "}}";
+    }
+    json << "]";
+    if(images.size() > 0)
+    {
+        json << ",\"samplers\":[{}],\"textures\":[";
+        for(uint32_t i = 0; i < images.size(); i++)
+            json << (i ? "," : "") << "{\"sampler\":0,\"source\":" << i << "}";
+        json << "],\"images\":[";
+        for(uint32_t i = 0; i < images.size(); i++)
+        {
+            json << (i ? "," : "") << "{\"bufferView\":" << (primitives.size() * 2 + i)
+                 << ",\"mimeType\":\"image/png\",\"name\":";
+            writeJsonString(json, imagePaths[i]);
+            json << "}";
+        }
+        json << "]";
+    }
+    json << ",\"accessors\":[";
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        const Primitive *p = primitives[i];
+        vec3 minPos = p->vertices[0].position, maxPos = minPos;
+        for(uint32_t j = 1; j < p->vertices.size(); j++)
+        {
+            const vec3 &v = p->vertices[j].position;
+            minPos = vec3(min(minPos.x, v.x), min(minPos.y, v.y), min(minPos.z, v.z));
+            maxPos = vec3(max(maxPos.x, v.x), max(maxPos.y, v.y), max(maxPos.z, v.z));
+        }
+        uint32_t count = p->vertices.size();
+        json << (i ? "," : "") << "{\"bufferView\":" << (i * 2) << ",\"byteOffset\":0,\"componentType\":"
+             << GLTF_FLOAT << ",\"count\":" << count << ",\"type\":\"VEC3\",\"min\":";
+        writeJsonVec(json, &minPos.x, 3);
+        json << ",\"max\":";
+        writeJsonVec(json, &maxPos.x, 3);
+        json << "},{\"bufferView\":" << (i * 2) << ",\"byteOffset\":" << sizeof(vec3)
+             << ",\"componentType\":" << GLTF_FLOAT << ",\"count\":" << count << ",\"type\":\"VEC3\"}";
+        json << ",{\"bufferView\":" << (i * 2) << ",\"byteOffset\":" << (2 * sizeof(vec3))
+             << ",\"componentType\":" << GLTF_FLOAT << ",\"count\":" << count << ",\"type\":\"VEC2\"}";
+        json << ",{\"bufferView\":" << (i * 2 + 1) << ",\"byteOffset\":0,\"componentType\":"
+             << ((indexSizes[i] == 2) ? GLTF_UNSIGNED_SHORT : GLTF_UNSIGNED_INT)
+             << ",\"count\":" << p->indices.size() << ",\"type\":\"SCALAR\"}";
+    }
+    json << "],\"bufferViews\":[";
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        const Primitive *p = primitives[i];
+        json << (i ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << vertexOffsets[i]
+             << ",\"byteLength\":" << (p->vertices.size() * sizeof(VertexData))
+             << ",\"byteStride\":" << sizeof(VertexData) << ",\"target\":" << GLTF_ARRAY_BUFFER << "}";
+        json << ",{\"buffer\":0,\"byteOffset\":" << indexOffsets[i]
+             << ",\"byteLength\":" << (p->indices.size() * indexSizes[i])
+             << ",\"target\":" << GLTF_ELEMENT_ARRAY_BUFFER << "}";
+    }
+    for(uint32_t i = 0; i < images.size(); i++)
+    {
+        json << ((primitives.size() + i) ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << imageOffsets[i]
+             << ",\"byteLength\":" << images[i].size() << "}";
+    }
+    json << "],\"buffers\":[{\"byteLength\":" << binSize << "}]}";
+
+    // the JSON chunk is padded with spaces, the binary chunk with zeros
+    string jsonText = json.str();
+    jsonText.resize(alignGlbSize(jsonText.size()), ' ');
+    vector<char> bin(binSize, 0);
+    for(uint32_t i = 0; i < primitives.size(); i++)
+    {
+        const Primitive *p = primitives[i];
+        memcpy(&bin[vertexOffsets[i]], &p->vertices[0], p->vertices.size() * sizeof(VertexData));
+        if(indexSizes[i] == 2)
+        {
+            vector<uint16_t> shortIndices(p->indices.begin(), p->indices.end());
+            memcpy(&bin[indexOffsets[i]], &shortIndices[0], shortIndices.size() * sizeof(uint16_t));
+        }
+        else
+        {
+            memcpy(&bin[indexOffsets[i]], &p->indices[0], p->indices.size() * sizeof(uint32_t));
+        }
+    }
+    for(uint32_t i = 0; i < images.size(); i++)
+        memcpy(&bin[imageOffsets[i]], &images[i][0], images[i].size());
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == 0)
+    {
+        fprintf(stderr, "Could not open file '%s' for writing.\n", path.c_str());
+        return false;
+    }
+    uint32_t jsonSize = jsonText.size();
+    uint32_t header[3] = { GLB_MAGIC, GLB_VERSION, 12 + 8 + jsonSize + ((binSize > 0) ? 8 + binSize : 0) };
+    uint32_t jsonChunk[2] = { jsonSize, GLB_CHUNK_JSON };
+    uint32_t binChunk[2] = { binSize, GLB_CHUNK_BIN };
+    bool written = (fwrite(header, sizeof(header), 1, f) == 1) &&
+        (fwrite(jsonChunk, sizeof(jsonChunk), 1, f) == 1) &&
+        (fwrite(jsonText.data(), jsonSize, 1, f) == 1);
+    if(binSize > 0)
+    {
+        written = written && (fwrite(binChunk, sizeof(binChunk), 1, f) == 1) &&
+            (fwrite(&bin[0], binSize, 1, f) == 1);
+    }
+    fclose(f);
+    if(!written)
+    {
+        fprintf(stderr, "Could not write file '%s'.\n", path.c_str());
+        remove(path.c_str());
+    }
+    return written;
+}
@@ -95,88 +95,30 @@ void Material::setTexture(uint32_t texture)
     m_texture = texture;
 }
 
-void Material::freeTexture()
+static uint32_t * pixelsFromTIFF(TIFF *tiff, uint32_t &width, uint32_t &height)
 {
-    if(m_texture != 0)
-    {
-        glDeleteTextures(1, &m_texture);
-        m_texture = 0;
-    }
-}
-
-void setTextureParams(uint32_t target, bool mipmaps)
-{
-    if(mipmaps)
-        glTexParameterf(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    else
-        glTexParameterf(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameterf(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
-}
-
-void Material::loadTextureTIFF(string path, bool mipmaps)
-{
-    m_texture = textureFromTIFFImage(path, mipmaps);
-}
-
-void Material::loadTextureTIFF(const char *data, size_t size, bool mipmaps)
-{
-    m_texture = textureFromTIFFImage(data, size, mipmaps);
-}
-
-uint32_t textureFromTIFF(TIFF *tiff, bool mipmaps)
-{
-    uint32_t width, height;
+    width = height = 0;
     TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
     TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
 
     uint32_t *data = (uint32_t *) _TIFFmalloc(width * height * sizeof(uint32_t));
     if(!data)
-    {
-        TIFFClose(tiff);
         return 0;
-    }
 
     if(!TIFFReadRGBAImage(tiff, width, height, data, 1))
     {
         _TIFFfree(data);
-        TIFFClose(tiff);
         return 0;
     }
-
-    // create a texture
-    uint32_t texID = 0;
-    bool hasMipmaps = false;
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-#ifdef JNI_WRAPPER
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, data);
-#else
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, data);
-    if(mipmaps)
-    {
-        if(GLEW_ARB_framebuffer_object)
-        {
-            glGenerateMipmap(GL_TEXTURE_2D);
-            hasMipmaps = true;
-        }
-    }
-#endif
-    setTextureParams(GL_TEXTURE_2D, hasMipmaps);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    _TIFFfree(data);
-    return texID;
+    return data;
 }
 
-uint32_t Material::textureFromTIFFImage(string path, bool mipmaps)
+uint32_t * Material::decodeTIFFImage(string path, uint32_t &width, uint32_t &height)
 {
     string blob;
     if (!loadFileBlob(path, blob))
         return 0;
-    return textureFromTIFFImage(blob.data(), blob.size(), mipmaps);
+    return decodeTIFFImage(blob.data(), blob.size(), width, height);
 }
 
 typedef struct
@@ -250,7 +192,7 @@ void tiff_Unmap(thandle_t, tdata_t, toff_t)
 {
 }
 
-uint32_t Material::textureFromTIFFImage(const char *data, size_t size, bool mipmaps)
+uint32_t * Material::decodeTIFFImage(const char *data, size_t size, uint32_t &width, uint32_t &height)
 {
     tiff_stream s;
     s.buffer = data;
@@ -261,7 +203,13 @@ uint32_t Material::textureFromTIFFImage(const char *data, size_t size, bool mipm
         tiff_Read, tiff_Write, tiff_Seek, tiff_Close, tiff_Size, tiff_Map, tiff_Unmap);
     if(!tiff)
         return 0;
-    uint32_t texID = textureFromTIFF(tiff, mipmaps);
+    uint32_t *pixels = pixelsFromTIFF(tiff, width, height);
     TIFFClose(tiff);
-    return texID;
+    return pixels;
+}
+
+void Material::freeTIFFImage(uint32_t *pixels)
+{
+    if(pixels)
+        _TIFFfree(pixels);
 }
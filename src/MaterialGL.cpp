@@ -0,0 +1,103 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "Platform.h"
+#include "Material.h"
+
+void Material::freeTexture()
+{
+    if(m_texture != 0)
+    {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+}
+
+void setTextureParams(uint32_t target, bool mipmaps)
+{
+    if(mipmaps)
+        glTexParameterf(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    else
+        glTexParameterf(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+void Material::loadTextureTIFF(string path, bool mipmaps)
+{
+    m_texture = textureFromTIFFImage(path, mipmaps);
+}
+
+void Material::loadTextureTIFF(const char *data, size_t size, bool mipmaps)
+{
+    m_texture = textureFromTIFFImage(data, size, mipmaps);
+}
+
+uint32_t Material::textureFromPixels(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps)
+{
+    if(!pixels)
+        return 0;
+
+    // create a texture
+    uint32_t texID = 0;
+    bool hasMipmaps = false;
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+#ifdef JNI_WRAPPER
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+#else
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    if(mipmaps)
+    {
+        if(GLEW_ARB_framebuffer_object)
+        {
+            glGenerateMipmap(GL_TEXTURE_2D);
+            hasMipmaps = true;
+        }
+    }
+#endif
+    setTextureParams(GL_TEXTURE_2D, hasMipmaps);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texID;
+}
+
+uint32_t Material::textureFromTIFFImage(string path, bool mipmaps)
+{
+    uint32_t width, height;
+    uint32_t *pixels = decodeTIFFImage(path, width, height);
+    uint32_t texID = textureFromPixels(pixels, width, height, mipmaps);
+    freeTIFFImage(pixels);
+    return texID;
+}
+
+uint32_t Material::textureFromTIFFImage(const char *data, size_t size, bool mipmaps)
+{
+    uint32_t width, height;
+    uint32_t *pixels = decodeTIFFImage(data, size, width, height);
+    uint32_t texID = textureFromPixels(pixels, width, height, mipmaps);
+    freeTIFFImage(pixels);
+    return texID;
+}
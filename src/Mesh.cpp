@@ -21,12 +21,15 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <cfloat>
+#include <climits>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include "Mesh.h"
 #include "Material.h"
@@ -52,6 +55,48 @@ Mesh::Mesh()
 
 Mesh::~Mesh()
 {
+    for(uint32_t i = 0; i < m_lods.size(); i++)
+        delete m_lods[i];
+}
+
+VertexPacker::Format Mesh::vertexFormat() const
+{
+    return VertexPacker::Float;
+}
+
+bool Mesh::setVertexFormat(VertexPacker::Format format)
+{
+    return format == VertexPacker::Float;
+}
+
+void Mesh::takeGroup(VertexGroup *vg)
+{
+    addGroup(vg);
+    delete vg;
+}
+
+bool Mesh::copyGroupTo(int index, VertexGroup *vg) const
+{
+    VertexGroupView view;
+    return groupView(index, view) && view.copyTo(vg);
+}
+
+int Mesh::lodCount() const
+{
+    return m_lods.size() + 1;
+}
+
+Mesh * Mesh::lod(int level)
+{
+    if((level <= 0) || m_lods.empty())
+        return this;
+    return m_lods[min((size_t)level, m_lods.size()) - 1];
+}
+
+void Mesh::addLod(Mesh *lod)
+{
+    if(lod)
+        m_lods.push_back(lod);
 }
 
 /* Show the normal for every vertex in the mesh, for debugging purposes. */
@@ -60,368 +105,1674 @@ void Mesh::drawNormals(RenderState *s)
     (void)s;
 }
 
-VertexGroup * Mesh::loadStl(string path, bool computeNormals)
+typedef struct
 {
-    VertexGroup *vg = 0;
-    FILE *f = fopen(path.c_str(), "rb");
-    char header[80];
-    uint32_t triangles = 0;
-    vec3 points[4];
-    uint16_t attributes;
+    int vertexIndex;
+    int normalIndex;
+    int texCoordsIndex;
+} ObjPoint;
+
+typedef struct
+{
+    size_t vertices;
+    size_t normals;
+    size_t texCoords;
+    size_t faces;
+} ObjCounts;
+
+static inline bool isObjSpace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static inline bool isObjDigit(char c)
+{
+    return (c >= '0') && (c <= '9');
+}
+
+static inline const char * skipObjSpaces(const char *p, const char *end)
+{
+    while((p < end) && isObjSpace(*p))
+        p++;
+    return p;
+}
+
+static inline const char * nextObjLine(const char *p, const char *end)
+{
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    return eol ? (eol + 1) : end;
+}
+
+// Powers of ten that can be represented exactly as doubles.
+static const double objPowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+};
+
+// Slow path for numbers the fast path does not handle (e.g. 'nan' or 'inf').
+static const char * parseObjFloatSlow(const char *p, const char *end, float &f)
+{
+    char buffer[64];
+    size_t n = 0;
+    while((p + n < end) && (n < sizeof(buffer) - 1) && !isObjSpace(p[n]) && (p[n] != '\n'))
+    {
+        buffer[n] = p[n];
+        n++;
+    }
+    buffer[n] = '\0';
+    char *last = 0;
+    double value = strtod(buffer, &last);
+    if(last == buffer)
+        return 0;
+    f = (float)value;
+    return p + (last - buffer);
+}
+
+// Parse a floating-point number without going through the C locale.
+static const char * parseObjFloat(const char *p, const char *end, float &f)
+{
+    const char *start = p;
+    bool negative = false;
+    if((p < end) && ((*p == '-') || (*p == '+')))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    for(; (p < end) && isObjDigit(*p); p++, hasDigits = true)
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if(mantissa)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if((p < end) && (*p == '.'))
+    {
+        for(p++; (p < end) && isObjDigit(*p); p++, hasDigits = true)
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    if(!hasDigits)
+        return parseObjFloatSlow(start, end, f);
+    if((p < end) && ((*p == 'e') || (*p == 'E')))
+    {
+        const char *q = p + 1;
+        bool negativeExp = false;
+        if((q < end) && ((*q == '-') || (*q == '+')))
+        {
+            negativeExp = (*q == '-');
+            q++;
+        }
+        if((q < end) && isObjDigit(*q))
+        {
+            int e = 0;
+            for(; (q < end) && isObjDigit(*q); q++)
+            {
+                if(e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExp ? -e : e;
+            p = q;
+        }
+    }
+    if((mantissa < (1 << 24)) && (exponent >= -10) && (exponent <= 10))
+    {
+        // both operands are exact floats so the result is correctly rounded
+        float value = (float)mantissa;
+        if(exponent < 0)
+            value /= (float)objPowersOfTen[-exponent];
+        else
+            value *= (float)objPowersOfTen[exponent];
+        f = negative ? -value : value;
+        return p;
+    }
+    double value = (double)mantissa;
+    if((exponent < 0) && (exponent >= -22))
+        value /= objPowersOfTen[-exponent];
+    else if((exponent > 0) && (exponent <= 22))
+        value *= objPowersOfTen[exponent];
+    else if(exponent != 0)
+        value *= pow(10.0, exponent);
+    f = (float)(negative ? -value : value);
+    return p;
+}
+
+static inline const char * parseObjInt(const char *p, const char *end, int &i)
+{
+    bool negative = false;
+    if((p < end) && ((*p == '-') || (*p == '+')))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    if((p >= end) || !isObjDigit(*p))
+        return 0;
+    int64_t value = 0;
+    for(; (p < end) && isObjDigit(*p); p++)
+    {
+        value = value * 10 + (*p - '0');
+        if(value > INT_MAX)
+            return 0;
+    }
+    i = negative ? -(int)value : (int)value;
+    return p;
+}
+
+static const char * parseObjFloats(const char *p, const char *end, float *values, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        p = skipObjSpaces(p, end);
+        if(!p || (p >= end))
+            return 0;
+        p = parseObjFloat(p, end, values[i]);
+        if(!p)
+            return 0;
+    }
+    return p;
+}
+
+// Parse a face point in one of the 'v', 'v/t', 'v//n' or 'v/t/n' forms.
+// Missing texture or normal indices default to the vertex index.
+static const char * parseObjPoint(const char *p, const char *end, ObjPoint &point)
+{
+    int vertexIndex = 0;
+    p = parseObjInt(p, end, vertexIndex);
+    if(!p)
+        return 0;
+    point.vertexIndex = vertexIndex;
+    point.texCoordsIndex = vertexIndex;
+    point.normalIndex = vertexIndex;
+    if((p >= end) || (*p != '/'))
+        return p;
+    p++;
+    if((p < end) && (*p != '/'))
+    {
+        p = parseObjInt(p, end, point.texCoordsIndex);
+        if(!p)
+            return 0;
+    }
+    if((p >= end) || (*p != '/'))
+        return p;
+    return parseObjInt(p + 1, end, point.normalIndex);
+}
+
+// Convert a one-based (or negative, relative) OBJ index to a zero-based one.
+static inline int resolveObjIndex(int index, size_t count)
+{
+    if(index > 0)
+        return index - 1;
+    else if(index < 0)
+        return (int)count + index;
+    else
+        return -1;
+}
+
+// Attribute tables that the indices of a face refer to. Faces can only refer
+// to the elements that were defined before them.
+typedef struct
+{
+    const vec3 *vertices;
+    const vec3 *normals;
+    const vec2 *texCoords;
+    size_t vertexCount;
+    size_t normalCount;
+    size_t texCoordsCount;
+} ObjTables;
+
+enum ObjLineType
+{
+    ObjOther,
+    ObjVertex,
+    ObjNormal,
+    ObjTexCoords,
+    ObjFace
+};
+
+// Type of the line, p being its first non-space character.
+static inline ObjLineType objLineType(const char *p, const char *end)
+{
+    if((end - p) < 2)
+        return ObjOther;
+    else if((p[0] == 'v') && isObjSpace(p[1]))
+        return ObjVertex;
+    else if((p[0] == 'v') && (p[1] == 'n'))
+        return ObjNormal;
+    else if((p[0] == 'v') && (p[1] == 't'))
+        return ObjTexCoords;
+    else if((p[0] == 'f') && isObjSpace(p[1]))
+        return ObjFace;
+    else
+        return ObjOther;
+}
+
+// The vector types' default constructors leave their members uninitialized,
+// so the caller passes the value to use for missing elements.
+template<class T>
+static T safe_value(const T *data, size_t count, int index, const T &missing)
+{
+    if((index < 0) || ((size_t)index >= count))
+        return missing;
+    else
+        return data[index];
+}
+
+template<class T>
+static inline const T * objTableData(const vector<T> &table)
+{
+    return table.empty() ? 0 : &table[0];
+}
+
+// Give the three vertices of each triangle the normal of the triangle.
+static void setFaceNormals(VertexData *triangles, uint32_t count)
+{
+    if(count == 0)
+        return;
+    uint32_t stride = 3 * sizeof(VertexData);
+    vec3::normals(&triangles[0].position, &triangles[1].position, &triangles[2].position,
+                  stride, &triangles[0].normal, stride, count);
+    for(uint32_t i = 0; i < count; i++, triangles += 3)
+        triangles[1].normal = triangles[2].normal = triangles[0].normal;
+}
+
+// Parse the points of a face and write its triangles, as a fan around the first
+// point. Output::addTriangle() returns where to write the three vertices. When
+// the file has no normals (yet) the output computes them from the positions,
+// for many triangles at once.
+template<class Output>
+static void parseObjFace(const char *p, const char *end, const ObjTables &tables, Output &output)
+{
+    const vec3 zero3(0.0, 0.0, 0.0);
+    const vec2 zero2(0.0, 0.0);
+    ObjPoint points[3];
+    int n = 0;
+    for(p = skipObjSpaces(p, end); (p < end) && (*p != '\n') && (*p != '#');
+        p = skipObjSpaces(p, end))
+    {
+        ObjPoint &point = points[(n < 2) ? n : 2];
+        p = parseObjPoint(p, end, point);
+        if(!p)
+            break;
+        point.vertexIndex = resolveObjIndex(point.vertexIndex, tables.vertexCount);
+        point.normalIndex = resolveObjIndex(point.normalIndex, tables.normalCount);
+        point.texCoordsIndex = resolveObjIndex(point.texCoordsIndex, tables.texCoordsCount);
+        if(++n < 3)
+            continue;
+        bool computeNormals = (tables.normalCount == 0);
+        VertexData *vd = output.addTriangle(computeNormals);
+        for(int i = 0; i < 3; i++)
+        {
+            vd[i].position = safe_value(tables.vertices, tables.vertexCount, points[i].vertexIndex, zero3);
+            if(!computeNormals)
+                vd[i].normal = safe_value(tables.normals, tables.normalCount, points[i].normalIndex, zero3);
+            vd[i].texCoords = safe_value(tables.texCoords, tables.texCoordsCount, points[i].texCoordsIndex, zero2);
+        }
+        points[1] = points[2];
+    }
+}
+
+// Count the triangles parseObjFace would write for the face.
+static size_t countObjFaceTriangles(const char *p, const char *end)
+{
+    ObjPoint point;
+    size_t n = 0;
+    for(p = skipObjSpaces(p, end); (p < end) && (*p != '\n') && (*p != '#');
+        p = skipObjSpaces(p, end))
+    {
+        p = parseObjPoint(p, end, point);
+        if(!p)
+            break;
+        n++;
+    }
+    return (n > 2) ? (n - 2) : 0;
+}
+
+// Count the elements in the buffer.
+static void countObjElements(const char *data, const char *end, ObjCounts &counts)
+{
+    memset(&counts, 0, sizeof(ObjCounts));
+    for(const char *p = data; p < end; p = nextObjLine(p, end))
+    {
+        switch(objLineType(skipObjSpaces(p, end), end))
+        {
+        case ObjVertex:
+            counts.vertices++;
+            break;
+        case ObjNormal:
+            counts.normals++;
+            break;
+        case ObjTexCoords:
+            counts.texCoords++;
+            break;
+        case ObjFace:
+            counts.faces++;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Parser state shared by the buffer and streaming OBJ loaders. Triangles are
+// sent to the sink in batches, as soon as their face has been parsed.
+class ObjParser
+{
+public:
+    ObjParser(VertexSink *sink)
+    {
+        m_sink = sink;
+        m_batchSize = 0;
+        m_faceNormalCount = 0;
+    }
+
+    void reserve(const ObjCounts &counts)
+    {
+        m_vertices.reserve(counts.vertices);
+        m_normals.reserve(counts.normals);
+        m_texCoords.reserve(counts.texCoords);
+    }
+
+    // Parse the complete lines in the buffer, or every line if it is the last
+    // one. Returns the number of bytes parsed.
+    size_t parseLines(const char *data, size_t size, bool last)
+    {
+        const char *end = data + size;
+        const char *line = data;
+        while(line < end)
+        {
+            const char *lineEnd = (const char *)memchr(line, '\n', end - line);
+            if(!lineEnd && !last)
+                break;
+            lineEnd = lineEnd ? (lineEnd + 1) : end;
+            parseLine(line, lineEnd);
+            line = lineEnd;
+        }
+        return line - data;
+    }
+
+    VertexData * addTriangle(bool faceNormal)
+    {
+        if((m_batchSize + 3) > (sizeof(m_batch) / sizeof(VertexData)))
+            flush();
+        VertexData *triangle = m_batch + m_batchSize;
+        m_batchSize += 3;
+        // faces only lack normals until the first one is defined, so these
+        // triangles are at the start of the batch
+        if(faceNormal)
+            m_faceNormalCount++;
+        return triangle;
+    }
+
+    void flush()
+    {
+        setFaceNormals(m_batch, m_faceNormalCount);
+        if(m_batchSize > 0)
+            m_sink->addVertices(m_batch, m_batchSize);
+        m_batchSize = 0;
+        m_faceNormalCount = 0;
+    }
+
+private:
+    void parseLine(const char *p, const char *end);
+
+    vector<vec3> m_vertices;
+    vector<vec3> m_normals;
+    vector<vec2> m_texCoords;
+    VertexSink *m_sink;
+    VertexData m_batch[3 * 256];
+    uint32_t m_batchSize;
+    uint32_t m_faceNormalCount;     // triangles at the start of the batch without normals
+};
+
+void ObjParser::parseLine(const char *p, const char *end)
+{
+    float v[3];
+    p = skipObjSpaces(p, end);
+    switch(objLineType(p, end))
+    {
+    case ObjVertex:
+        if(parseObjFloats(p + 1, end, v, 3))
+            m_vertices.push_back(vec3(v[0], v[1], v[2]));
+        break;
+    case ObjNormal:
+        if(parseObjFloats(p + 2, end, v, 3))
+            m_normals.push_back(vec3(v[0], v[1], v[2]));
+        break;
+    case ObjTexCoords:
+        if(parseObjFloats(p + 2, end, v, 2))
+            m_texCoords.push_back(vec2(v[0], v[1]));
+        break;
+    case ObjFace:
+        {
+            ObjTables tables =
+            {
+                objTableData(m_vertices), objTableData(m_normals), objTableData(m_texCoords),
+                m_vertices.size(), m_normals.size(), m_texCoords.size()
+            };
+            parseObjFace(p + 1, end, tables, *this);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Buffers smaller than this are not worth splitting between threads.
+static const size_t OBJ_PARALLEL_SIZE = 4 << 20;
+
+// Lines of the buffer parsed by one thread. The attributes are parsed first and
+// counted, so that the tables of every range can be concatenated and the faces
+// written at their final place in the mesh in a second pass.
+class ObjRangeTask : public Task
+{
+public:
+    enum Pass
+    {
+        ParseAttributes,
+        ParseFaces
+    };
+
+    ObjRangeTask(const char *start, const char *end)
+    {
+        this->start = start;
+        this->end = end;
+        pass = ParseAttributes;
+        triangles = 0;
+        memset(&tables, 0, sizeof(ObjTables));
+        output = 0;
+        faceNormalCount = 0;
+    }
+
+    virtual void run()
+    {
+        if(pass == ParseAttributes)
+            parseAttributes();
+        else
+            parseFaces();
+    }
+
+    VertexData * addTriangle(bool faceNormal)
+    {
+        VertexData *triangle = output;
+        output += 3;
+        if(faceNormal)
+            faceNormalCount++;
+        return triangle;
+    }
+
+    const char *start;
+    const char *end;
+    Pass pass;
+    vector<vec3> vertices;
+    vector<vec3> normals;
+    vector<vec2> texCoords;
+    // attribute lines that could not be parsed and do not count as elements
+    vector<const char *> invalidLines;
+    size_t triangles;
+    // whole tables, with the number of elements defined before the range
+    ObjTables tables;
+    VertexData *output;
+    // triangles at the start of the output without normals
+    uint32_t faceNormalCount;
+
+private:
+    void parseAttributes();
+    void parseFaces();
+};
+
+void ObjRangeTask::parseAttributes()
+{
+    float v[3];
+    for(const char *line = start; line < end; )
+    {
+        const char *lineEnd = nextObjLine(line, end);
+        const char *p = skipObjSpaces(line, lineEnd);
+        switch(objLineType(p, lineEnd))
+        {
+        case ObjVertex:
+            if(parseObjFloats(p + 1, lineEnd, v, 3))
+                vertices.push_back(vec3(v[0], v[1], v[2]));
+            else
+                invalidLines.push_back(line);
+            break;
+        case ObjNormal:
+            if(parseObjFloats(p + 2, lineEnd, v, 3))
+                normals.push_back(vec3(v[0], v[1], v[2]));
+            else
+                invalidLines.push_back(line);
+            break;
+        case ObjTexCoords:
+            if(parseObjFloats(p + 2, lineEnd, v, 2))
+                texCoords.push_back(vec2(v[0], v[1]));
+            else
+                invalidLines.push_back(line);
+            break;
+        case ObjFace:
+            triangles += countObjFaceTriangles(p + 1, lineEnd);
+            break;
+        default:
+            break;
+        }
+        line = lineEnd;
+    }
+}
+
+void ObjRangeTask::parseFaces()
+{
+    VertexData *first = output;
+    size_t invalid = 0;
+    for(const char *line = start; line < end; )
+    {
+        const char *lineEnd = nextObjLine(line, end);
+        const char *p = skipObjSpaces(line, lineEnd);
+        ObjLineType type = objLineType(p, lineEnd);
+        if(type == ObjFace)
+        {
+            parseObjFace(p + 1, lineEnd, tables, *this);
+        }
+        else if((invalid < invalidLines.size()) && (invalidLines[invalid] == line))
+        {
+            invalid++;
+        }
+        else if(type == ObjVertex)
+        {
+            tables.vertexCount++;
+        }
+        else if(type == ObjNormal)
+        {
+            tables.normalCount++;
+        }
+        else if(type == ObjTexCoords)
+        {
+            tables.texCoordsCount++;
+        }
+        line = lineEnd;
+    }
+    setFaceNormals(first, faceNormalCount);
+}
+
+template<class T>
+static void concatObjTables(vector<T> &table, vector<T> &rangeTable, size_t &offset)
+{
+    if(rangeTable.size() > 0)
+        memcpy(&table[offset], &rangeTable[0], rangeTable.size() * sizeof(T));
+    offset += rangeTable.size();
+    vector<T>().swap(rangeTable);
+}
+
+static void runObjTasks(TaskPool &pool, vector<ObjRangeTask *> &ranges)
+{
+    for(size_t i = 0; i < ranges.size(); i++)
+        pool.start(ranges[i]);
+    while(pool.waitForNext())
+    {
+    }
+}
+
+static VertexGroup * loadObjParallel(const char *data, size_t size, TaskPool &pool)
+{
+    // split the buffer in ranges of whole lines, a few per thread to balance the load
+    const char *end = data + size;
+    size_t rangeCount = pool.threadCount() * 4;
+    vector<ObjRangeTask *> ranges;
+    const char *start = data;
+    for(size_t i = 1; (i <= rangeCount) && (start < end); i++)
+    {
+        const char *rangeEnd = data + (size * i) / rangeCount;
+        if(rangeEnd <= start)
+            continue;
+        rangeEnd = nextObjLine(rangeEnd - 1, end);
+        ranges.push_back(new ObjRangeTask(start, rangeEnd));
+        start = rangeEnd;
+    }
+
+    // parse the attributes and count the triangles of every range
+    runObjTasks(pool, ranges);
+    ObjCounts counts;
+    memset(&counts, 0, sizeof(ObjCounts));
+    size_t triangles = 0;
+    for(size_t i = 0; i < ranges.size(); i++)
+    {
+        counts.vertices += ranges[i]->vertices.size();
+        counts.normals += ranges[i]->normals.size();
+        counts.texCoords += ranges[i]->texCoords.size();
+        triangles += ranges[i]->triangles;
+    }
+    vector<vec3> vertices(counts.vertices);
+    vector<vec3> normals(counts.normals);
+    vector<vec2> texCoords(counts.texCoords);
+    VertexGroup *vg = new VertexGroup(GL_TRIANGLES, triangles * 3);
+
+    // fix up the offsets of every range with prefix sums, then parse the faces
+    ObjTables tables =
+    {
+        objTableData(vertices), objTableData(normals), objTableData(texCoords), 0, 0, 0
+    };
+    VertexData *output = vg->data;
+    for(size_t i = 0; i < ranges.size(); i++)
+    {
+        ObjRangeTask *range = ranges[i];
+        range->pass = ObjRangeTask::ParseFaces;
+        range->tables = tables;
+        range->output = output;
+        concatObjTables(vertices, range->vertices, tables.vertexCount);
+        concatObjTables(normals, range->normals, tables.normalCount);
+        concatObjTables(texCoords, range->texCoords, tables.texCoordsCount);
+        output += range->triangles * 3;
+    }
+    runObjTasks(pool, ranges);
+
+    for(size_t i = 0; i < ranges.size(); i++)
+        delete ranges[i];
+    return vg;
+}
+
+// Size of the chunks read by the streaming loader. Lines longer than this make
+// the buffer grow.
+static const size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+// Read and parse chunks until the source is empty. read() returns 0 at the end.
+template<class Source>
+static void streamObj(Source &source, VertexSink *sink)
+{
+    ObjParser parser(sink);
+    vector<char> buffer(OBJ_CHUNK_SIZE);
+    size_t used = 0;
+    while(true)
+    {
+        if(used == buffer.size())
+            buffer.resize(buffer.size() * 2);
+        size_t count = source.read(&buffer[used], buffer.size() - used);
+        used += count;
+        size_t parsed = parser.parseLines(&buffer[0], used, count == 0);
+        // keep the start of a line split across two chunks for the next read
+        used -= parsed;
+        if(used > 0)
+            memmove(&buffer[0], &buffer[parsed], used);
+        if(count == 0)
+            break;
+    }
+    parser.flush();
+}
+
+// Adapts an input stream to the source interface used by streamObj.
+class ObjStreamSource
+{
+public:
+    ObjStreamSource(istream &s) : m_stream(s)
+    {
+    }
+
+    size_t read(char *buffer, size_t size)
+    {
+        m_stream.read(buffer, size);
+        return m_stream.gcount();
+    }
+
+private:
+    istream &m_stream;
+};
+
+VertexGroup * Mesh::loadObj(string path)
+{
+    // files on disk can be parsed in parallel, resources have to be streamed
+    size_t size = 0;
+    const char *data = mapFileData(path, size);
+    if(data)
+    {
+        VertexGroup *vg = loadObj(data, size);
+        unmapFileData(data, size);
+        return vg;
+    }
+    VertexArraySink sink;
+    if(!loadObj(path, &sink))
+        return 0;
+    return sink.createGroup(GL_TRIANGLES);
+}
+
+VertexGroup * Mesh::loadObj(istream &s)
+{
+    VertexArraySink sink;
+    loadObj(s, &sink);
+    return sink.createGroup(GL_TRIANGLES);
+}
+
+VertexGroup * Mesh::loadObj(const char *data, size_t size, int threads)
+{
+    if((size >= OBJ_PARALLEL_SIZE) && (threads != 1))
+    {
+        TaskPool pool(threads);
+        if(pool.threadCount() > 1)
+            return loadObjParallel(data, size, pool);
+    }
+
+    // count the elements first so that every array is allocated once
+    ObjCounts counts;
+    countObjElements(data, data + size, counts);
+    VertexArraySink sink;
+    sink.reserve(counts.faces * 3);
+    ObjParser parser(&sink);
+    parser.reserve(counts);
+    parser.parseLines(data, size, true);
+    parser.flush();
+    return sink.createGroup(GL_TRIANGLES);
+}
+
+bool Mesh::loadObj(string path, VertexSink *sink)
+{
+    FileReader reader;
+    if(!reader.open(path))
+    {
+        cerr << "Could not open file '" << path << "'." << endl;
+        return false;
+    }
+    streamObj(reader, sink);
+    return true;
+}
+
+void Mesh::loadObj(istream &s, VertexSink *sink)
+{
+    ObjStreamSource source(s);
+    streamObj(source, sink);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Binary STL files have an 80-byte header and a triangle count, followed by one
+// 50-byte record per triangle: the normal, three points and a 16-bit attribute.
+static const size_t STL_HEADER_SIZE = 84;
+static const size_t STL_TRIANGLE_SIZE = 50;
+
+// Files with fewer triangles are not worth decoding on several threads.
+static const uint32_t STL_PARALLEL_TRIANGLES = 1 << 16;
+
+// Number of triangles encoded in memory before each write when saving.
+static const uint32_t STL_WRITE_BLOCK = 1 << 14;
+
+// Largest number of decoded triangles whose normals are computed at once.
+static const uint32_t STL_NORMAL_BLOCK = 256;
+
+static void decodeStlTriangles(const char *records, uint32_t count, bool computeNormals,
+                               VertexData *output)
+{
+    // many scanners leave the normals out, they are computed for runs of such
+    // triangles once their positions have been decoded, while still in the cache
+    uint32_t missing = 0;
+    for(uint32_t i = 0; i < count; i++, records += STL_TRIANGLE_SIZE)
+    {
+        vec3 values[4];
+        memcpy(values, records, sizeof(values));
+        VertexData *triangle = output + 3 * i;
+        const vec3 &n = values[0];
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            triangle[j].position = values[j + 1];
+            triangle[j].normal = n;
+            triangle[j].texCoords = vec2(0.0, 0.0);
+        }
+        bool needed = computeNormals || ((n.x == 0.0f) && (n.y == 0.0f) && (n.z == 0.0f));
+        uint32_t end = needed ? (i + 1) : i;
+        if(needed && ((end - missing) < STL_NORMAL_BLOCK))
+            continue;
+        setFaceNormals(output + 3 * missing, end - missing);
+        missing = i + 1;
+    }
+    setFaceNormals(output + 3 * missing, count - missing);
+}
 
-    // read file header
-    if(f == 0)
+// Triangles of a binary STL buffer decoded by one thread.
+class StlRangeTask : public Task
+{
+public:
+    StlRangeTask(const char *records, uint32_t count, bool computeNormals, VertexData *output)
     {
-        fprintf(stderr, "Could not open file '%s'.\n", path.c_str());
-        return 0;
+        m_records = records;
+        m_count = count;
+        m_computeNormals = computeNormals;
+        m_output = output;
     }
-    if((fread(header, sizeof(header), 1, f) < 1) ||
-            (fread(&triangles, 4, 1, f) < 1))
+
+    virtual void run()
     {
-        fclose(f);
-        return 0;
+        decodeStlTriangles(m_records, m_count, m_computeNormals, m_output);
     }
 
-    // read vertex data
-    vg = new VertexGroup(GL_TRIANGLES, 3 * triangles);
-    VertexData *v = vg->data;
-    for(uint32_t i = 0; i < triangles; i++)
+private:
+    const char *m_records;
+    uint32_t m_count;
+    bool m_computeNormals;
+    VertexData *m_output;
+};
+
+static VertexGroup * loadStlBinary(const char *data, uint32_t triangles, bool computeNormals,
+                                   int threads)
+{
+    VertexGroup *vg = new VertexGroup(GL_TRIANGLES, 3 * triangles);
+    const char *records = data + STL_HEADER_SIZE;
+    if((triangles >= STL_PARALLEL_TRIANGLES) && (threads != 1))
     {
-        if((fread(points, sizeof(points), 1, f) < 1) || (fread(&attributes, 2, 1, f) < 1))
+        TaskPool pool(threads);
+        if(pool.threadCount() > 1)
         {
-            delete vg;
-            fclose(f);
-            return 0;
-        }
-        if(computeNormals)
-            points[0] = vec3::normal(points[1], points[2], points[3]);
-        for(uint32_t j = 0; j < 3; j++, v++)
-        {
-            v->position = points[j + 1];
-            v->normal = points[0];
-            v->texCoords = vec2();
+            uint32_t rangeCount = pool.threadCount() * 4;
+            vector<StlRangeTask *> ranges;
+            for(uint32_t i = 0; i < rangeCount; i++)
+            {
+                uint32_t start = (uint32_t)(((uint64_t)triangles * i) / rangeCount);
+                uint32_t end = (uint32_t)(((uint64_t)triangles * (i + 1)) / rangeCount);
+                ranges.push_back(new StlRangeTask(records + start * STL_TRIANGLE_SIZE,
+                    end - start, computeNormals, vg->data + start * 3));
+                pool.start(ranges.back());
+            }
+            pool.waitForDone();
+            for(uint32_t i = 0; i < ranges.size(); i++)
+                delete ranges[i];
+            return vg;
         }
     }
-    fclose(f);
+    decodeStlTriangles(records, triangles, computeNormals, vg->data);
     return vg;
 }
 
-typedef struct
+static inline bool matchStlKeyword(const char *&p, const char *end, const char *keyword)
 {
-    uint32_t vertexIndex;
-    uint32_t normalIndex;
-    uint32_t texCoordsIndex;
-} ObjPoint;
+    size_t length = strlen(keyword);
+    if(((size_t)(end - p) < length) || (memcmp(p, keyword, length) != 0))
+        return false;
+    p += length;
+    return true;
+}
 
-static bool parseObjPoint(char *data, ObjPoint *p)
+// ASCII files list 'facet normal', then one 'vertex' line per point of the facet.
+static VertexGroup * loadStlAscii(const char *data, size_t size, bool computeNormals)
 {
-    int vertexIndex = 0;
-    int normalIndex = 0;
-    int texCoordsIndex = 0;
-    if(sscanf(data, "%d/%d/%d", &vertexIndex, &normalIndex, &texCoordsIndex) == 3)
+    const char *end = data + size;
+    VertexArraySink sink;
+    vector<vec3> points;
+    vec3 normal(0.0, 0.0, 0.0);
+    for(const char *p = data; p < end; p = nextObjLine(p, end))
     {
-        if(p)
+        p = skipObjSpaces(p, end);
+        if(matchStlKeyword(p, end, "vertex"))
+        {
+            vec3 point;
+            if(parseObjFloats(p, end, &point.x, 3))
+                points.push_back(point);
+        }
+        else if(matchStlKeyword(p, end, "facet"))
         {
-            p->vertexIndex = vertexIndex;
-            p->normalIndex = normalIndex;
-            p->texCoordsIndex = texCoordsIndex;
+            p = skipObjSpaces(p, end);
+            normal = vec3(0.0, 0.0, 0.0);
+            if(matchStlKeyword(p, end, "normal"))
+                parseObjFloats(p, end, &normal.x, 3);
+            points.clear();
+        }
+        else if(matchStlKeyword(p, end, "endfacet"))
+        {
+            // facets are triangles, but split larger polygons as a fan anyway
+            for(size_t i = 2; i < points.size(); i++)
+            {
+                VertexData triangle[3];
+                triangle[0].position = points[0];
+                triangle[1].position = points[i - 1];
+                triangle[2].position = points[i];
+                vec3 n = normal;
+                if(computeNormals || ((n.x == 0.0f) && (n.y == 0.0f) && (n.z == 0.0f)))
+                    n = vec3::normal(points[0], points[i - 1], points[i]);
+                for(uint32_t j = 0; j < 3; j++)
+                {
+                    triangle[j].normal = n;
+                    triangle[j].texCoords = vec2(0.0, 0.0);
+                }
+                sink.addVertices(triangle, 3);
+            }
+            points.clear();
         }
-        return true;
     }
-    else if(sscanf(data, "%d//%d", &vertexIndex, &normalIndex) == 2)
+    return sink.createGroup(GL_TRIANGLES);
+}
+
+VertexGroup * Mesh::loadStl(string path, bool computeNormals, int threads)
+{
+    size_t size = 0;
+    const char *data = mapFileData(path, size);
+    if(data)
+    {
+        VertexGroup *vg = loadStlData(data, size, computeNormals, threads);
+        unmapFileData(data, size);
+        return vg;
+    }
+    string blob;
+    if(!loadFileBlob(path, blob))
+    {
+        fprintf(stderr, "Could not open file '%s'.\n", path.c_str());
+        return 0;
+    }
+    return loadStlData(blob.data(), blob.size(), computeNormals, threads);
+}
+
+VertexGroup * Mesh::loadStlData(const char *data, size_t size, bool computeNormals, int threads)
+{
+    // ASCII files start with 'solid', but so do the headers of some binary files
+    uint32_t triangles = 0;
+    if(size >= STL_HEADER_SIZE)
+        memcpy(&triangles, data + 80, sizeof(uint32_t));
+    uint64_t binarySize = STL_HEADER_SIZE + (uint64_t)triangles * STL_TRIANGLE_SIZE;
+    bool ascii = (size >= 5) && (memcmp(data, "solid", 5) == 0);
+    if((size >= STL_HEADER_SIZE) && ((size == binarySize) || (!ascii && (size > binarySize))))
+        return loadStlBinary(data, triangles, computeNormals, threads);
+    else if(ascii)
+        return loadStlAscii(data, size, computeNormals);
+    return 0;
+}
+
+static const uint32_t OBJ_EMPTY_SLOT = 0xffffffff;
+
+// Deduplicates the values of one kind of OBJ attribute ('v', 'vt' or 'vn').
+template<class T>
+class ObjAttributeTable
+{
+public:
+    ObjAttributeTable()
+    {
+        m_slots.resize(1024, OBJ_EMPTY_SLOT);
+    }
+
+    // Return the index of the value in the table, adding it if needed.
+    uint32_t add(const T &value)
     {
-        if(p)
+        if((m_values.size() + 1) * 2 > m_slots.size())
+            grow();
+        uint32_t mask = m_slots.size() - 1;
+        uint32_t slot = hash(value) & mask;
+        while(m_slots[slot] != OBJ_EMPTY_SLOT)
         {
-            p->vertexIndex = vertexIndex;
-            p->normalIndex = normalIndex;
-            p->texCoordsIndex = vertexIndex;
+            if(memcmp(&m_values[m_slots[slot]], &value, sizeof(T)) == 0)
+                return m_slots[slot];
+            slot = (slot + 1) & mask;
         }
-        return true;
+        m_slots[slot] = m_values.size();
+        m_values.push_back(value);
+        return m_slots[slot];
+    }
+
+    const vector<T> & values() const
+    {
+        return m_values;
     }
-    else if(sscanf(data, "%d/%d", &vertexIndex, &texCoordsIndex) == 2)
+
+private:
+    static uint32_t hash(const T &value)
     {
-        if(p)
+        uint32_t words[sizeof(T) / sizeof(uint32_t)];
+        memcpy(words, &value, sizeof(T));
+        uint32_t h = 2166136261u;
+        for(uint32_t i = 0; i < sizeof(T) / sizeof(uint32_t); i++)
         {
-            p->vertexIndex = vertexIndex;
-            p->normalIndex = vertexIndex;
-            p->texCoordsIndex = texCoordsIndex;
+            h ^= words[i];
+            h *= 16777619u;
+            h ^= h >> 15;
         }
-        return true;
+        return h;
     }
-    else if(sscanf(data, "%d", &vertexIndex) == 1)
+
+    void grow()
     {
-        if(p)
+        m_slots.assign(m_slots.size() * 2, OBJ_EMPTY_SLOT);
+        uint32_t mask = m_slots.size() - 1;
+        for(uint32_t i = 0; i < m_values.size(); i++)
         {
-            p->vertexIndex = vertexIndex;
-            p->normalIndex = vertexIndex;
-            p->texCoordsIndex = vertexIndex;
+            uint32_t slot = hash(m_values[i]) & mask;
+            while(m_slots[slot] != OBJ_EMPTY_SLOT)
+                slot = (slot + 1) & mask;
+            m_slots[slot] = i;
         }
-        return true;
     }
-    return false;
-}
 
-template<class T>
-static T safe_value(vector<T> &data, int index)
+    vector<T> m_values;
+    vector<uint32_t> m_slots;
+};
+
+static inline char * formatObjUInt(char *p, uint64_t value)
 {
-    if((index < 0) || ((size_t)index >= data.size()))
-        return T();
-    else
-        return data[index];
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value > 0);
+    while(n > 0)
+        *p++ = digits[--n];
+    return p;
 }
 
-VertexGroup * Mesh::loadObj(string path)
+// Format a number with six decimals like "%f" does, but without the trailing
+// zeros and without going through the C locale. The sign of negative zero is
+// kept, so that it is read back as the same float.
+static char * formatObjFloat(char *p, float f)
 {
-    string blob;
-    if(!loadFileBlob(path, blob))
+    double v = f;
+    if(v != v)
     {
-        cerr << "Could not open file '" << path << "'." << endl;
-        return 0;
+        memcpy(p, "nan", 3);
+        return p + 3;
+    }
+    uint32_t bits = 0;
+    memcpy(&bits, &f, sizeof(uint32_t));
+    if((bits >> 31) != 0)
+        *p++ = '-';
+    v = fabs(v);
+    if(v > FLT_MAX)
+    {
+        memcpy(p, "inf", 3);
+        return p + 3;
+    }
+    else if(v >= 1e9)
+    {
+        // floats this large are integers, which are exact as 64-bit values
+        if(v < 18446744073709551616.0)
+            return formatObjUInt(p, (uint64_t)v);
+        // nine significant digits are enough to read the same float back
+        int exponent = (int)floor(log10(v)) - 8;
+        uint64_t mantissa = (uint64_t)(v / pow(10.0, exponent) + 0.5);
+        if(mantissa >= 1000000000)
+        {
+            mantissa = (mantissa + 5) / 10;
+            exponent++;
+        }
+        p = formatObjUInt(p, mantissa);
+        *p++ = 'e';
+        return formatObjUInt(p, exponent);
+    }
+    uint64_t scaled = (uint64_t)(v * 1e6 + 0.5);
+    p = formatObjUInt(p, scaled / 1000000);
+    uint32_t fraction = (uint32_t)(scaled % 1000000);
+    if(fraction > 0)
+    {
+        *p++ = '.';
+        for(uint32_t div = 100000; fraction > 0; div /= 10)
+        {
+            *p++ = (char)('0' + fraction / div);
+            fraction %= div;
+        }
     }
-    istringstream s(blob);
-    return loadObj(s);
+    return p;
 }
 
-VertexGroup * Mesh::loadObj(istream &s)
+// Size of the chunks of lines formatted by one thread.
+static const uint32_t OBJ_FORMAT_CHUNK = 1 << 16;
+
+// Builds the deduplicated tables and the faces of an OBJ file from vertex
+// groups, then formats the file in chunks that can be written at once.
+class ObjWriter
 {
-    char line[512];
-    char point1[32];
-    char point2[32];
-    char point3[32];
-    vector<vec3> vertices;
-    vector<vec3> normals;
-    vector<vec2> texCoords;
-    vector<VertexData> meshVertices;
-    ObjPoint points[4];
-    vec3 normal;
-    s.getline(line, sizeof(line));
-    while(!s.eof())
-    {
-        float v1, v2, v3;
-        if(sscanf(line, "v %f %f %f", &v1, &v2, &v3) == 3)
-            vertices.push_back(vec3(v1, v2, v3));
-        else if(sscanf(line, "vn %f %f %f", &v1, &v2, &v3) == 3)
-            normals.push_back(vec3(v1, v2, v3));
-        else if(sscanf(line, "vt %f %f", &v1, &v2) == 2)
-            texCoords.push_back(vec2(v1, v2));
-        else if(sscanf(line, "f %s %s %s", point1, point2, point3) == 3)
-        {
-            if(parseObjPoint(point1, &points[0]) &&
-                parseObjPoint(point2, &points[1]) &&
-                parseObjPoint(point3, &points[2]))
+public:
+    void addGroup(const VertexGroupView &vg)
+    {
+        // find the attributes of every vertex of the group in the tables
+        vector<uint32_t> ids(vg.count() * 3);
+        for(uint32_t i = 0; i < vg.count(); i++)
+        {
+            VertexData v = vg.vertex(i);
+            ids[i * 3] = m_positions.add(v.position) + 1;
+            ids[i * 3 + 1] = m_texCoords.add(v.texCoords) + 1;
+            ids[i * 3 + 2] = m_normals.add(v.normal) + 1;
+        }
+        uint32_t elements = vg.elementCount();
+        switch(vg.mode)
+        {
+        case GL_TRIANGLES:
+            for(uint32_t i = 0; (i + 2) < elements; i += 3)
+                addFace(ids, vg.vertexIndex(i), vg.vertexIndex(i + 1), vg.vertexIndex(i + 2));
+            break;
+        case GL_QUADS:
+            for(uint32_t i = 0; (i + 3) < elements; i += 4)
             {
-                bool computeNormals = (normals.size() == 0);
-                if(computeNormals)
-                {
-                    vec3 v1 = safe_value(vertices, points[0].vertexIndex - 1);
-                    vec3 v2 = safe_value(vertices, points[1].vertexIndex - 1);
-                    vec3 v3 = safe_value(vertices, points[2].vertexIndex - 1);
-                    normal = vec3::normal(v1, v2, v3);
-                }
-                for(int i = 0; i < 3; i++)
-                {
-                    VertexData vd;
-                    vd.position = safe_value(vertices, points[i].vertexIndex - 1);
-                    if(computeNormals)
-                        vd.normal = normal;
-                    else
-                        vd.normal = safe_value(normals, points[i].normalIndex - 1);
-                    vd.texCoords = safe_value(texCoords, points[i].texCoordsIndex - 1);
-                    meshVertices.push_back(vd);
-                }
+                addFace(ids, vg.vertexIndex(i), vg.vertexIndex(i + 1), vg.vertexIndex(i + 2));
+                addFace(ids, vg.vertexIndex(i), vg.vertexIndex(i + 2), vg.vertexIndex(i + 3));
             }
+            break;
+        case GL_TRIANGLE_STRIP:
+            for(uint32_t i = 0; (i + 2) < elements; i++)
+                addFace(ids, vg.vertexIndex(i), vg.vertexIndex(i + 1), vg.vertexIndex(i + 2));
+            break;
         }
-        s.getline(line, sizeof(line));
     }
-    return new VertexGroup(GL_TRIANGLES, meshVertices);
-}
 
-void Mesh::saveStl(string path) const
-{
-    int groups = groupCount();
-    VertexGroup **vg = (VertexGroup **)new VertexGroup*[groups];
-    for(int i = 0; i < groups; i++)
+    bool write(string path, int threads = 0);
+
+    enum Section
+    {
+        Positions,
+        TexCoords,
+        Normals,
+        Faces
+    };
+
+    // Append the lines of a section, from start to end, to the text.
+    void format(Section section, uint32_t start, uint32_t end, string &text) const
     {
-        uint32_t mode = groupMode(i);
-        uint32_t count = groupSize(i);
-        vg[i] = new VertexGroup(mode, count);
-        copyGroupTo(i, vg[i]);
+        char line[256];
+        for(uint32_t i = start; i < end; i++)
+        {
+            char *p = line;
+            switch(section)
+            {
+            case Positions:
+                p = formatObjVec3(p, "v ", m_positions.values()[i]);
+                break;
+            case TexCoords:
+            {
+                const vec2 &t = m_texCoords.values()[i];
+                *p++ = 'v';
+                *p++ = 't';
+                *p++ = ' ';
+                p = formatObjFloat(p, t.x);
+                *p++ = ' ';
+                p = formatObjFloat(p, t.y);
+                break;
+            }
+            case Normals:
+                p = formatObjVec3(p, "vn ", m_normals.values()[i]);
+                break;
+            case Faces:
+            {
+                const uint32_t *face = &m_faces[i * 9];
+                *p++ = 'f';
+                for(uint32_t j = 0; j < 9; j++)
+                {
+                    *p++ = ((j % 3) == 0) ? ' ' : '/';
+                    p = formatObjUInt(p, face[j]);
+                }
+                break;
+            }
+            }
+            *p++ = '\n';
+            text.append(line, p - line);
+        }
     }
-    saveStl(path, vg, groups);
-    for(int i = 0; i < groups; i++)
+
+    uint32_t sectionSize(Section section) const
     {
-        delete vg[i];
+        switch(section)
+        {
+        case Positions:
+            return m_positions.values().size();
+        case TexCoords:
+            return m_texCoords.values().size();
+        case Normals:
+            return m_normals.values().size();
+        default:
+        case Faces:
+            return m_faces.size() / 9;
+        }
     }
-    delete [] vg;
-}
 
-void Mesh::saveObj(string path) const
-{
-    int groups = groupCount();
-    VertexGroup **vg = (VertexGroup **)new VertexGroup*[groups];
-    for(int i = 0; i < groups; i++)
+private:
+    void addFace(const vector<uint32_t> &ids, uint32_t a, uint32_t b, uint32_t c)
     {
-        uint32_t mode = groupMode(i);
-        uint32_t count = groupSize(i);
-        vg[i] = new VertexGroup(mode, count);
-        copyGroupTo(i, vg[i]);
+        m_faces.insert(m_faces.end(), &ids[a * 3], &ids[a * 3] + 3);
+        m_faces.insert(m_faces.end(), &ids[b * 3], &ids[b * 3] + 3);
+        m_faces.insert(m_faces.end(), &ids[c * 3], &ids[c * 3] + 3);
     }
-    saveObj(path, vg, groups);
-    for(int i = 0; i < groups; i++)
+
+    static char * formatObjVec3(char *p, const char *prefix, const vec3 &v)
     {
-        delete vg[i];
+        while(*prefix)
+            *p++ = *prefix++;
+        p = formatObjFloat(p, v.x);
+        *p++ = ' ';
+        p = formatObjFloat(p, v.y);
+        *p++ = ' ';
+        return formatObjFloat(p, v.z);
     }
-    delete [] vg;
-}
 
-void Mesh::saveStl(string path, VertexGroup **vg, int groups)
+    ObjAttributeTable<vec3> m_positions;
+    ObjAttributeTable<vec2> m_texCoords;
+    ObjAttributeTable<vec3> m_normals;
+    vector<uint32_t> m_faces;       // v/vt/vn indices of the three points of every face
+};
+
+// Lines of a section of an OBJ file formatted by one thread.
+class ObjFormatTask : public Task
 {
-    if(!vg)
-        return;
-    FILE *f = fopen(path.c_str(), "wb");
-    char header[80];
-    uint32_t triangles = 0;
-    uint16_t attributes = 0;
+public:
+    ObjFormatTask(const ObjWriter *writer, ObjWriter::Section section, uint32_t start, uint32_t end)
+    {
+        m_writer = writer;
+        m_section = section;
+        m_start = start;
+        m_end = end;
+    }
 
-    // count triangles
-    for(int i = 0; i < groups; i++)
+    virtual void run()
     {
-        VertexGroup *g = vg[i];
-        if(g->mode == GL_TRIANGLES)
-            triangles += (g->count / 3);
+        text.reserve((m_end - m_start) * 32);
+        m_writer->format(m_section, m_start, m_end, text);
     }
 
-    // write file header
+    string text;
+
+private:
+    const ObjWriter *m_writer;
+    ObjWriter::Section m_section;
+    uint32_t m_start;
+    uint32_t m_end;
+};
+
+bool ObjWriter::write(string path, int threads)
+{
+    FILE *f = fopen(path.c_str(), "w");
     if(f == 0)
     {
         fprintf(stderr, "Could not open file '%s' for writing.\n", path.c_str());
-        return;
+        return false;
+    }
+    vector<ObjFormatTask *> tasks;
+    for(int s = Positions; s <= Faces; s++)
+    {
+        uint32_t size = sectionSize((Section)s);
+        for(uint32_t start = 0; start < size; start += OBJ_FORMAT_CHUNK)
+            tasks.push_back(new ObjFormatTask(this, (Section)s, start, min(start + OBJ_FORMAT_CHUNK, size)));
     }
-    memset(header, 0, sizeof(header));
-    fwrite(header, sizeof(header), 1, f);
-    fwrite(&triangles, sizeof(uint32_t), 1, f);
 
-    // write vertex data
-    for(int i = 0; i < groups; i++)
+    // format a few chunks per thread at a time, then write them in order
+    TaskPool pool((tasks.size() > 1) ? threads : 1);
+    bool parallel = (pool.threadCount() > 1);
+    uint32_t batchSize = parallel ? pool.threadCount() * 2 : 1;
+    bool written = true;
+    for(uint32_t i = 0; i < tasks.size(); i += batchSize)
     {
-        VertexGroup *g = vg[i];
-        if(g->mode != GL_TRIANGLES)
-            continue;
-        VertexData *v = g->data;
-        for(uint32_t j = 0; (g->count - j) >= 3; j += 3)
+        uint32_t end = min(i + batchSize, (uint32_t)tasks.size());
+        for(uint32_t j = i; j < end; j++)
+        {
+            if(parallel)
+                pool.start(tasks[j]);
+            else
+                tasks[j]->run();
+        }
+        if(parallel)
         {
-            fwrite(&v->normal, sizeof(vec3), 1, f);
-            for(uint32_t k = 0; j < 3; k++)
-                fwrite(&((v + k)->position), sizeof(vec3), 1, f);
-            fwrite(&attributes, sizeof(attributes), 1, f);
+            while(pool.waitForNext())
+            {
+            }
+        }
+        for(uint32_t j = i; j < end; j++)
+        {
+            const string &text = tasks[j]->text;
+            written = written && (text.empty() || (fwrite(text.data(), text.size(), 1, f) == 1));
+            delete tasks[j];
         }
     }
     fclose(f);
+    if(!written)
+        fprintf(stderr, "Could not write file '%s'.\n", path.c_str());
+    return written;
+}
+
+// Views of every group, read where the mesh keeps them.
+static vector<VertexGroupView> meshGroupViews(const Mesh *m)
+{
+    vector<VertexGroupView> views(m->groupCount());
+    for(int i = 0; i < m->groupCount(); i++)
+        m->groupView(i, views[i]);
+    return views;
+}
+
+static vector<VertexGroupView> groupViews(VertexGroup **vg, int groups)
+{
+    vector<VertexGroupView> views;
+    for(int i = 0; i < groups; i++)
+        views.push_back(VertexGroupView(vg[i]));
+    return views;
+}
+
+void Mesh::saveStl(string path) const
+{
+    vector<VertexGroupView> views = meshGroupViews(this);
+    saveStl(path, views.size() ? &views[0] : 0, views.size());
+}
+
+bool Mesh::saveObj(string path) const
+{
+    vector<VertexGroupView> views = meshGroupViews(this);
+    return saveObj(path, views.size() ? &views[0] : 0, views.size());
 }
 
-void Mesh::saveObj(string path, VertexGroup **vg, int groups)
+void Mesh::saveStl(string path, VertexGroup **vg, int groups)
 {
     if(!vg)
         return;
-    FILE *f = fopen(path.c_str(), "w");
+    vector<VertexGroupView> views = groupViews(vg, groups);
+    saveStl(path, views.size() ? &views[0] : 0, views.size());
+}
+
+void Mesh::saveStl(string path, const VertexGroupView *views, int groups)
+{
+    if(!views && (groups > 0))
+        return;
+    FILE *f = fopen(path.c_str(), "wb");
     if(f == 0)
     {
         fprintf(stderr, "Could not open file '%s' for writing.\n", path.c_str());
         return;
     }
+
+    // count triangles
+    uint32_t triangles = 0;
     for(int i = 0; i < groups; i++)
     {
-        VertexGroup *g = vg[i];
-        for(uint32_t j = 0; j < g->count; j++)
-        {
-            vec3 vertex = g->data[j].position;
-            fprintf(f, "v %f %f %f\n", vertex.x, vertex.y, vertex.z);
-        }
-    }
-    for(int i = 0; i < groups; i++)
-    {
-        VertexGroup *g = vg[i];
-        for(uint32_t j = 0; j < g->count; j++)
-        {
-            vec2 texCoords = g->data[j].texCoords;
-            fprintf(f, "vt %f %f\n", texCoords.x, texCoords.y);
-        }
-    }
-    for(int i = 0; i < groups; i++)
-    {
-        VertexGroup *g = vg[i];
-        for(uint32_t j = 0; j < g->count; j++)
-        {
-            vec3 normal = g->data[j].normal;
-            fprintf(f, "vn %f %f %f\n", normal.x, normal.y, normal.z);
-        }
+        if(views[i].mode == GL_TRIANGLES)
+            triangles += (views[i].elementCount() / 3);
     }
-    uint32_t offset = 0;
-    for(int i = 0; i < groups; i++)
+
+    // write file header
+    char header[STL_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header + 80, &triangles, sizeof(uint32_t));
+    bool written = (fwrite(header, sizeof(header), 1, f) == 1);
+
+    // encode the triangles in blocks and write each block at once
+    vector<char> block(STL_WRITE_BLOCK * STL_TRIANGLE_SIZE, 0);
+    size_t used = 0;
+    for(int i = 0; written && (i < groups); i++)
     {
-        VertexGroup *g = vg[i];
-        switch(g->mode)
+        const VertexGroupView &g = views[i];
+        if(g.mode != GL_TRIANGLES)
+            continue;
+        uint32_t elements = g.elementCount();
+        for(uint32_t j = 0; (elements - j) >= 3; j += 3)
         {
-        case GL_TRIANGLES:
-            saveObjIndicesTri(f, g, offset);
-            break;
-        case GL_QUADS:
-            saveObjIndicesQuad(f, g, offset);
-            break;
-        case GL_TRIANGLE_STRIP:
-            saveObjIndicesTriStrip(f, g, offset);
-            break;
+            vec3 values[4];
+            uint32_t first = g.vertexIndex(j);
+            values[0] = g.normals.empty() ? vec3(0.0f, 0.0f, 0.0f) : g.normals[first];
+            for(uint32_t k = 0; k < 3; k++)
+                values[k + 1] = g.positions[g.vertexIndex(j + k)];
+            // the attribute bytes stay zero
+            memcpy(&block[used], values, sizeof(values));
+            used += STL_TRIANGLE_SIZE;
+            if(used == block.size())
+            {
+                written = written && (fwrite(&block[0], used, 1, f) == 1);
+                used = 0;
+            }
         }
     }
+    if(used > 0)
+        written = written && (fwrite(&block[0], used, 1, f) == 1);
     fclose(f);
+    if(!written)
+        fprintf(stderr, "Could not write file '%s'.\n", path.c_str());
+}
+
+bool Mesh::saveObj(string path, VertexGroup **vg, int groups)
+{
+    if(!vg)
+        return false;
+    vector<VertexGroupView> views = groupViews(vg, groups);
+    return saveObj(path, views.size() ? &views[0] : 0, views.size());
+}
+
+bool Mesh::saveObj(string path, const VertexGroupView *views, int groups)
+{
+    if(!views && (groups > 0))
+        return false;
+    ObjWriter writer;
+    for(int i = 0; i < groups; i++)
+        writer.addGroup(views[i]);
+    return writer.write(path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Binary mesh files start with a header, followed by a table with one entry per
+// vertex group. The vertex and index data of every group come next, in the
+// layout used for glBufferData and aligned to 16 bytes. Indices are stored
+// with 16 bits when every vertex of the group can be addressed with them.
+// All values are stored in the byte order of the machine (little-endian).
+
+#define MESH_FILE_MAGIC 0x48534d44      // 'DMSH'
+#define MESH_FILE_VERSION 3         // 2: triangles are optimized for the vertex cache
+                                    // 3: groups have a level of detail
+#define MESH_FILE_ALIGNMENT 16
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t groups;
+    uint32_t vertexSize;
+    vec3 boundsMin;
+    vec3 boundsMax;
+} MeshFileHeader;
+
+typedef struct
+{
+    uint32_t mode;
+    uint32_t count;
+    uint32_t indexCount;
+    uint32_t indexSize;
+    uint32_t lod;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+} MeshFileGroup;
+
+static uint64_t alignMeshFileOffset(uint64_t offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+static bool writeMeshFilePadding(FILE *f, uint64_t &offset)
+{
+    static const char zeros[MESH_FILE_ALIGNMENT] = {0};
+    uint64_t aligned = alignMeshFileOffset(offset);
+    size_t padding = (size_t)(aligned - offset);
+    offset = aligned;
+    return (padding == 0) || (fwrite(zeros, padding, 1, f) == 1);
 }
 
-void Mesh::saveObjIndicesTri(FILE *f, VertexGroup *vg, uint32_t &offset)
+bool Mesh::loadBinary(string path, vector<VertexGroup *> &groups)
 {
-    uint32_t endOffset = offset + vg->count - 2;
-    for(uint32_t i = offset; i < endOffset; i += 3)
-        saveObjFace(f, i, i + 1, i + 2);
-    offset += vg->count;
+    size_t size = 0;
+    const char *data = mapFileData(path, size);
+    if(!data)
+        return false;
+    bool loaded = loadBinary(data, size, groups);
+    unmapFileData(data, size);
+    return loaded;
 }
 
-void Mesh::saveObjIndicesQuad(FILE *f, VertexGroup *vg, uint32_t &offset)
+bool Mesh::loadBinary(const char *data, size_t size, vector<VertexGroup *> &groups)
 {
-    uint32_t endOffset = offset + vg->count - 3;
-    for(uint32_t i = offset; i < endOffset; i += 4)
+    MeshFileHeader header;
+    if(size < sizeof(MeshFileHeader))
+        return false;
+    memcpy(&header, data, sizeof(MeshFileHeader));
+    if((header.magic != MESH_FILE_MAGIC) || (header.version != MESH_FILE_VERSION) ||
+        (header.vertexSize != sizeof(VertexData)))
+        return false;
+    uint64_t tableSize = (uint64_t)header.groups * sizeof(MeshFileGroup);
+    if(tableSize > (size - sizeof(MeshFileHeader)))
+        return false;
+
+    const char *table = data + sizeof(MeshFileHeader);
+    vector<VertexGroup *> loaded;
+    for(uint32_t i = 0; i < header.groups; i++)
     {
-        saveObjFace(f, i, i + 1, i + 2);
-        saveObjFace(f, i, i + 2, i + 3);
+        MeshFileGroup g;
+        memcpy(&g, table + i * sizeof(MeshFileGroup), sizeof(MeshFileGroup));
+        uint64_t vertexSize = (uint64_t)g.count * sizeof(VertexData);
+        uint64_t indexSize = (uint64_t)g.indexCount * g.indexSize;
+        bool valid = ((g.indexSize == 0) || (g.indexSize == 2) || (g.indexSize == 4)) &&
+            (g.vertexOffset <= size) && (vertexSize <= (size - g.vertexOffset)) &&
+            (g.indexOffset <= size) && (indexSize <= (size - g.indexOffset));
+        VertexGroup *vg = 0;
+        if(valid)
+        {
+            vg = new VertexGroup(g.mode, g.count, (g.indexSize > 0) ? g.indexCount : 0);
+            vg->lod = g.lod;
+            loaded.push_back(vg);
+            memcpy(vg->data, data + g.vertexOffset, (size_t)vertexSize);
+            if(g.indexSize == 4)
+            {
+                memcpy(vg->indices, data + g.indexOffset, (size_t)indexSize);
+            }
+            else if(g.indexSize == 2)
+            {
+                const uint16_t *indices = (const uint16_t *)(data + g.indexOffset);
+                for(uint32_t j = 0; j < g.indexCount; j++)
+                    vg->indices[j] = indices[j];
+            }
+            // a damaged file must not make the renderer read past the vertices
+            for(uint32_t j = 0; valid && vg->indices && (j < g.indexCount); j++)
+                valid = (vg->indices[j] < g.count);
+        }
+        if(!valid)
+        {
+            for(uint32_t j = 0; j < loaded.size(); j++)
+                delete loaded[j];
+            return false;
+        }
     }
-    offset += (vg->count * 6) / 4;
+    groups.insert(groups.end(), loaded.begin(), loaded.end());
+    return true;
 }
 
-void Mesh::saveObjIndicesTriStrip(FILE *f, VertexGroup *vg, uint32_t &offset)
+bool Mesh::saveBinary(string path) const
 {
-    uint32_t endOffset = offset + vg->count - 2;
-    for(uint32_t i = offset; i < endOffset; i++)
-        saveObjFace(f, i, i + 1, i + 2);
-    offset += (vg->count - 2) * 3;
+    vector<VertexGroupView> views = meshGroupViews(this);
+    return saveBinary(path, views.size() ? &views[0] : 0, views.size());
 }
 
-void Mesh::saveObjFace(FILE *f, uint32_t ind1, uint32_t ind2, uint32_t ind3)
+bool Mesh::saveBinary(string path, VertexGroup **vg, int groups)
 {
-    fprintf(f, "f ");
-    saveObjIndice(f, ind1 + 1);
-    fprintf(f, " ");
-    saveObjIndice(f, ind2 + 1);
-    fprintf(f, " ");
-    saveObjIndice(f, ind3 + 1);
-    fprintf(f, "\n");
+    if(!vg)
+        return false;
+    vector<VertexGroupView> views = groupViews(vg, groups);
+    return saveBinary(path, views.size() ? &views[0] : 0, views.size());
 }
 
-void Mesh::saveObjIndice(FILE *f, uint32_t ind)
+bool Mesh::saveBinary(string path, const VertexGroupView *views, int groups)
 {
-    //if(texCoords && normals)
-        fprintf(f, "%d/%d/%d", ind, ind, ind);
-    //else if(normals)
-    //    fprintf(f, "%d//%d", ind, ind);
-    //else if(texCoords)
-    //    fprintf(f, "%d/%d", ind, ind);
-    //else
-    //    fprintf(f, "%d", ind);
+    if(!views && (groups > 0))
+        return false;
+    MeshFileHeader header = MeshFileHeader();
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.groups = groups;
+    header.vertexSize = sizeof(VertexData);
+    header.boundsMin = header.boundsMax = vec3(0.0, 0.0, 0.0);
+
+    // lay out the group data after the header and table
+    vector<MeshFileGroup> table(groups);
+    uint64_t offset = sizeof(MeshFileHeader) + groups * sizeof(MeshFileGroup);
+    bool hasBounds = false;
+    for(int i = 0; i < groups; i++)
+    {
+        const VertexGroupView &g = views[i];
+        MeshFileGroup &entry = table[i];
+        vec3 groupMin, groupMax;
+        if(g.bounds(groupMin, groupMax))
+        {
+            if(!hasBounds)
+            {
+                header.boundsMin = groupMin;
+                header.boundsMax = groupMax;
+                hasBounds = true;
+            }
+            header.boundsMin.x = min(header.boundsMin.x, groupMin.x);
+            header.boundsMin.y = min(header.boundsMin.y, groupMin.y);
+            header.boundsMin.z = min(header.boundsMin.z, groupMin.z);
+            header.boundsMax.x = max(header.boundsMax.x, groupMax.x);
+            header.boundsMax.y = max(header.boundsMax.y, groupMax.y);
+            header.boundsMax.z = max(header.boundsMax.z, groupMax.z);
+        }
+        entry.mode = g.mode;
+        entry.count = g.count();
+        entry.indexCount = g.indices.size();
+        entry.indexSize = g.indices.empty() ? 0 : ((g.count() <= 0x10000) ? 2 : 4);
+        entry.lod = g.lod;
+        entry.reserved = 0;
+        entry.vertexOffset = offset = alignMeshFileOffset(offset);
+        offset += (uint64_t)entry.count * sizeof(VertexData);
+        entry.indexOffset = offset = alignMeshFileOffset(offset);
+        offset += (uint64_t)entry.indexCount * entry.indexSize;
+    }
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == 0)
+    {
+        fprintf(stderr, "Could not open file '%s' for writing.\n", path.c_str());
+        return false;
+    }
+    bool written = (fwrite(&header, sizeof(MeshFileHeader), 1, f) == 1);
+    if(groups > 0)
+        written = written && (fwrite(&table[0], sizeof(MeshFileGroup), groups, f) == (size_t)groups);
+    offset = sizeof(MeshFileHeader) + groups * sizeof(MeshFileGroup);
+    vector<VertexData> vertices;
+    vector<uint16_t> shortIndices;
+    vector<uint32_t> indices;
+    for(int i = 0; written && (i < groups); i++)
+    {
+        const VertexGroupView &g = views[i];
+        MeshFileGroup &entry = table[i];
+        written = writeMeshFilePadding(f, offset);
+        const VertexData *data = g.vertexData();
+        if(!data && (entry.count > 0))
+        {
+            // gather attributes that are stored apart
+            vertices.resize(entry.count);
+            for(uint32_t j = 0; j < entry.count; j++)
+                vertices[j] = g.vertex(j);
+            data = &vertices[0];
+        }
+        written = written && (fwrite(data, sizeof(VertexData), entry.count, f) == entry.count);
+        offset += (uint64_t)entry.count * sizeof(VertexData);
+        written = written && writeMeshFilePadding(f, offset);
+        const void *indexData = g.indices.data();
+        if((entry.indexSize == 2) && (g.indices.indexSize() != 2))
+        {
+            shortIndices.resize(entry.indexCount);
+            for(uint32_t j = 0; j < entry.indexCount; j++)
+                shortIndices[j] = g.indices[j];
+            indexData = &shortIndices[0];
+        }
+        else if((entry.indexSize == 4) && (g.indices.indexSize() != 4))
+        {
+            indices.resize(entry.indexCount);
+            for(uint32_t j = 0; j < entry.indexCount; j++)
+                indices[j] = g.indices[j];
+            indexData = &indices[0];
+        }
+        if(entry.indexSize > 0)
+            written = written && (fwrite(indexData, entry.indexSize, entry.indexCount, f) == entry.indexCount);
+        offset += (uint64_t)entry.indexCount * entry.indexSize;
+    }
+    fclose(f);
+    if(!written)
+    {
+        fprintf(stderr, "Could not write file '%s'.\n", path.c_str());
+        remove(path.c_str());
+    }
+    return written;
 }
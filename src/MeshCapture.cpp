@@ -0,0 +1,101 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include "MeshCapture.h"
+#include "RenderState.h"
+
+MeshCapture::MeshCapture() : Mesh()
+{
+}
+
+MeshCapture::~MeshCapture()
+{
+    for(uint32_t i = 0; i < m_groups.size(); i++)
+        delete m_groups[i];
+}
+
+int MeshCapture::groupCount() const
+{
+    return m_groups.size();
+}
+
+uint32_t MeshCapture::groupMode(int index) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return 0;
+    return m_groups[index]->mode;
+}
+
+uint32_t MeshCapture::groupSize(int index) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return 0;
+    return m_groups[index]->count;
+}
+
+uint32_t MeshCapture::groupIndexCount(int index) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return 0;
+    return m_groups[index]->indexCount;
+}
+
+void MeshCapture::addGroup(VertexGroup *vg)
+{
+    VertexGroup *copy = new VertexGroup(vg->mode, vg->count, vg->indexCount);
+    memcpy(copy->data, vg->data, vg->count * sizeof(VertexData));
+    if(vg->indices)
+        memcpy(copy->indices, vg->indices, vg->indexCount * sizeof(uint32_t));
+    m_groups.push_back(copy);
+}
+
+void MeshCapture::takeGroup(VertexGroup *vg)
+{
+    m_groups.push_back(vg);
+}
+
+bool MeshCapture::groupView(int index, VertexGroupView &view) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return false;
+    view = VertexGroupView(m_groups[index]);
+    return true;
+}
+
+void MeshCapture::draw(OutputMode mode, RenderState *s, Mesh *output)
+{
+    if((mode != RenderToMesh) || !s || !output)
+        return;
+    matrix4 m = s->currentMatrix();
+    for(uint32_t i = 0; i < m_groups.size(); i++)
+    {
+        // transform straight into the group given to the output mesh
+        const VertexGroup *source = m_groups[i];
+        VertexGroup *vg = new VertexGroup(source->mode, source->count, source->indexCount);
+        m.mapVertices(source->data, vg->data, source->count);
+        if(source->indices)
+            memcpy(vg->indices, source->indices, source->indexCount * sizeof(uint32_t));
+        output->takeGroup(vg);
+    }
+}
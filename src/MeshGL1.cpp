@@ -26,9 +26,11 @@
 #include "MeshGL1.h"
 #include "Material.h"
 #include "RenderState.h"
+#include "RenderStateGL1.h"
 
-MeshGL1::MeshGL1() : Mesh()
+MeshGL1::MeshGL1(const RenderStateGL1 *state) : Mesh()
 {
+    m_state = state;
 }
 
 MeshGL1::~MeshGL1()
@@ -56,8 +58,24 @@ uint32_t MeshGL1::groupSize(int index) const
         return m_faces[index].count;
 }
 
+uint32_t MeshGL1::groupIndexCount(int index) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return 0;
+    else
+        return m_faces[index].indexCount;
+}
+
 void MeshGL1::addGroup(VertexGroup *vg)
 {
+#ifdef JNI_WRAPPER
+    // GLES1 only has 16-bit indices
+    if(vg->indices && (vg->count > 0x10000))
+    {
+        addSplitGroup(vg);
+        return;
+    }
+#endif
     uint32_t destOffset = m_vertices.size();
     uint32_t newSize = destOffset + vg->count;
     m_vertices.resize(newSize);
@@ -72,25 +90,122 @@ void MeshGL1::addGroup(VertexGroup *vg)
         m_texCoords[i] = v->texCoords;
     }
     addFace(vg->mode, vg->count, destOffset);
+    if(vg->indices)
+    {
+        // indices are relative to the face, use 16-bit ones when they fit
+        Face &f = m_faces.back();
+        f.indexCount = vg->indexCount;
+        if(vg->count <= 0x10000)
+        {
+            f.indexType = GL_UNSIGNED_SHORT;
+            f.indexOffset = m_shortIndices.size();
+            m_shortIndices.insert(m_shortIndices.end(), vg->indices, vg->indices + vg->indexCount);
+        }
+        else
+        {
+            f.indexType = GL_UNSIGNED_INT;
+            f.indexOffset = m_indices.size();
+            m_indices.insert(m_indices.end(), vg->indices, vg->indices + vg->indexCount);
+        }
+    }
 }
 
-bool MeshGL1::copyGroupTo(int index, VertexGroup *vg) const
+/* Add an indexed group as several faces whose vertices fit 16-bit indices.
+Triangles are kept together and vertices shared across chunks are copied.
+Other modes are drawn from the expanded vertices instead. */
+void MeshGL1::addSplitGroup(VertexGroup *vg)
 {
-    if((index < 0) || (index >= groupCount()))
-        return false;
-    Face face = m_faces[index];
-    if((uint32_t)face.count > vg->count)
-        return false;
-    bool normals = m_normals.size() > 0;
-    bool texCoords = m_texCoords.size() > 0;
-    VertexData *d = vg->data;
-    int endOffset = face.offset + face.count;
-    for(int i = face.offset; i < endOffset; i++, d++)
+    const uint32_t MAX_CHUNK_VERTICES = 0x10000;
+    const uint32_t NO_INDEX = 0xffffffff;
+    if(vg->mode != GL_TRIANGLES)
+    {
+        uint32_t destOffset = m_vertices.size();
+        for(uint32_t i = 0; i < vg->indexCount; i++)
+            addVertex(vg->data[vg->indices[i]]);
+        addFace(vg->mode, vg->indexCount, destOffset);
+        return;
+    }
+    std::vector<uint32_t> chunkIndices(vg->count, NO_INDEX);
+    std::vector<uint32_t> chunkVertices;
+    std::vector<uint16_t> indices;
+    uint32_t triangleEnd = vg->indexCount - (vg->indexCount % 3);
+    for(uint32_t i = 0; i <= triangleEnd; i += 3)
     {
-        d->position = m_vertices[i];
-        d->normal = normals ? m_normals[i] : vec3();
-        d->texCoords = texCoords ? m_texCoords[i] : vec2();
+        uint32_t newVertices = 0;
+        for(uint32_t j = 0; (i < triangleEnd) && (j < 3); j++)
+        {
+            if(chunkIndices[vg->indices[i + j]] == NO_INDEX)
+                newVertices++;
+        }
+        if((i == triangleEnd) || (chunkVertices.size() + newVertices > MAX_CHUNK_VERTICES))
+        {
+            // flush the current chunk as a face
+            uint32_t destOffset = m_vertices.size();
+            for(uint32_t j = 0; j < chunkVertices.size(); j++)
+            {
+                addVertex(vg->data[chunkVertices[j]]);
+                chunkIndices[chunkVertices[j]] = NO_INDEX;
+            }
+            if(indices.size() > 0)
+            {
+                addFace(GL_TRIANGLES, chunkVertices.size(), destOffset);
+                Face &f = m_faces.back();
+                f.indexCount = indices.size();
+                f.indexType = GL_UNSIGNED_SHORT;
+                f.indexOffset = m_shortIndices.size();
+                m_shortIndices.insert(m_shortIndices.end(), indices.begin(), indices.end());
+            }
+            chunkVertices.clear();
+            indices.clear();
+            if(i == triangleEnd)
+                break;
+        }
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            uint32_t index = vg->indices[i + j];
+            if(chunkIndices[index] == NO_INDEX)
+            {
+                chunkIndices[index] = chunkVertices.size();
+                chunkVertices.push_back(index);
+            }
+            indices.push_back((uint16_t)chunkIndices[index]);
+        }
     }
+}
+
+void MeshGL1::addVertex(const VertexData &v)
+{
+    m_vertices.push_back(v.position);
+    m_normals.push_back(v.normal);
+    m_texCoords.push_back(v.texCoords);
+}
+
+uint32_t MeshGL1::faceIndex(const Face &f, int i) const
+{
+    if(f.indexType == GL_UNSIGNED_SHORT)
+        return m_shortIndices[f.indexOffset + i];
+    else
+        return m_indices[f.indexOffset + i];
+}
+
+bool MeshGL1::groupView(int index, VertexGroupView &view) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return false;
+    const Face &face = m_faces[index];
+    view = VertexGroupView();
+    view.mode = face.mode;
+    if(face.count == 0)
+        return true;
+    view.positions = StridedView<vec3>(&m_vertices[face.offset], face.count);
+    if(m_normals.size() > 0)
+        view.normals = StridedView<vec3>(&m_normals[face.offset], face.count);
+    if(m_texCoords.size() > 0)
+        view.texCoords = StridedView<vec2>(&m_texCoords[face.offset], face.count);
+    if((face.indexCount > 0) && (face.indexType == GL_UNSIGNED_SHORT))
+        view.indices = IndexView(&m_shortIndices[face.indexOffset], face.indexCount);
+    else if(face.indexCount > 0)
+        view.indices = IndexView(&m_indices[face.indexOffset], face.indexCount);
     return true;
 }
 
@@ -100,6 +215,9 @@ void MeshGL1::addFace(uint32_t mode, int vertexCount, int offset, bool draw)
     f.mode = mode;
     f.count = vertexCount;
     f.offset = offset;
+    f.indexCount = 0;
+    f.indexOffset = 0;
+    f.indexType = 0;
     f.draw = draw;
     m_faces.push_back(f);
 }
@@ -122,29 +240,46 @@ void MeshGL1::drawVertexList()
 {
     bool normals = m_normals.size() > 0;
     bool texCoords = m_texCoords.size() > 0;
-    if(normals)
-    {
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glNormalPointer(GL_FLOAT, 0, &m_normals[0]);
-    }
-    if(texCoords)
-    {
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glTexCoordPointer(2, GL_FLOAT, 0, &m_texCoords[0]);
-    }
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, &m_vertices[0]);
+    // the arrays stay enabled for the next mesh, until the end of the frame
+    GLStateCache *gl = m_state->glState();
+    gl->setClientState(GL_NORMAL_ARRAY, normals);
+    gl->setClientState(GL_TEXTURE_COORD_ARRAY, texCoords);
+    gl->setClientState(GL_VERTEX_ARRAY, true);
+    // the pointers are only moved when a face starts at another vertex
+    int pointerOffset = -1;
     for(uint32_t i = 0; i < m_faces.size(); i++)
     {
         Face f = m_faces[i];
-        if(f.draw)
+        if(!f.draw)
+            continue;
+        // indices are relative to the first vertex of the face
+        int offset = (f.indexCount > 0) ? f.offset : 0;
+        if(offset != pointerOffset)
+        {
+            setVertexPointers(offset, normals, texCoords);
+            pointerOffset = offset;
+        }
+        if(f.indexCount > 0)
+        {
+            const void *indices = (f.indexType == GL_UNSIGNED_SHORT)
+                ? (const void *)&m_shortIndices[f.indexOffset]
+                : (const void *)&m_indices[f.indexOffset];
+            glDrawElements(f.mode, f.indexCount, f.indexType, indices);
+        }
+        else
+        {
             glDrawArrays(f.mode, f.offset, f.count);
+        }
     }
-    if(texCoords)
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+void MeshGL1::setVertexPointers(int offset, bool normals, bool texCoords)
+{
     if(normals)
-        glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_VERTEX_ARRAY);
+        glNormalPointer(GL_FLOAT, 0, &m_normals[offset]);
+    if(texCoords)
+        glTexCoordPointer(2, GL_FLOAT, 0, &m_texCoords[offset]);
+    glVertexPointer(3, GL_FLOAT, 0, &m_vertices[offset]);
 }
 
 void MeshGL1::drawToMesh(Mesh *out, RenderState *s)
@@ -156,9 +291,7 @@ void MeshGL1::drawToMesh(Mesh *out, RenderState *s)
         Face f = m_faces[i];
         if(!f.draw)
             continue;
-        VertexGroup *vg = drawFaceToMeshCopy(s, f);
-        out->addGroup(vg);
-        delete vg;
+        out->takeGroup(drawFaceToMeshCopy(s, f));
     }
 }
 
@@ -166,16 +299,24 @@ VertexGroup * MeshGL1::drawFaceToMeshCopy(RenderState *s, Face f)
 {
     bool normals = m_normals.size() > 0;
     bool texCoords = m_texCoords.size() > 0;
-    VertexGroup *vg = new VertexGroup(f.mode, f.count);
+    VertexGroup *vg = new VertexGroup(f.mode, f.count, f.indexCount);
     VertexData *v = vg->data;
     matrix4 m = s->currentMatrix();
-    int endOffset = f.offset + f.count;
-    for(int i = f.offset; i < endOffset; i++, v++)
+    uint32_t stride = sizeof(VertexData);
+    if(f.count > 0)
+    {
+        m.mapPoints(&m_vertices[f.offset], sizeof(vec3), &v->position, stride, f.count);
+        if(normals)
+            m.normalMatrix().mapNormals(&m_normals[f.offset], sizeof(vec3), &v->normal, stride, f.count);
+    }
+    for(int i = 0; i < f.count; i++)
     {
-        v->position = m.map(m_vertices[i]);
-        v->normal = normals ? m.mapNormal(m_normals[i]) : vec3();
-        v->texCoords = texCoords ? m_texCoords[i] : vec2();
+        if(!normals)
+            v[i].normal = vec3(0.0, 0.0, 0.0);
+        v[i].texCoords = texCoords ? m_texCoords[f.offset + i] : vec2(0.0, 0.0);
     }
+    for(int i = 0; i < f.indexCount; i++)
+        vg->indices[i] = faceIndex(f, i);
     return vg;
 }
 
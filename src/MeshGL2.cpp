@@ -28,12 +28,17 @@
 #include "Material.h"
 #include "RenderState.h"
 #include "RenderStateGL2.h"
+#include "GLStateCache.h"
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+// groups with more vertices are drawn from buffers
+static const uint32_t MAX_ARRAY_VERTICES = 100;
+
 MeshGL2::MeshGL2(const RenderStateGL2 *state) : Mesh()
 {
     m_state = state;
+    m_format = VertexPacker::Float;
 }
 
 MeshGL2::~MeshGL2()
@@ -42,10 +47,21 @@ MeshGL2::~MeshGL2()
     {
         VertexGroup *vg = m_groups[i];
         if(vg->id != 0)
+        {
             glDeleteBuffers(1, &vg->id);
+            m_state->glState()->deleteBuffer(vg->id);
+        }
+        if(vg->indexId != 0)
+        {
+            glDeleteBuffers(1, &vg->indexId);
+            m_state->glState()->deleteBuffer(vg->indexId);
+        }
         delete vg;
     }
     m_groups.clear();
+    m_ranges.clear();
+    m_shortIndices.clear();
+    m_shortIndexOffsets.clear();
 }
 
 int MeshGL2::groupCount() const
@@ -69,31 +85,111 @@ uint32_t MeshGL2::groupSize(int index) const
         return m_groups[index]->count;
 }
 
+uint32_t MeshGL2::groupIndexCount(int index) const
+{
+    if((index < 0) || (index >= groupCount()))
+        return 0;
+    else
+        return m_groups[index]->indexCount;
+}
+
 void MeshGL2::addGroup(VertexGroup *vg)
 {
-    VertexGroup *copy = new VertexGroup(vg->mode, vg->count);
+    VertexGroup *copy = new VertexGroup(vg->mode, vg->count, vg->indexCount);
     uint32_t size = vg->count * sizeof(VertexData);
     memcpy(copy->data, vg->data, size);
+    if(vg->indices)
+        memcpy(copy->indices, vg->indices, vg->indexCount * sizeof(uint32_t));
     m_groups.push_back(copy);
+    m_ranges.push_back(VertexPacker::range(copy));
+    addShortIndices(copy);
+}
+
+void MeshGL2::takeGroup(VertexGroup *vg)
+{
+    m_groups.push_back(vg);
+    m_ranges.push_back(VertexPacker::range(vg));
+    addShortIndices(vg);
+}
+
+void MeshGL2::addShortIndices(const VertexGroup *vg)
+{
+    if(!vg->indices || (vg->count > MAX_ARRAY_VERTICES))
+    {
+        m_shortIndexOffsets.push_back(-1);
+        return;
+    }
+    m_shortIndexOffsets.push_back(m_shortIndices.size());
+    m_shortIndices.insert(m_shortIndices.end(), vg->indices, vg->indices + vg->indexCount);
 }
 
-bool MeshGL2::copyGroupTo(int index, VertexGroup *vg) const
+bool MeshGL2::groupView(int index, VertexGroupView &view) const
 {
     if((index < 0) || (index >= groupCount()))
         return false;
-    VertexGroup *source = m_groups[index];
-    if(source->count > vg->count)
-        return false;
-    memcpy(vg->data, source->data, source->count * sizeof(VertexData));
+    view = VertexGroupView(m_groups[index]);
+    return true;
+}
+
+VertexPacker::Format MeshGL2::vertexFormat() const
+{
+    return m_format;
+}
+
+bool MeshGL2::setVertexFormat(VertexPacker::Format format)
+{
+    if(format == m_format)
+        return true;
+    // the buffers are created again in the new format the next time they are drawn
+    for(uint32_t i = 0; i < m_groups.size(); i++)
+    {
+        VertexGroup *vg = m_groups[i];
+        if(vg->id != 0)
+        {
+            glDeleteBuffers(1, &vg->id);
+            m_state->glState()->deleteBuffer(vg->id);
+            vg->id = 0;
+        }
+        if(vg->indexId != 0)
+        {
+            glDeleteBuffers(1, &vg->indexId);
+            m_state->glState()->deleteBuffer(vg->indexId);
+            vg->indexId = 0;
+        }
+    }
+    m_format = format;
     return true;
 }
 
 void MeshGL2::draw(Mesh::OutputMode mode, RenderState *s, Mesh *output)
 {
-    (void)mode;
-    (void)s;
-    (void)output;
-    drawToScreen();
+    switch(mode)
+    {
+    default:
+    case RenderToScreen:
+        drawToScreen();
+        break;
+    case RenderToMesh:
+        drawToMesh(output, s);
+        break;
+    }
+}
+
+void MeshGL2::drawToMesh(Mesh *output, RenderState *s)
+{
+    if(!output || !s)
+        return;
+    matrix4 m = s->currentMatrix();
+    for(uint32_t i = 0; i < m_groups.size(); i++)
+    {
+        // transform straight into the group given to the output mesh
+        const VertexGroup *source = m_groups[i];
+        VertexGroup *vg = new VertexGroup(source->mode, source->count, source->indexCount);
+        m.mapVertices(source->data, vg->data, source->count);
+        if(source->indices)
+            memcpy(vg->indices, source->indices, source->indexCount * sizeof(uint32_t));
+        output->takeGroup(vg);
+    }
 }
 
 void MeshGL2::drawToScreen()
@@ -101,52 +197,137 @@ void MeshGL2::drawToScreen()
     int position = m_state->positionAttr();
     int normal = m_state->normalAttr();
     int texCoords = m_state->texCoordsAttr();
-    glEnableVertexAttribArray(position);
-    glEnableVertexAttribArray(normal);
-    glEnableVertexAttribArray(texCoords);
+    // the arrays stay enabled for the next mesh, until the end of the frame
+    GLStateCache *gl = m_state->glState();
+    gl->setVertexAttribArray(position, true);
+    gl->setVertexAttribArray(normal, true);
+    gl->setVertexAttribArray(texCoords, true);
+    if(m_format == VertexPacker::Float)
+        m_state->resetVertexRange();
     for(uint32_t i = 0; i < m_groups.size(); i++)
     {
         VertexGroup *vg = m_groups[i];
-        if(vg->count > 100)
-            drawVBO(vg, position, normal, texCoords);
+        // packed vertices only exist in buffers, even for small groups
+        if(m_format != VertexPacker::Float)
+        {
+            m_state->setVertexRange(m_ranges[i], true);
+            drawVBO(vg, m_ranges[i], position, normal, texCoords);
+        }
+        else if(vg->count > MAX_ARRAY_VERTICES)
+        {
+            drawVBO(vg, m_ranges[i], position, normal, texCoords);
+        }
         else
-            drawArray(vg, position, normal, texCoords);
+        {
+            drawArray(vg, m_shortIndexOffsets[i], position, normal, texCoords);
+        }
     }
-    glDisableVertexAttribArray(position);
-    glDisableVertexAttribArray(normal);
-    glDisableVertexAttribArray(texCoords);
 }
 
-void MeshGL2::drawArray(VertexGroup *vg, int position, int normal, int texCoords)
+void MeshGL2::drawArray(VertexGroup *vg, int indexOffset, int position, int normal, int texCoords)
 {
+    // the vertices and indices are read from memory, not from buffers, using
+    // the 16-bit copy of the indices like drawVBO
+    GLStateCache *gl = m_state->glState();
+    gl->bindBuffer(GL_ARRAY_BUFFER, 0);
+    if(vg->indices)
+        gl->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE,
         sizeof(VertexData), &vg->data->position);
     glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE,
         sizeof(VertexData), &vg->data->normal);
     glVertexAttribPointer(texCoords, 2, GL_FLOAT, GL_FALSE,
         sizeof(VertexData), &vg->data->texCoords);
-    glDrawArrays(vg->mode, 0, vg->count);
+    if(vg->indices)
+        glDrawElements(vg->mode, vg->indexCount, GL_UNSIGNED_SHORT, &m_shortIndices[indexOffset]);
+    else
+        glDrawArrays(vg->mode, 0, vg->count);
 }
 
-void MeshGL2::drawVBO(VertexGroup *vg, int position, int normal, int texCoords)
+void MeshGL2::drawVBO(VertexGroup *vg, const PackedRange &range, int position, int normal, int texCoords)
 {
+    GLStateCache *gl = m_state->glState();
     if(vg->id == 0)
     {
-        uint32_t size = vg->count * sizeof(VertexData);
         glGenBuffers(1, &vg->id);
-        glBindBuffer(GL_ARRAY_BUFFER, vg->id);
-        glBufferData(GL_ARRAY_BUFFER, size, vg->data, GL_STATIC_DRAW);
+        gl->bindBuffer(GL_ARRAY_BUFFER, vg->id);
+        uploadVertices(vg, range);
     }
     else
     {
-        glBindBuffer(GL_ARRAY_BUFFER, vg->id);
+        gl->bindBuffer(GL_ARRAY_BUFFER, vg->id);
+    }
+    setVertexPointers(position, normal, texCoords);
+    if(vg->indices)
+    {
+        // use 16-bit indices when every vertex can be addressed with them
+        bool shortIndices = (vg->count <= 0x10000);
+        if(vg->indexId == 0)
+        {
+            glGenBuffers(1, &vg->indexId);
+            gl->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, vg->indexId);
+            if(shortIndices)
+            {
+                uint16_t *indices = new uint16_t[vg->indexCount];
+                for(uint32_t i = 0; i < vg->indexCount; i++)
+                    indices[i] = (uint16_t)vg->indices[i];
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, vg->indexCount * sizeof(uint16_t),
+                             indices, GL_STATIC_DRAW);
+                delete [] indices;
+            }
+            else
+            {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, vg->indexCount * sizeof(uint32_t),
+                             vg->indices, GL_STATIC_DRAW);
+            }
+        }
+        else
+        {
+            gl->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, vg->indexId);
+        }
+        glDrawElements(vg->mode, vg->indexCount,
+                       shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+    }
+    else
+    {
+        glDrawArrays(vg->mode, 0, vg->count);
+    }
+}
+
+void MeshGL2::uploadVertices(VertexGroup *vg, const PackedRange &range)
+{
+    if(m_format == VertexPacker::Float)
+    {
+        glBufferData(GL_ARRAY_BUFFER, vg->count * sizeof(VertexData), vg->data, GL_STATIC_DRAW);
+        return;
+    }
+    uint32_t size = vg->count * VertexPacker::vertexSize(m_format);
+    char *packed = new char[size];
+    VertexPacker::pack(vg->data, vg->count, m_format, range, packed);
+    glBufferData(GL_ARRAY_BUFFER, size, packed, GL_STATIC_DRAW);
+    delete [] packed;
+}
+
+void MeshGL2::setVertexPointers(int position, int normal, int texCoords)
+{
+    // packed attributes are normalized to [0, 1], the vertex shader maps them back
+    uint32_t stride = VertexPacker::vertexSize(m_format);
+    switch(m_format)
+    {
+    case VertexPacker::Packed16:
+        glVertexAttribPointer(position, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(0));
+        glVertexAttribPointer(normal, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(8));
+        glVertexAttribPointer(texCoords, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(12));
+        break;
+    case VertexPacker::Packed12:
+        glVertexAttribPointer(position, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(0));
+        glVertexAttribPointer(normal, 2, GL_UNSIGNED_BYTE, GL_TRUE, stride, BUFFER_OFFSET(6));
+        glVertexAttribPointer(texCoords, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, BUFFER_OFFSET(8));
+        break;
+    default:
+        glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(0));
+        glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(sizeof(vec3)));
+        glVertexAttribPointer(texCoords, 2, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(2 * sizeof(vec3)));
+        break;
     }
-    glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE,
-        sizeof(VertexData), BUFFER_OFFSET(0));
-    glVertexAttribPointer(normal, 3, GL_FLOAT, GL_FALSE,
-        sizeof(VertexData), BUFFER_OFFSET(sizeof(vec3)));
-    glVertexAttribPointer(texCoords, 2, GL_FLOAT, GL_FALSE,
-        sizeof(VertexData), BUFFER_OFFSET(2 * sizeof(vec3)));
-    glDrawArrays(vg->mode, 0, vg->count);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -0,0 +1,1008 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "MeshOptimizer.h"
+#include "Platform.h"
+
+using namespace std;
+
+static const uint32_t EMPTY_SLOT = 0xffffffff;
+
+static uint32_t hashVertex(const VertexData &v)
+{
+    uint32_t words[sizeof(VertexData) / sizeof(uint32_t)];
+    memcpy(words, &v, sizeof(VertexData));
+    uint32_t h = 2166136261u;
+    for(uint32_t i = 0; i < sizeof(words) / sizeof(uint32_t); i++)
+    {
+        h ^= words[i];
+        h *= 16777619u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+// Flat-shaded meshes share few vertices. Only index them when the indexed group
+// takes up less memory than the original one.
+static bool isIndexingWorth(uint32_t count, uint32_t uniqueCount)
+{
+    size_t indexSize = (uniqueCount <= 0x10000) ? sizeof(uint16_t) : sizeof(uint32_t);
+    size_t indexedSize = uniqueCount * sizeof(VertexData) + count * indexSize;
+    return indexedSize < count * sizeof(VertexData);
+}
+
+void MeshOptimizer::weld(VertexGroup *vg)
+{
+    if(!vg || vg->indices || (vg->count == 0))
+        return;
+
+    // open addressing table of indices into the unique vertex array
+    uint32_t tableSize = 1;
+    while(tableSize < vg->count * 2)
+        tableSize *= 2;
+    vector<uint32_t> table(tableSize, EMPTY_SLOT);
+    uint32_t mask = tableSize - 1;
+
+    uint32_t *indices = new uint32_t[vg->count];
+    VertexData *unique = vg->data;
+    uint32_t uniqueCount = 0;
+    for(uint32_t i = 0; i < vg->count; i++)
+    {
+        const VertexData &v = vg->data[i];
+        uint32_t slot = hashVertex(v) & mask;
+        while(true)
+        {
+            uint32_t index = table[slot];
+            if(index == EMPTY_SLOT)
+            {
+                // unique vertices are compacted in place, since uniqueCount <= i
+                table[slot] = uniqueCount;
+                unique[uniqueCount] = v;
+                indices[i] = uniqueCount++;
+                break;
+            }
+            else if(memcmp(&unique[index], &v, sizeof(VertexData)) == 0)
+            {
+                indices[i] = index;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    if(!isIndexingWorth(vg->count, uniqueCount))
+    {
+        // expanding backwards only overwrites vertices that are not needed anymore
+        for(uint32_t i = vg->count; i > 0; i--)
+            vg->data[i - 1] = unique[indices[i - 1]];
+        delete [] indices;
+        return;
+    }
+
+    VertexData *data = new VertexData[uniqueCount];
+    memcpy(data, unique, uniqueCount * sizeof(VertexData));
+    vg->indexCount = vg->count;
+    vg->indices = indices;
+    vg->setData(data, uniqueCount);
+}
+
+void MeshOptimizer::optimize(VertexGroup *vg)
+{
+    weld(vg);
+    optimizeVertexCache(vg);
+    optimizeOverdraw(vg);
+    optimizeVertexFetch(vg);
+}
+
+static const uint32_t NO_TRIANGLE = 0xffffffff;
+
+// Size of the cache used to score vertices. It is larger than the hardware
+// caches so that the order works well whatever their exact size.
+static const int FORSYTH_CACHE_SIZE = 32;
+static const uint32_t FORSYTH_MAX_VALENCE = 64;
+// Size of the FIFO cache the new order is checked against.
+static const uint32_t FORSYTH_CHECK_CACHE_SIZE = 16;
+
+class ForsythScores
+{
+public:
+    ForsythScores()
+    {
+        for(int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+        {
+            // the vertices of the last triangle get a fixed score so that it
+            // is not followed by a triangle that shares a single vertex with it
+            if(i < 3)
+                m_cache[i] = 0.75f;
+            else
+                m_cache[i] = pow(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        // vertices used by few triangles are favoured, not to be left behind
+        m_valence[0] = 0.0f;
+        for(uint32_t i = 1; i <= FORSYTH_MAX_VALENCE; i++)
+            m_valence[i] = 2.0f * pow((float)i, -0.5f);
+    }
+
+    float vertexScore(int cachePosition, uint32_t activeTriangles) const
+    {
+        if(activeTriangles == 0)
+            return -1.0f;
+        float score = (cachePosition >= 0) ? m_cache[cachePosition] : 0.0f;
+        return score + m_valence[min(activeTriangles, FORSYTH_MAX_VALENCE)];
+    }
+
+private:
+    float m_cache[FORSYTH_CACHE_SIZE];
+    float m_valence[FORSYTH_MAX_VALENCE + 1];
+};
+
+void MeshOptimizer::optimizeVertexCache(VertexGroup *vg)
+{
+    if(!vg || !vg->indices || (vg->mode != GL_TRIANGLES) || (vg->indexCount < 6))
+        return;
+    ForsythScores scores;
+    uint32_t triangleCount = vg->indexCount / 3;
+    uint32_t vertexCount = vg->count;
+    const uint32_t *indices = vg->indices;
+
+    // list the triangles that use each vertex and are not drawn yet
+    vector<uint32_t> activeCount(vertexCount, 0);
+    for(uint32_t i = 0; i < triangleCount * 3; i++)
+        activeCount[indices[i]]++;
+    vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(uint32_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] = offsets[i] + activeCount[i];
+    vector<uint32_t> adjacency(triangleCount * 3);
+    vector<uint32_t> filled(vertexCount, 0);
+    for(uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        uint32_t v = indices[i];
+        adjacency[offsets[v] + filled[v]++] = i / 3;
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScore(vertexCount);
+    for(uint32_t i = 0; i < vertexCount; i++)
+        vertexScore[i] = scores.vertexScore(-1, activeCount[i]);
+    vector<float> triangleScore(triangleCount);
+    vector<uint8_t> emitted(triangleCount, 0);
+    uint32_t best = NO_TRIANGLE;
+    float bestScore = -1.0f;
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t *tri = indices + t * 3;
+        triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+        if(triangleScore[t] > bestScore)
+        {
+            best = t;
+            bestScore = triangleScore[t];
+        }
+    }
+
+    uint32_t *output = new uint32_t[vg->indexCount];
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t cacheSize = 0;
+    uint32_t nextInput = 0;
+    for(uint32_t n = 0; n < triangleCount; n++)
+    {
+        if(best == NO_TRIANGLE)
+        {
+            // dead end, continue with the next triangle in the original order
+            while(emitted[nextInput])
+                nextInput++;
+            best = nextInput;
+        }
+        const uint32_t *tri = indices + best * 3;
+        memcpy(output + n * 3, tri, 3 * sizeof(uint32_t));
+        emitted[best] = 1;
+
+        // the vertices of the triangle move to the front of the cache
+        uint32_t newSize = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            uint32_t v = tri[k];
+            if((k == 0) || ((v != tri[0]) && ((k == 1) || (v != tri[1]))))
+                newCache[newSize++] = v;
+
+            // remove the triangle from the list of the vertex
+            uint32_t *list = &adjacency[offsets[v]];
+            uint32_t count = activeCount[v];
+            for(uint32_t j = 0; j < count; j++)
+            {
+                if(list[j] == best)
+                {
+                    list[j] = list[count - 1];
+                    break;
+                }
+            }
+            activeCount[v]--;
+        }
+        for(uint32_t i = 0; i < cacheSize; i++)
+        {
+            uint32_t v = cache[i];
+            if((v != tri[0]) && (v != tri[1]) && (v != tri[2]))
+                newCache[newSize++] = v;
+        }
+
+        // update the scores of the vertices in the cache and of the ones pushed out
+        for(uint32_t i = 0; i < newSize; i++)
+        {
+            uint32_t v = newCache[i];
+            cachePosition[v] = (i < (uint32_t)FORSYTH_CACHE_SIZE) ? (int)i : -1;
+            vertexScore[v] = scores.vertexScore(cachePosition[v], activeCount[v]);
+        }
+
+        // the next triangle is the best one using a vertex from the cache
+        best = NO_TRIANGLE;
+        bestScore = -1.0f;
+        for(uint32_t i = 0; i < newSize; i++)
+        {
+            uint32_t v = newCache[i];
+            const uint32_t *list = &adjacency[offsets[v]];
+            for(uint32_t j = 0; j < activeCount[v]; j++)
+            {
+                uint32_t t = list[j];
+                const uint32_t *other = indices + t * 3;
+                float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                triangleScore[t] = score;
+                if((i < (uint32_t)FORSYTH_CACHE_SIZE) && (score > bestScore))
+                {
+                    best = t;
+                    bestScore = score;
+                }
+            }
+        }
+
+        cacheSize = min(newSize, (uint32_t)FORSYTH_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(uint32_t));
+    }
+
+    // the heuristic can do worse than an order that was already good, keep that one
+    float acmrBefore = 0.0f, acmrAfter = 0.0f, atvr = 0.0f;
+    analyzeVertexCache(vg, FORSYTH_CHECK_CACHE_SIZE, acmrBefore, atvr);
+    uint32_t *original = vg->indices;
+    vg->indices = output;
+    analyzeVertexCache(vg, FORSYTH_CHECK_CACHE_SIZE, acmrAfter, atvr);
+    if(acmrAfter > acmrBefore)
+    {
+        vg->indices = original;
+        delete [] output;
+    }
+    else
+    {
+        delete [] original;
+    }
+}
+
+// FIFO cache simulation. A vertex is in the cache when fewer than cacheSize
+// vertices were loaded since it was.
+class VertexCacheSimulator
+{
+public:
+    VertexCacheSimulator(uint32_t vertexCount, uint32_t cacheSize)
+        : m_loadTime(vertexCount, 0)
+    {
+        m_cacheSize = cacheSize;
+        m_time = cacheSize + 1;
+    }
+
+    uint32_t misses(const VertexGroup *vg, uint32_t triangle)
+    {
+        uint32_t misses = 0;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t v = vg->vertexIndex(triangle * 3 + k);
+            if((m_time - m_loadTime[v]) > m_cacheSize)
+            {
+                m_loadTime[v] = m_time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void clear()
+    {
+        m_time += m_cacheSize + 1;
+    }
+
+private:
+    vector<uint32_t> m_loadTime;
+    uint32_t m_cacheSize;
+    uint32_t m_time;
+};
+
+// Size of the cache used to measure the cache efficiency of clusters.
+static const uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+// Split the triangles into clusters that can be drawn in any order. Clusters
+// start where all the vertices of a triangle miss the cache, and are split
+// further where starting with an empty cache does not cost too much.
+static void clusterTriangles(const VertexGroup *vg, float threshold, vector<uint32_t> &clusters)
+{
+    uint32_t triangleCount = vg->elementCount() / 3;
+    uint32_t vertexCount = vg->indices ? vg->count : vg->elementCount();
+    vector<uint32_t> hard;
+    vector<uint32_t> hardMisses;
+    VertexCacheSimulator cache(vertexCount, OVERDRAW_CACHE_SIZE);
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        uint32_t misses = cache.misses(vg, t);
+        if((t == 0) || (misses == 3))
+        {
+            hard.push_back(t);
+            hardMisses.push_back(0);
+        }
+        hardMisses.back() += misses;
+    }
+    hard.push_back(triangleCount);
+
+    VertexCacheSimulator clusterCache(vertexCount, OVERDRAW_CACHE_SIZE);
+    for(uint32_t i = 0; i + 1 < hard.size(); i++)
+    {
+        uint32_t start = hard[i], end = hard[i + 1];
+        float acmr = (float)hardMisses[i] / (end - start);
+        uint32_t misses = 0;
+        clusters.push_back(start);
+        clusterCache.clear();
+        for(uint32_t t = start; t < end; t++)
+        {
+            misses += clusterCache.misses(vg, t);
+            uint32_t size = t + 1 - clusters.back();
+            if(((t + 1) < end) && ((float)misses <= (acmr * threshold * size)))
+            {
+                clusters.push_back(t + 1);
+                clusterCache.clear();
+                misses = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+}
+
+void MeshOptimizer::optimizeOverdraw(VertexGroup *vg, float threshold)
+{
+    if(!vg || (vg->mode != GL_TRIANGLES))
+        return;
+    uint32_t triangleCount = vg->elementCount() / 3;
+    if(triangleCount < 2)
+        return;
+    vector<uint32_t> clusters;
+    clusterTriangles(vg, threshold, clusters);
+    uint32_t clusterCount = clusters.size() - 1;
+    if(clusterCount < 2)
+        return;
+
+    // area-weighted centroid and normal of each cluster
+    vector<float> clusterData(clusterCount * 6, 0.0f);
+    float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+    float meshArea = 0.0f;
+    for(uint32_t c = 0; c < clusterCount; c++)
+    {
+        float *data = &clusterData[c * 6];
+        float area = 0.0f;
+        for(uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const vec3 &a = vg->data[vg->vertexIndex(t * 3)].position;
+            const vec3 &b = vg->data[vg->vertexIndex(t * 3 + 1)].position;
+            const vec3 &d = vg->data[vg->vertexIndex(t * 3 + 2)].position;
+            float e1[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+            float e2[3] = {d.x - a.x, d.y - a.y, d.z - a.z};
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                          e1[2] * e2[0] - e1[0] * e2[2],
+                          e1[0] * e2[1] - e1[1] * e2[0]};
+            float triangleArea = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            data[0] += (a.x + b.x + d.x) * triangleArea / 3.0f;
+            data[1] += (a.y + b.y + d.y) * triangleArea / 3.0f;
+            data[2] += (a.z + b.z + d.z) * triangleArea / 3.0f;
+            data[3] += n[0];
+            data[4] += n[1];
+            data[5] += n[2];
+            area += triangleArea;
+        }
+        for(int k = 0; k < 3; k++)
+            meshCentroid[k] += data[k];
+        meshArea += area;
+        if(area > 0.0f)
+        {
+            for(int k = 0; k < 3; k++)
+                data[k] /= area;
+        }
+    }
+    if(meshArea > 0.0f)
+    {
+        for(int k = 0; k < 3; k++)
+            meshCentroid[k] /= meshArea;
+    }
+
+    // clusters that are further out along their normal are more likely to
+    // hide the other ones, draw them first
+    vector< pair<float, uint32_t> > order(clusterCount);
+    for(uint32_t c = 0; c < clusterCount; c++)
+    {
+        const float *data = &clusterData[c * 6];
+        float length = sqrt(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+        float dot = 0.0f;
+        for(int k = 0; k < 3; k++)
+            dot += (data[k] - meshCentroid[k]) * data[3 + k];
+        float key = (length > 0.0f) ? (-dot / length) : 0.0f;
+        order[c] = pair<float, uint32_t>((key == key) ? key : 0.0f, c);
+    }
+    sort(order.begin(), order.end());
+
+    if(vg->indices)
+    {
+        uint32_t *indices = new uint32_t[vg->indexCount];
+        uint32_t *out = indices;
+        for(uint32_t i = 0; i < clusterCount; i++)
+        {
+            uint32_t c = order[i].second;
+            uint32_t size = (clusters[c + 1] - clusters[c]) * 3;
+            memcpy(out, vg->indices + clusters[c] * 3, size * sizeof(uint32_t));
+            out += size;
+        }
+        delete [] vg->indices;
+        vg->indices = indices;
+    }
+    else
+    {
+        VertexData *data = new VertexData[vg->count];
+        VertexData *out = data;
+        for(uint32_t i = 0; i < clusterCount; i++)
+        {
+            uint32_t c = order[i].second;
+            uint32_t size = (clusters[c + 1] - clusters[c]) * 3;
+            memcpy(out, vg->data + clusters[c] * 3, size * sizeof(VertexData));
+            out += size;
+        }
+        vg->setData(data, vg->count);
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(VertexGroup *vg)
+{
+    if(!vg || !vg->indices)
+        return;
+    vector<uint32_t> remap(vg->count, EMPTY_SLOT);
+    VertexData *data = new VertexData[vg->count];
+    uint32_t used = 0;
+    for(uint32_t i = 0; i < vg->indexCount; i++)
+    {
+        uint32_t v = vg->indices[i];
+        if(remap[v] == EMPTY_SLOT)
+        {
+            remap[v] = used;
+            data[used++] = vg->data[v];
+        }
+        vg->indices[i] = remap[v];
+    }
+    // vertices that are not used by any triangle are dropped
+    vg->setData(data, used);
+}
+
+void MeshOptimizer::analyzeVertexCache(const VertexGroup *vg, uint32_t cacheSize,
+                                       float &acmr, float &atvr)
+{
+    acmr = atvr = 0.0f;
+    if(!vg || (vg->mode != GL_TRIANGLES))
+        return;
+    uint32_t triangleCount = vg->elementCount() / 3;
+    uint32_t vertexCount = vg->indices ? vg->count : vg->elementCount();
+    if((triangleCount == 0) || (vertexCount == 0))
+        return;
+    VertexCacheSimulator cache(vertexCount, cacheSize);
+    uint32_t misses = 0;
+    for(uint32_t t = 0; t < triangleCount; t++)
+        misses += cache.misses(vg, t);
+    acmr = (float)misses / triangleCount;
+    atvr = (float)misses / vertexCount;
+}
+
+// Sum of the squared distances to a set of planes, weighted by the area of the
+// triangles they come from: v^T A v + 2 b.v + c.
+typedef struct
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+} Quadric;
+
+static void addPlaneQuadric(Quadric &q, const vec3 &p0, const vec3 &p1, const vec3 &p2)
+{
+    double ux = p1.x - p0.x, uy = p1.y - p0.y, uz = p1.z - p0.z;
+    double vx = p2.x - p0.x, vy = p2.y - p0.y, vz = p2.z - p0.z;
+    double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+    double length = sqrt(nx * nx + ny * ny + nz * nz);
+    if(length == 0.0)
+        return;
+    double area = length * 0.5;
+    nx /= length;
+    ny /= length;
+    nz /= length;
+    double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+    q.a00 += area * nx * nx;
+    q.a01 += area * nx * ny;
+    q.a02 += area * nx * nz;
+    q.a11 += area * ny * ny;
+    q.a12 += area * ny * nz;
+    q.a22 += area * nz * nz;
+    q.b0 += area * nx * d;
+    q.b1 += area * ny * d;
+    q.b2 += area * nz * d;
+    q.c += area * d * d;
+    q.weight += area;
+}
+
+static void addQuadric(Quadric &q, const Quadric &r)
+{
+    q.a00 += r.a00;
+    q.a01 += r.a01;
+    q.a02 += r.a02;
+    q.a11 += r.a11;
+    q.a12 += r.a12;
+    q.a22 += r.a22;
+    q.b0 += r.b0;
+    q.b1 += r.b1;
+    q.b2 += r.b2;
+    q.c += r.c;
+    q.weight += r.weight;
+}
+
+// Mean squared distance between the point and the planes of the quadric.
+static double quadricError(const Quadric &q, const vec3 &v)
+{
+    if(q.weight == 0.0)
+        return 0.0;
+    double x = v.x, y = v.y, z = v.z;
+    double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+        2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+        2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return fabs(e) / q.weight;
+}
+
+static vec3 triangleNormal(const vec3 &p0, const vec3 &p1, const vec3 &p2)
+{
+    vec3 u = p1 - p0, v = p2 - p0;
+    return vec3(u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x);
+}
+
+static int compareVectors(const float *a, const float *b, uint32_t size)
+{
+    for(uint32_t i = 0; i < size; i++)
+    {
+        if(a[i] != b[i])
+            return (a[i] < b[i]) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Orders vertices by position, then by the attributes that make them distinct.
+class WedgeOrder
+{
+public:
+    WedgeOrder(const VertexData *data, bool withNormals) : m_data(data), m_withNormals(withNormals) {}
+
+    int compare(uint32_t a, uint32_t b, bool positionOnly) const
+    {
+        const VertexData &va = m_data[a], &vb = m_data[b];
+        int c = compareVectors(&va.position.x, &vb.position.x, 3);
+        if((c != 0) || positionOnly)
+            return c;
+        if(m_withNormals && ((c = compareVectors(&va.normal.x, &vb.normal.x, 3)) != 0))
+            return c;
+        return compareVectors(&va.texCoords.x, &vb.texCoords.x, 2);
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return compare(a, b, false) < 0;
+    }
+
+private:
+    const VertexData *m_data;
+    bool m_withNormals;
+};
+
+// Whether every vertex has the normal of its triangle, the way meshes without
+// normals are loaded. These normals are recomputed after simplifying.
+static bool hasFaceNormals(const VertexData *data, const vector<uint32_t> &indices)
+{
+    for(uint32_t i = 0; i < indices.size(); i += 3)
+    {
+        const VertexData &v0 = data[indices[i]], &v1 = data[indices[i + 1]], &v2 = data[indices[i + 2]];
+        vec3 n = vec3::normal(v0.position, v1.position, v2.position);
+        if((memcmp(&n, &v0.normal, sizeof(vec3)) != 0) || (memcmp(&n, &v1.normal, sizeof(vec3)) != 0) ||
+           (memcmp(&n, &v2.normal, sizeof(vec3)) != 0))
+            return false;
+    }
+    return true;
+}
+
+typedef struct
+{
+    float cost;
+    uint32_t from;
+    uint32_t to;
+} EdgeCollapse;
+
+static bool operator<(const EdgeCollapse &a, const EdgeCollapse &b)
+{
+    return a.cost < b.cost;
+}
+
+VertexGroup * MeshOptimizer::simplify(const VertexGroup *vg, uint32_t targetIndexCount,
+                                      float maxError, float *error)
+{
+    if(error)
+        *error = 0.0f;
+    if(!vg || (vg->mode != GL_TRIANGLES) || (vg->count == 0))
+        return 0;
+    vector<uint32_t> indices(vg->elementCount() - vg->elementCount() % 3);
+    for(uint32_t i = 0; i < indices.size(); i++)
+        indices[i] = vg->vertexIndex(i);
+    uint32_t vertexCount = vg->count;
+    const VertexData *data = vg->data;
+
+    // Merge the vertices that only differ by normal when the normals are
+    // recomputed, then give vertices with the same position the same position id.
+    bool faceNormals = hasFaceNormals(data, indices);
+    WedgeOrder wedgeOrder(data, !faceNormals);
+    vector<uint32_t> order(vertexCount);
+    for(uint32_t i = 0; i < vertexCount; i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), wedgeOrder);
+    vector<uint32_t> wedgeIds(vertexCount);
+    vector<uint32_t> positionIds(vertexCount);
+    vector<uint32_t> wedges;
+    for(uint32_t i = 0; i < vertexCount; i++)
+    {
+        uint32_t v = order[i];
+        if((i > 0) && (wedgeOrder.compare(order[i - 1], v, false) == 0))
+        {
+            wedgeIds[v] = wedgeIds[order[i - 1]];
+        }
+        else
+        {
+            wedgeIds[v] = v;
+            if((i == 0) || (wedgeOrder.compare(order[i - 1], v, true) != 0))
+                wedges.push_back(0);
+            wedges.back()++;
+        }
+        positionIds[v] = wedges.size() - 1;
+    }
+    for(uint32_t i = 0; i < indices.size(); i++)
+        indices[i] = wedgeIds[indices[i]];
+    uint32_t positionCount = wedges.size();
+
+    // list the wedges of each position
+    vector<uint32_t> wedgeOffsets(positionCount + 1, 0);
+    for(uint32_t i = 0; i < positionCount; i++)
+        wedgeOffsets[i + 1] = wedgeOffsets[i] + wedges[i];
+    vector<uint32_t> wedgeList(wedgeOffsets.back());
+    for(uint32_t i = 0; i < vertexCount; i++)
+    {
+        if(wedgeIds[i] == i)
+            wedgeList[wedgeOffsets[positionIds[i]] + --wedges[positionIds[i]]] = i;
+    }
+
+    // Vertices on the border of the mesh keep their position, so that its outline
+    // is preserved. Seams are preserved by collapsing them only along themselves.
+    vector<bool> locked(positionCount, false);
+    vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for(uint32_t i = 0; i < indices.size(); i += 3)
+    {
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            uint64_t a = positionIds[indices[i + j]];
+            uint64_t b = positionIds[indices[i + (j + 1) % 3]];
+            edges.push_back((min(a, b) << 32) | max(a, b));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    for(uint32_t i = 0; i < edges.size(); )
+    {
+        uint32_t j = i + 1;
+        while((j < edges.size()) && (edges[j] == edges[i]))
+            j++;
+        // edges used by one triangle are on a border, by more than two they are not manifold
+        if((j - i) != 2)
+        {
+            locked[(uint32_t)(edges[i] >> 32)] = true;
+            locked[(uint32_t)(edges[i] & 0xffffffff)] = true;
+        }
+        i = j;
+    }
+
+    Quadric zero;
+    memset(&zero, 0, sizeof(Quadric));
+    vector<Quadric> quadrics(positionCount, zero);
+    for(uint32_t i = 0; i < indices.size(); i += 3)
+    {
+        const vec3 &p0 = data[indices[i]].position;
+        const vec3 &p1 = data[indices[i + 1]].position;
+        const vec3 &p2 = data[indices[i + 2]].position;
+        Quadric q = zero;
+        addPlaneQuadric(q, p0, p1, p2);
+        for(uint32_t j = 0; j < 3; j++)
+            addQuadric(quadrics[positionIds[indices[i + j]]], q);
+    }
+
+    vec3 minPos, maxPos;
+    vg->bounds(minPos, maxPos);
+    vec3 extent = maxPos - minPos;
+    double diagonal = sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+    double maxCost = (maxError * diagonal) * (maxError * diagonal);
+    double maxCollapsed = 0.0;
+
+    // Collapse the cheapest edges in passes. Vertices around a collapsed edge are
+    // not touched again in the same pass, so the adjacency can be built once per pass.
+    vector<uint32_t> remap(vertexCount);
+    vector<bool> touched(vertexCount);
+    vector<uint32_t> offsets(vertexCount + 1);
+    vector<uint32_t> adjacency;
+    vector<EdgeCollapse> collapses;
+    vector<uint32_t> targets;
+    while(indices.size() > targetIndexCount)
+    {
+        uint32_t triangleCount = indices.size() / 3;
+        fill(offsets.begin(), offsets.end(), 0);
+        for(uint32_t i = 0; i < indices.size(); i++)
+            offsets[indices[i] + 1]++;
+        for(uint32_t i = 0; i < vertexCount; i++)
+            offsets[i + 1] += offsets[i];
+        adjacency.resize(indices.size());
+        vector<uint32_t> fillCount(offsets.begin(), offsets.end() - 1);
+        for(uint32_t i = 0; i < indices.size(); i++)
+            adjacency[fillCount[indices[i]]++] = i / 3;
+
+        collapses.clear();
+        for(uint32_t i = 0; i < indices.size(); i++)
+        {
+            uint32_t a = indices[i];
+            uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+            uint32_t pa = positionIds[a], pb = positionIds[b];
+            for(uint32_t k = 0; k < 2; k++)
+            {
+                if(!locked[pa] && (pa != pb))
+                {
+                    Quadric q = quadrics[pa];
+                    addQuadric(q, quadrics[pb]);
+                    EdgeCollapse c;
+                    c.cost = (float)quadricError(q, data[b].position);
+                    c.from = a;
+                    c.to = b;
+                    collapses.push_back(c);
+                }
+                swap(a, b);
+                swap(pa, pb);
+            }
+        }
+        sort(collapses.begin(), collapses.end());
+
+        for(uint32_t i = 0; i < vertexCount; i++)
+            remap[i] = i;
+        fill(touched.begin(), touched.end(), false);
+        uint32_t removeTarget = (indices.size() - targetIndexCount) / 3;
+        uint32_t removed = 0;
+        for(uint32_t i = 0; (i < collapses.size()) && (removed < removeTarget); i++)
+        {
+            const EdgeCollapse &c = collapses[i];
+            if(c.cost > maxCost)
+                break;
+            // every wedge of the position must be moved to a wedge it shares an edge
+            // with, otherwise the texture would be stretched across a seam
+            uint32_t pa = positionIds[c.from], pb = positionIds[c.to];
+            bool valid = true;
+            targets.clear();
+            for(uint32_t w = wedgeOffsets[pa]; valid && (w < wedgeOffsets[pa + 1]); w++)
+            {
+                uint32_t from = wedgeList[w];
+                uint32_t to = EMPTY_SLOT;
+                for(uint32_t j = offsets[from]; valid && (j < offsets[from + 1]); j++)
+                {
+                    const uint32_t *t = &indices[adjacency[j] * 3];
+                    for(uint32_t k = 0; k < 3; k++)
+                    {
+                        if(positionIds[t[k]] != pb)
+                            continue;
+                        valid = (to == EMPTY_SLOT) || (to == t[k]);
+                        to = t[k];
+                    }
+                }
+                valid = valid && (to != EMPTY_SLOT) && !touched[from] && !touched[to];
+                targets.push_back(to);
+            }
+            if(!valid)
+                continue;
+
+            // do not flip the triangles around the position being moved
+            bool flipped = false;
+            uint32_t collapsedTriangles = 0;
+            for(uint32_t w = wedgeOffsets[pa]; !flipped && (w < wedgeOffsets[pa + 1]); w++)
+            {
+                uint32_t from = wedgeList[w];
+                for(uint32_t j = offsets[from]; !flipped && (j < offsets[from + 1]); j++)
+                {
+                    const uint32_t *t = &indices[adjacency[j] * 3];
+                    if((positionIds[t[0]] == pb) || (positionIds[t[1]] == pb) || (positionIds[t[2]] == pb))
+                    {
+                        collapsedTriangles++;
+                        continue;
+                    }
+                    vec3 p[3], q[3];
+                    for(uint32_t k = 0; k < 3; k++)
+                    {
+                        p[k] = data[t[k]].position;
+                        q[k] = (t[k] == from) ? data[c.to].position : p[k];
+                    }
+                    vec3 before = triangleNormal(p[0], p[1], p[2]);
+                    vec3 after = triangleNormal(q[0], q[1], q[2]);
+                    flipped = (before.x * after.x + before.y * after.y + before.z * after.z) <= 0.0f;
+                }
+            }
+            if(flipped)
+                continue;
+            addQuadric(quadrics[pb], quadrics[pa]);
+            for(uint32_t w = wedgeOffsets[pa]; w < wedgeOffsets[pa + 1]; w++)
+            {
+                uint32_t from = wedgeList[w];
+                remap[from] = targets[w - wedgeOffsets[pa]];
+                touched[remap[from]] = true;
+                for(uint32_t j = offsets[from]; j < offsets[from + 1]; j++)
+                {
+                    const uint32_t *t = &indices[adjacency[j] * 3];
+                    touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+                }
+            }
+            removed += collapsedTriangles;
+            maxCollapsed = max(maxCollapsed, (double)c.cost);
+        }
+        if(removed == 0)
+            break;
+
+        // drop the triangles that lost their area
+        uint32_t kept = 0;
+        for(uint32_t i = 0; i < triangleCount; i++)
+        {
+            uint32_t a = remap[indices[i * 3]];
+            uint32_t b = remap[indices[i * 3 + 1]];
+            uint32_t c = remap[indices[i * 3 + 2]];
+            uint32_t pa = positionIds[a], pb = positionIds[b], pc = positionIds[c];
+            if((pa == pb) || (pb == pc) || (pa == pc))
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+    }
+
+    if(error && (diagonal > 0.0))
+        *error = (float)(sqrt(maxCollapsed) / diagonal);
+    VertexGroup *lod;
+    if(faceNormals)
+    {
+        lod = new VertexGroup(GL_TRIANGLES, indices.size());
+        for(uint32_t i = 0; i < indices.size(); i++)
+            lod->data[i] = data[indices[i]];
+        uint32_t triangles = indices.size() / 3, stride = 3 * sizeof(VertexData);
+        VertexData *t = lod->data;
+        if(triangles > 0)
+        {
+            vec3::normals(&t[0].position, &t[1].position, &t[2].position, stride,
+                          &t[0].normal, stride, triangles);
+        }
+        for(uint32_t i = 0; i < triangles; i++, t += 3)
+            t[1].normal = t[2].normal = t[0].normal;
+        weld(lod);
+    }
+    else
+    {
+        lod = new VertexGroup(GL_TRIANGLES, vertexCount, indices.size());
+        memcpy(lod->data, data, vertexCount * sizeof(VertexData));
+        if(indices.size() > 0)
+            memcpy(lod->indices, &indices[0], indices.size() * sizeof(uint32_t));
+        optimizeVertexFetch(lod);
+    }
+    return lod;
+}
+
+WeldingVertexSink::WeldingVertexSink()
+{
+    resizeTable(1024);
+}
+
+void WeldingVertexSink::addVertices(const VertexData *vertices, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+        m_indices.push_back(addVertex(vertices[i]));
+}
+
+uint32_t WeldingVertexSink::addVertex(const VertexData &v)
+{
+    uint32_t mask = m_table.size() - 1;
+    uint32_t slot = hashVertex(v) & mask;
+    while(true)
+    {
+        uint32_t index = m_table[slot];
+        if(index == EMPTY_SLOT)
+            break;
+        else if(memcmp(&m_vertices[index], &v, sizeof(VertexData)) == 0)
+            return index;
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t index = m_vertices.size();
+    m_table[slot] = index;
+    m_vertices.push_back(v);
+    // keep the table at most half full
+    if((m_vertices.size() * 2) > m_table.size())
+        resizeTable(m_table.size() * 2);
+    return index;
+}
+
+void WeldingVertexSink::resizeTable(uint32_t size)
+{
+    vector<uint32_t>(size, EMPTY_SLOT).swap(m_table);
+    uint32_t mask = size - 1;
+    for(uint32_t i = 0; i < m_vertices.size(); i++)
+    {
+        uint32_t slot = hashVertex(m_vertices[i]) & mask;
+        while(m_table[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+        m_table[slot] = i;
+    }
+}
+
+VertexGroup * WeldingVertexSink::createGroup(uint32_t mode)
+{
+    vector<uint32_t>().swap(m_table);
+    uint32_t count = m_indices.size();
+    uint32_t uniqueCount = m_vertices.size();
+    VertexGroup *vg = 0;
+    if(isIndexingWorth(count, uniqueCount))
+    {
+        vg = new VertexGroup(mode, uniqueCount, count);
+        if(uniqueCount > 0)
+            memcpy(vg->data, &m_vertices[0], uniqueCount * sizeof(VertexData));
+        if(count > 0)
+            memcpy(vg->indices, &m_indices[0], count * sizeof(uint32_t));
+    }
+    else
+    {
+        vg = new VertexGroup(mode, count);
+        for(uint32_t i = 0; i < count; i++)
+            vg->data[i] = m_vertices[m_indices[i]];
+    }
+    vector<VertexData>().swap(m_vertices);
+    vector<uint32_t>().swap(m_indices);
+    resizeTable(1024);
+    return vg;
+}
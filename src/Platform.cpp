@@ -21,14 +21,106 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <cstdio>
+#include <deque>
 #include "Platform.h"
 
-void checkGlError(const char* op)
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+
+const char *mapFileData(std::string path, size_t &size)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+        return 0;
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+    {
+        CloseHandle(file);
+        return 0;
+    }
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    CloseHandle(file);
+    if(!mapping)
+        return 0;
+    // the view keeps the mapping alive until it is unmapped
+    const char *data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if(data)
+        size = (size_t)fileSize.QuadPart;
+    return data;
+}
+
+void unmapFileData(const char *data, size_t size)
+{
+    (void)size;
+    if(data)
+        UnmapViewOfFile(data);
+}
+
+std::string temporaryFilePath(std::string path)
+{
+    char suffix[32];
+    sprintf(suffix, ".%lu.tmp", (unsigned long)GetCurrentProcessId());
+    return path + suffix;
+}
+
+bool replaceFile(std::string from, std::string to)
+{
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+const char *mapFileData(std::string path, size_t &size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return 0;
+    struct stat info;
+    if((fstat(fd, &info) < 0) || (info.st_size == 0))
+    {
+        close(fd);
+        return 0;
+    }
+    void *data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return 0;
+    size = (size_t)info.st_size;
+    return (const char *)data;
+}
+
+void unmapFileData(const char *data, size_t size)
+{
+    if(data)
+        munmap((void *)data, size);
+}
+
+std::string temporaryFilePath(std::string path)
+{
+    char suffix[32];
+    sprintf(suffix, ".%lu.tmp", (unsigned long)getpid());
+    return path + suffix;
+}
+
+bool replaceFile(std::string from, std::string to)
 {
-    for(GLint error = glGetError(); error; error = glGetError())
-        LOGI("after %s() glError (0x%x)\n", op, error);
+    return rename(from.c_str(), to.c_str()) == 0;
 }
 
+#endif
+
 #ifdef JNI_WRAPPER
 
 char *loadFileData(std::string path)
@@ -57,9 +149,126 @@ char *loadFileData(std::string path)
     return code;
 }
 
+bool isFileNewer(std::string path, std::string other)
+{
+    struct stat info, otherInfo;
+    if(stat(path.c_str(), &info) < 0)
+        return false;
+    if(stat(other.c_str(), &otherInfo) < 0)
+        return true;
+    return info.st_mtime >= otherInfo.st_mtime;
+}
+
+std::string cacheFilePath(std::string path, std::string extension)
+{
+    (void)path;
+    (void)extension;
+    return std::string();
+}
+
+class FileReaderPrivate
+{
+public:
+    FILE *file;
+};
+
+FileReader::FileReader()
+{
+    d = new FileReaderPrivate();
+    d->file = 0;
+}
+
+FileReader::~FileReader()
+{
+    close();
+    delete d;
+}
+
+bool FileReader::open(std::string path)
+{
+    close();
+    d->file = fopen(path.c_str(), "rb");
+    return d->file != 0;
+}
+
+void FileReader::close()
+{
+    if(d->file)
+    {
+        fclose(d->file);
+        d->file = 0;
+    }
+}
+
+size_t FileReader::read(char *buffer, size_t size)
+{
+    return d->file ? fread(buffer, 1, size, d->file) : 0;
+}
+
+// There is no thread pool on this platform, tasks are run when they are started.
+class TaskPoolPrivate
+{
+public:
+    std::deque<Task *> finished;
+};
+
+TaskPool::TaskPool(int threads)
+{
+    (void)threads;
+    d = new TaskPoolPrivate();
+}
+
+TaskPool::~TaskPool()
+{
+    delete d;
+}
+
+int TaskPool::threadCount() const
+{
+    return 1;
+}
+
+int TaskPool::pendingCount() const
+{
+    return (int)d->finished.size();
+}
+
+void TaskPool::start(Task *task)
+{
+    task->run();
+    d->finished.push_back(task);
+}
+
+Task * TaskPool::nextFinished()
+{
+    return waitForNext();
+}
+
+Task * TaskPool::waitForNext()
+{
+    if(d->finished.empty())
+        return 0;
+    Task *task = d->finished.front();
+    d->finished.pop_front();
+    return task;
+}
+
+void TaskPool::waitForDone()
+{
+}
+
 #else
 
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
 
 QString resolvePath(QString path)
 {
@@ -106,4 +315,169 @@ void freeFileData(char *data)
     delete [] data;
 }
 
+static QDateTime lastModified(QString path)
+{
+    // resources are as old as the executable they are embedded in
+    if(!QFile::exists(path))
+        path = QFile::exists(QString(":/%1").arg(path)) ? QCoreApplication::applicationFilePath() : QString();
+    return path.isEmpty() ? QDateTime() : QFileInfo(path).lastModified();
+}
+
+bool isFileNewer(std::string path, std::string other)
+{
+    QDateTime time = lastModified(QString::fromStdString(path));
+    if(!time.isValid())
+        return false;
+    QDateTime otherTime = lastModified(QString::fromStdString(other));
+    return !otherTime.isValid() || (time >= otherTime);
+}
+
+std::string cacheFilePath(std::string path, std::string extension)
+{
+    QString cacheDir = QDir::homePath() + "/.cache/dragon-demo";
+    if(!QDir().mkpath(cacheDir))
+        return std::string();
+    // escape the whole path into one file name, so different files do not clash
+    QString realPath = resolvePath(QString::fromStdString(path));
+    if(!realPath.startsWith(":/"))
+        realPath = QFileInfo(realPath).absoluteFilePath();
+    QFileInfo info(realPath);
+    QString name = info.path() + "/" + info.completeBaseName() + QString::fromStdString(extension);
+    name.replace("%", "%25").replace("/", "%2F").replace("\\", "%5C").replace(":", "%3A");
+    return (cacheDir + "/" + name).toStdString();
+}
+
+class FileReaderPrivate
+{
+public:
+    QFile file;
+};
+
+FileReader::FileReader()
+{
+    d = new FileReaderPrivate();
+}
+
+FileReader::~FileReader()
+{
+    delete d;
+}
+
+bool FileReader::open(std::string path)
+{
+    close();
+    d->file.setFileName(resolvePath(QString::fromStdString(path)));
+    return d->file.open(QFile::ReadOnly);
+}
+
+void FileReader::close()
+{
+    d->file.close();
+}
+
+size_t FileReader::read(char *buffer, size_t size)
+{
+    qint64 count = d->file.read(buffer, (qint64)size);
+    return (count > 0) ? (size_t)count : 0;
+}
+
+class TaskPoolPrivate
+{
+public:
+    QThreadPool pool;
+    QMutex lock;
+    QWaitCondition taskFinished;
+    std::deque<Task *> finished;
+    // tasks started but not collected yet
+    int pending;
+};
+
+class TaskRunner : public QRunnable
+{
+public:
+    TaskRunner(TaskPoolPrivate *pool, Task *task)
+    {
+        m_pool = pool;
+        m_task = task;
+    }
+
+    virtual void run()
+    {
+        m_task->run();
+        QMutexLocker locker(&m_pool->lock);
+        m_pool->finished.push_back(m_task);
+        m_pool->taskFinished.wakeAll();
+    }
+
+private:
+    TaskPoolPrivate *m_pool;
+    Task *m_task;
+};
+
+TaskPool::TaskPool(int threads)
+{
+    d = new TaskPoolPrivate();
+    d->pending = 0;
+    if(threads <= 0)
+        threads = QThread::idealThreadCount();
+    d->pool.setMaxThreadCount(qMax(threads, 1));
+}
+
+TaskPool::~TaskPool()
+{
+    d->pool.waitForDone();
+    delete d;
+}
+
+int TaskPool::threadCount() const
+{
+    return d->pool.maxThreadCount();
+}
+
+int TaskPool::pendingCount() const
+{
+    QMutexLocker locker(&d->lock);
+    return d->pending;
+}
+
+void TaskPool::start(Task *task)
+{
+    {
+        QMutexLocker locker(&d->lock);
+        d->pending++;
+    }
+    d->pool.start(new TaskRunner(d, task));
+}
+
+Task * TaskPool::nextFinished()
+{
+    QMutexLocker locker(&d->lock);
+    if(d->finished.empty())
+        return 0;
+    Task *task = d->finished.front();
+    d->finished.pop_front();
+    d->pending--;
+    return task;
+}
+
+Task * TaskPool::waitForNext()
+{
+    QMutexLocker locker(&d->lock);
+    if(d->pending == 0)
+        return 0;
+    while(d->finished.empty())
+        d->taskFinished.wait(&d->lock);
+    Task *task = d->finished.front();
+    d->finished.pop_front();
+    d->pending--;
+    return task;
+}
+
+void TaskPool::waitForDone()
+{
+    QMutexLocker locker(&d->lock);
+    while((int)d->finished.size() < d->pending)
+        d->taskFinished.wait(&d->lock);
+}
+
 #endif
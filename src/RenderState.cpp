@@ -21,8 +21,142 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
-#include <sstream>
+#include <cstdio>
 #include "RenderState.h"
+#include "MeshOptimizer.h"
+#include "GltfWriter.h"
+#include "Platform.h"
+
+// Write the cooked copy of a mesh to a temporary file first, so that a partly
+// written file never replaces a good one.
+static bool saveCookedMesh(string cookedPath, vector<VertexGroup *> &groups)
+{
+    string tempPath = temporaryFilePath(cookedPath);
+    if(Mesh::saveBinary(tempPath, &groups[0], groups.size()) && replaceFile(tempPath, cookedPath))
+        return true;
+    remove(tempPath.c_str());
+    return false;
+}
+
+// Number of LODs created for each mesh. Every level halves the triangle count
+// of the previous one and may deviate twice as much from the full mesh.
+#define MESH_LOD_LEVELS 3
+#define MESH_LOD_ERROR 0.01f
+
+// Simplify a single-group mesh into a chain of LODs, stopping once
+// simplifying further would not remove enough triangles.
+static void addLodGroups(vector<VertexGroup *> &groups)
+{
+    if(groups.size() != 1)
+        return;
+    const VertexGroup *full = groups[0];
+    uint32_t previousCount = full->elementCount();
+    float maxError = MESH_LOD_ERROR;
+    for(uint32_t level = 1; level <= MESH_LOD_LEVELS; level++, maxError *= 2.0f)
+    {
+        uint32_t target = (full->elementCount() / 3 >> level) * 3;
+        VertexGroup *lod = MeshOptimizer::simplify(full, target, maxError);
+        if(!lod || (lod->elementCount() > previousCount * 0.9))
+        {
+            delete lod;
+            break;
+        }
+        MeshOptimizer::optimize(lod);
+        lod->lod = level;
+        previousCount = lod->elementCount();
+        groups.push_back(lod);
+    }
+}
+
+// Load the groups of a mesh file, using the cooked copy of the mesh when it is
+// up to date and creating it otherwise. This does not use GL.
+static bool loadMeshGroups(string path, vector<VertexGroup *> &groups)
+{
+    string cookedPath = cacheFilePath(path, ".mesh");
+    if(!cookedPath.empty() && isFileNewer(cookedPath, path) && Mesh::loadBinary(cookedPath, groups))
+        return true;
+    // weld while streaming the file, large meshes would not fit in memory otherwise
+    WeldingVertexSink sink;
+    if(!Mesh::loadObj(path, &sink))
+        return false;
+    VertexGroup *vg = sink.createGroup(GL_TRIANGLES);
+    MeshOptimizer::optimize(vg);
+    groups.push_back(vg);
+    addLodGroups(groups);
+    if(!cookedPath.empty() && !saveCookedMesh(cookedPath, groups))
+        fprintf(stderr, "Could not cook mesh '%s' to '%s'.\n", path.c_str(), cookedPath.c_str());
+    return true;
+}
+
+class AssetLoadTask : public Task
+{
+public:
+    // Create the asset from what run() loaded. Called on the GL thread.
+    virtual void upload(RenderState *state) = 0;
+};
+
+class MeshLoadTask : public AssetLoadTask
+{
+public:
+    MeshLoadTask(string name, string path)
+    {
+        m_name = name;
+        m_path = path;
+    }
+
+    virtual void run()
+    {
+        loadMeshGroups(m_path, m_groups);
+    }
+
+    virtual void upload(RenderState *state)
+    {
+        state->loadMeshFromGroups(m_name, m_groups);
+        m_groups.clear();
+    }
+
+private:
+    string m_name;
+    string m_path;
+    vector<VertexGroup *> m_groups;
+};
+
+class TextureLoadTask : public AssetLoadTask
+{
+public:
+    TextureLoadTask(string name, string path, bool mipmaps)
+    {
+        m_name = name;
+        m_path = path;
+        m_mipmaps = mipmaps;
+        m_pixels = 0;
+        m_width = m_height = 0;
+    }
+
+    virtual ~TextureLoadTask()
+    {
+        Material::freeTIFFImage(m_pixels);
+    }
+
+    virtual void run()
+    {
+        m_pixels = Material::decodeTIFFImage(m_path, m_width, m_height);
+    }
+
+    virtual void upload(RenderState *state)
+    {
+        uint32_t texID = state->createTexture(m_pixels, m_width, m_height, m_mipmaps);
+        state->addTexture(m_name, texID, m_path);
+    }
+
+private:
+    string m_name;
+    string m_path;
+    bool m_mipmaps;
+    uint32_t *m_pixels;
+    uint32_t m_width;
+    uint32_t m_height;
+};
 
 RenderState::RenderState()
 {
@@ -30,12 +164,15 @@ RenderState::RenderState()
     m_exporting = false;
     m_oldOutput = m_output;
     m_bgColor = vec4(0.6, 0.6, 1.0, 1.0);
+    m_meshesByID.push_back(0);
     reset();
 }
 
 RenderState::~RenderState()
 {
     freeMeshes();
+    for(uint32_t i = 0; i < m_queuedAssets.size(); i++)
+        delete m_queuedAssets[i];
 }
 
 map<string, Mesh *> & RenderState::meshes()
@@ -50,14 +187,21 @@ const map<string, Mesh *> & RenderState::meshes() const
 
 Mesh * RenderState::loadMeshFromFile(string name, string path)
 {
-    return loadMeshFromGroup(name, Mesh::loadObj(path));
+    vector<VertexGroup *> groups;
+    loadMeshGroups(path, groups);
+    return loadMeshFromGroups(name, groups);
 }
 
 Mesh * RenderState::loadMeshFromData(string name, const char *data, size_t size)
 {
-    string contents(data, size);
-    std::stringstream s(contents, ios_base::in);
-    return loadMeshFromGroup(name, Mesh::loadObj(s));
+    VertexGroup *vg = Mesh::loadObj(data, size);
+    if(!vg)
+        return 0;
+    MeshOptimizer::optimize(vg);
+    vector<VertexGroup *> groups;
+    groups.push_back(vg);
+    addLodGroups(groups);
+    return loadMeshFromGroups(name, groups);
 }
 
 void RenderState::freeMeshes()
@@ -66,44 +210,154 @@ void RenderState::freeMeshes()
     for(it = m_meshes.begin(); it != m_meshes.end(); it++)
         delete it->second;
     m_meshes.clear();
+    // the handles stay valid, for meshes loaded again with the same names
+    for(uint32_t i = 0; i < m_meshesByID.size(); i++)
+        m_meshesByID[i] = 0;
+}
+
+static void copyMeshGroups(const Mesh *source, Mesh *target)
+{
+    for(int i = 0; i < source->groupCount(); i++)
+    {
+        VertexGroup *vg = new VertexGroup(source->groupMode(i), source->groupSize(i),
+                                          source->groupIndexCount(i));
+        source->copyGroupTo(i, vg);
+        target->takeGroup(vg);
+    }
+}
+
+void RenderState::copyAssetsTo(RenderState *target) const
+{
+    target->m_meshIDs = m_meshIDs;
+    target->m_meshesByID.resize(m_meshesByID.size(), 0);
+    map<string, Mesh *>::const_iterator it;
+    for(it = m_meshes.begin(); it != m_meshes.end(); it++)
+    {
+        Mesh *source = it->second;
+        Mesh *m = target->createMesh();
+        copyMeshGroups(source, m);
+        for(int level = 1; level < source->lodCount(); level++)
+        {
+            Mesh *lod = target->createMesh();
+            copyMeshGroups(source->lod(level), lod);
+            m->addLod(lod);
+        }
+        target->m_meshes.insert(pair<string, Mesh *>(it->first, m));
+        target->m_meshesByID[target->meshHandle(it->first).id] = m;
+    }
+    target->m_textures.insert(m_textures.begin(), m_textures.end());
+    target->m_texturePaths.insert(m_texturePaths.begin(), m_texturePaths.end());
 }
 
 Mesh * RenderState::loadMeshFromGroup(string name, VertexGroup *vg)
 {
-    Mesh *m = 0;
+    vector<VertexGroup *> groups;
     if(vg)
+        groups.push_back(vg);
+    return loadMeshFromGroups(name, groups);
+}
+
+Mesh * RenderState::loadMeshFromGroups(string name, const vector<VertexGroup *> &groups)
+{
+    Mesh *m = 0;
+    if(groups.size() > 0)
     {
         m = createMesh();
         if(m)
         {
-            m->addGroup(vg);
+            // groups of the same level of detail make up one mesh
+            uint32_t maxLevel = 0;
+            for(uint32_t i = 0; i < groups.size(); i++)
+                maxLevel = max(maxLevel, groups[i]->lod);
+            for(uint32_t level = 0; level <= maxLevel; level++)
+            {
+                Mesh *lod = (level == 0) ? m : createMesh();
+                for(uint32_t i = 0; i < groups.size(); i++)
+                {
+                    if(groups[i]->lod == level)
+                        lod->addGroup(groups[i]);
+                }
+                if(level > 0)
+                    m->addLod(lod);
+            }
             m_meshes.insert(pair<string, Mesh *>(name, m));
+            m_meshesByID[meshHandle(name).id] = m_meshes[name];
         }
-        delete vg;
     }
+    for(uint32_t i = 0; i < groups.size(); i++)
+        delete groups[i];
     return m;
 }
 
 uint32_t RenderState::loadTextureFromFile(string name, string path, bool mipmaps)
 {
-    uint32_t texID = Material::textureFromTIFFImage(path, mipmaps);
-    m_textures.insert(pair<string, uint32_t>(name, texID));
+    uint32_t width, height;
+    uint32_t *pixels = Material::decodeTIFFImage(path, width, height);
+    uint32_t texID = createTexture(pixels, width, height, mipmaps);
+    Material::freeTIFFImage(pixels);
+    addTexture(name, texID, path);
     return texID;
 }
 
 uint32_t RenderState::loadTextureFromData(string name, const char *data, size_t size, bool mipmaps)
 {
-    uint32_t texID = Material::textureFromTIFFImage(data, size, mipmaps);
-    m_textures.insert(pair<string, uint32_t>(name, texID));
+    uint32_t width, height;
+    uint32_t *pixels = Material::decodeTIFFImage(data, size, width, height);
+    uint32_t texID = createTexture(pixels, width, height, mipmaps);
+    Material::freeTIFFImage(pixels);
+    addTexture(name, texID);
     return texID;
 }
 
+void RenderState::queueMeshFromFile(string name, string path)
+{
+    m_queuedAssets.push_back(new MeshLoadTask(name, path));
+}
+
+void RenderState::queueTextureFromFile(string name, string path, bool mipmaps)
+{
+    m_queuedAssets.push_back(new TextureLoadTask(name, path, mipmaps));
+}
+
+void RenderState::loadQueuedAssets(int threads)
+{
+    // read and decode the assets on the pool, upload each one as soon as it is ready
+    TaskPool pool(threads);
+    for(uint32_t i = 0; i < m_queuedAssets.size(); i++)
+        pool.start(m_queuedAssets[i]);
+    m_queuedAssets.clear();
+    while(Task *task = pool.waitForNext())
+    {
+        AssetLoadTask *asset = (AssetLoadTask *)task;
+        asset->upload(this);
+        delete asset;
+    }
+}
+
 uint32_t RenderState::texture(string name) const
 {
     map<string, uint32_t>::const_iterator it = m_textures.find(name);
     return (it != m_textures.end()) ? it->second : 0;
 }
 
+string RenderState::texturePath(uint32_t texID) const
+{
+    map<uint32_t, string>::const_iterator it = m_texturePaths.find(texID);
+    return (it != m_texturePaths.end()) ? it->second : string();
+}
+
+void RenderState::addTexture(string name, uint32_t texID, string path)
+{
+    m_textures.insert(pair<string, uint32_t>(name, texID));
+    if(texID && !path.empty())
+        m_texturePaths.insert(pair<uint32_t, string>(texID, path));
+}
+
+Material RenderState::currentMaterial() const
+{
+    return (m_materialStack.size() > 0) ? m_materialStack.back() : Material();
+}
+
 bool RenderState::drawNormals() const
 {
     return m_drawNormals;
@@ -132,37 +386,105 @@ void RenderState::reset()
     m_wireframe = false;
 }
 
-void RenderState::drawMesh(string name)
+void RenderState::drawMesh(string name, int lod)
+{
+    drawMesh(meshHandle(name), lod);
+}
+
+void RenderState::drawMesh(MeshHandle handle, int lod)
+{
+    Mesh *m = mesh(handle);
+    if(m)
+        drawMesh(m->lod(lod));
+}
+
+MeshHandle RenderState::meshHandle(string name)
+{
+    map<string, uint32_t>::iterator it = m_meshIDs.find(name);
+    if(it != m_meshIDs.end())
+        return MeshHandle(it->second);
+    uint32_t id = m_meshesByID.size();
+    map<string, Mesh *>::iterator meshIt = m_meshes.find(name);
+    m_meshesByID.push_back((meshIt != m_meshes.end()) ? meshIt->second : 0);
+    m_meshIDs.insert(pair<string, uint32_t>(name, id));
+    return MeshHandle(id);
+}
+
+Mesh * RenderState::mesh(MeshHandle handle) const
 {
-    map<string, Mesh *>::iterator it = m_meshes.find(name);
-    if(it != m_meshes.end())
-        drawMesh(it->second);
+    return (handle.id < m_meshesByID.size()) ? m_meshesByID[handle.id] : 0;
 }
 
 void RenderState::beginExportMesh(string path)
 {
     if(m_exporting)
         return;
-    m_exporting = true;
+    beginCaptureMesh();
     m_exportPath = path;
+}
+
+void RenderState::beginCaptureMesh()
+{
+    if(m_exporting)
+        return;
+    m_exporting = true;
     m_oldOutput = m_output;
     pushMatrix();
     loadIdentity();
     m_output = Mesh::RenderToMesh;
     m_meshOutput = createMesh();
+    m_exportMaterials.clear();
 }
 
-void RenderState::endExportMesh()
+Mesh * RenderState::endCaptureMesh()
 {
     if(!m_exporting)
-        return;
+        return 0;
     popMatrix();
     m_output = m_oldOutput;
-    m_meshOutput->saveObj(m_exportPath);
-    delete m_meshOutput;
+    Mesh *m = m_meshOutput;
     m_meshOutput = 0;
-    m_exportPath = string();
     m_exporting = false;
+    return m;
+}
+
+void RenderState::addExportMaterials()
+{
+    Material m = currentMaterial();
+    while(m_exportMaterials.size() < (uint32_t)m_meshOutput->groupCount())
+        m_exportMaterials.push_back(m);
+}
+
+// Binary glTF keeps the materials and textures the groups were drawn with.
+static bool saveGltf(string path, const Mesh *m, const vector<Material> &materials,
+                     const RenderState *state)
+{
+    GltfWriter writer;
+    for(int i = 0; i < m->groupCount(); i++)
+    {
+        VertexGroupView vg;
+        m->groupView(i, vg);
+        Material material = (i < (int)materials.size()) ? materials[i] : Material();
+        writer.addGroup(vg, material, state->texturePath(material.texture()));
+    }
+    return writer.save(path);
+}
+
+bool RenderState::endExportMesh()
+{
+    if(!m_exporting)
+        return false;
+    Mesh *m = endCaptureMesh();
+    size_t dot = m_exportPath.rfind('.');
+    bool saved = false;
+    if((dot != string::npos) && (m_exportPath.substr(dot) == ".glb"))
+        saved = saveGltf(m_exportPath, m, m_exportMaterials, this);
+    else
+        saved = m->saveObj(m_exportPath);
+    delete m;
+    m_exportMaterials.clear();
+    m_exportPath = string();
+    return saved;
 }
 
 void RenderState::init()
@@ -176,6 +498,11 @@ StateObject::StateObject(RenderState *s)
     m_state = s;
 }
 
+void StateObject::setState(RenderState *s)
+{
+    m_state = s;
+}
+
 void StateObject::loadIdentity()
 {
     m_state->loadIdentity();
@@ -191,6 +518,11 @@ void StateObject::popMatrix()
     m_state->popMatrix();
 }
 
+void StateObject::multiplyMatrix(const matrix4 &m)
+{
+    m_state->multiplyMatrix(m);
+}
+
 void StateObject::translate(float dx, float dy, float dz)
 {
     m_state->translate(dx, dy, dz);
@@ -211,9 +543,19 @@ void StateObject::drawMesh(Mesh *m)
     m_state->drawMesh(m);
 }
 
-void StateObject::drawMesh(string name)
+void StateObject::drawMesh(string name, int lod)
+{
+    m_state->drawMesh(name, lod);
+}
+
+void StateObject::drawMesh(MeshHandle handle, int lod)
+{
+    m_state->drawMesh(handle, lod);
+}
+
+MeshHandle StateObject::meshHandle(string name)
 {
-    m_state->drawMesh(name);
+    return m_state->meshHandle(name);
 }
 
 void StateObject::pushMaterial(const Material &m)
@@ -0,0 +1,194 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "RenderStateCapture.h"
+#include "MeshCapture.h"
+
+RenderStateCapture::RenderStateCapture() : RenderState()
+{
+    m_matrixMode = ModelView;
+    m_modelView.setIdentity();
+    m_matrix[(int)Projection].setIdentity();
+    m_matrix[(int)Texture].setIdentity();
+    m_nextTexture = 1;
+}
+
+RenderStateCapture::~RenderStateCapture()
+{
+}
+
+Mesh * RenderStateCapture::createMesh() const
+{
+    return new MeshCapture();
+}
+
+void RenderStateCapture::drawMesh(Mesh *m)
+{
+    if(!m)
+        return;
+    m->draw(m_output, this, m_meshOutput);
+    if(m_exporting)
+        addExportMaterials();
+}
+
+uint32_t RenderStateCapture::loadTextureFromFile(string name, string path, bool mipmaps)
+{
+    (void)mipmaps;
+    uint32_t texID = m_nextTexture++;
+    addTexture(name, texID, path);
+    return texID;
+}
+
+uint32_t RenderStateCapture::loadTextureFromData(string name, const char *data, size_t size, bool mipmaps)
+{
+    (void)data;
+    (void)size;
+    (void)mipmaps;
+    uint32_t texID = m_nextTexture++;
+    addTexture(name, texID);
+    return texID;
+}
+
+void RenderStateCapture::queueTextureFromFile(string name, string path, bool mipmaps)
+{
+    loadTextureFromFile(name, path, mipmaps);
+}
+
+uint32_t RenderStateCapture::createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps)
+{
+    (void)pixels;
+    (void)width;
+    (void)height;
+    (void)mipmaps;
+    return m_nextTexture++;
+}
+
+void RenderStateCapture::freeTextures()
+{
+    // the textures belong to the state they were copied from
+    m_textures.clear();
+    m_texturePaths.clear();
+}
+
+void RenderStateCapture::setMatrixMode(RenderState::MatrixMode newMode)
+{
+    m_matrixMode = newMode;
+}
+
+void RenderStateCapture::loadIdentity()
+{
+    if(m_matrixMode == ModelView)
+        m_modelView.setIdentity();
+    else
+        m_matrix[(int)m_matrixMode].setIdentity();
+}
+
+void RenderStateCapture::multiplyMatrix(const matrix4 &m)
+{
+    int i = (int)m_matrixMode;
+    if(m_matrixMode == ModelView)
+        m_modelView = m_modelView * affine3x4(m);
+    else
+        m_matrix[i] = m_matrix[i] * m;
+}
+
+void RenderStateCapture::pushMatrix()
+{
+    int i = (int)m_matrixMode;
+    if(m_matrixMode == ModelView)
+        m_modelViewStack.push_back(m_modelView);
+    else
+        m_matrixStack[i].push_back(m_matrix[i]);
+}
+
+void RenderStateCapture::popMatrix()
+{
+    int i = (int)m_matrixMode;
+    if(m_matrixMode == ModelView)
+    {
+        m_modelView = m_modelViewStack.back();
+        m_modelViewStack.pop_back();
+    }
+    else
+    {
+        m_matrix[i] = m_matrixStack[i].back();
+        m_matrixStack[i].pop_back();
+    }
+}
+
+void RenderStateCapture::translate(float dx, float dy, float dz)
+{
+    if(m_matrixMode == ModelView)
+        m_modelView.translateBy(dx, dy, dz);
+    else
+        m_matrix[(int)m_matrixMode].translateBy(dx, dy, dz);
+}
+
+void RenderStateCapture::rotate(float angle, float rx, float ry, float rz)
+{
+    if(m_matrixMode == ModelView)
+        m_modelView.rotateBy(angle, rx, ry, rz);
+    else
+        m_matrix[(int)m_matrixMode].rotateBy(angle, rx, ry, rz);
+}
+
+void RenderStateCapture::scale(float sx, float sy, float sz)
+{
+    if(m_matrixMode == ModelView)
+        m_modelView.scaleBy(sx, sy, sz);
+    else
+        m_matrix[(int)m_matrixMode].scaleBy(sx, sy, sz);
+}
+
+matrix4 RenderStateCapture::currentMatrix() const
+{
+    if(m_matrixMode == ModelView)
+        return m_modelView.toMatrix4();
+    return m_matrix[(int)m_matrixMode];
+}
+
+void RenderStateCapture::beginFrame(int width, int heigth)
+{
+    (void)width;
+    (void)heigth;
+}
+
+void RenderStateCapture::setupViewport(int width, int heigth)
+{
+    (void)width;
+    (void)heigth;
+}
+
+void RenderStateCapture::endFrame()
+{
+}
+
+void RenderStateCapture::pushMaterial(const Material &m)
+{
+    m_materialStack.push_back(m);
+}
+
+void RenderStateCapture::popMaterial()
+{
+    m_materialStack.pop_back();
+}
@@ -35,7 +35,7 @@ RenderStateGL1::RenderStateGL1() : RenderState()
 
 Mesh * RenderStateGL1::createMesh() const
 {
-    return new MeshGL1();
+    return new MeshGL1(this);
 }
 
 void RenderStateGL1::drawMesh(Mesh *m)
@@ -43,16 +43,27 @@ void RenderStateGL1::drawMesh(Mesh *m)
     if(!m)
         return;
     m->draw(m_output, this, m_meshOutput);
+    if(m_exporting)
+        addExportMaterials();
     if(m_drawNormals)
         m->drawNormals(this);
 }
 
+uint32_t RenderStateGL1::createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps)
+{
+    return Material::textureFromPixels(pixels, width, height, mipmaps);
+}
+
 void RenderStateGL1::freeTextures()
 {
     map<string, uint32_t>::iterator it;
     for(it = m_textures.begin(); it != m_textures.end(); it++)
+    {
         glDeleteTextures(1, &it->second);
+        m_glState.deleteTexture(it->second);
+    }
     m_textures.clear();
+    m_texturePaths.clear();
 }
 
 void RenderStateGL1::setMatrixMode(RenderStateGL1::MatrixMode newMode)
@@ -121,11 +132,11 @@ void RenderStateGL1::pushMaterial(const Material &m)
 
 void RenderStateGL1::popMaterial()
 {
-    Material m = m_materialStack.back();
     m_materialStack.pop_back();
-    endApplyMaterial(m);
     if(m_materialStack.size() > 0)
         beginApplyMaterial(m_materialStack.back());
+    else
+        m_glState.setEnabled(GL_TEXTURE_2D, false);
 }
 
 void RenderStateGL1::beginApplyMaterial(const Material &m)
@@ -134,29 +145,23 @@ void RenderStateGL1::beginApplyMaterial(const Material &m)
     glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, (GLfloat *)&m.diffuse());
     glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, (GLfloat *)&m.specular());
     glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, m.shine());
+    // the previous texture can stay bound while texturing is disabled
+    m_glState.setEnabled(GL_TEXTURE_2D, m.texture() != 0);
     if(m.texture() != 0)
-    {
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, m.texture());
-    }
-}
-
-void RenderStateGL1::endApplyMaterial(const Material &m)
-{
-    if(m.texture() != 0)
-    {
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glDisable(GL_TEXTURE_2D);
-    }
+        m_glState.bindTexture(GL_TEXTURE_2D, m.texture());
 }
 
 void RenderStateGL1::beginFrame(int w, int h)
 {
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_NORMALIZE);
+    // the state may have been changed since the last frame, e.g. by Qt
+    m_glState.invalidate();
+    m_glState.resetCounters();
+    m_glState.activeTexture(GL_TEXTURE0);
+    m_glState.setEnabled(GL_DEPTH_TEST, true);
+    m_glState.setEnabled(GL_NORMALIZE, true);
     glShadeModel(GL_SMOOTH);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+    m_glState.setEnabled(GL_LIGHTING, true);
+    m_glState.setEnabled(GL_LIGHT0, true);
     glLightfv(GL_LIGHT0, GL_POSITION, (GLfloat *)&m_light0_pos);
     glLightfv(GL_LIGHT0, GL_AMBIENT, (GLfloat *)&m_ambient0);
     glLightfv(GL_LIGHT0, GL_DIFFUSE, (GLfloat *)&m_diffuse0);
@@ -180,10 +185,21 @@ void RenderStateGL1::endFrame()
 #endif
     setMatrixMode(RenderStateGL1::ModelView);
     popMatrix();
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_NORMALIZE);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_LIGHT0);
+    // meshes leave their state set for the next one, restore the default state
+    m_glState.setClientState(GL_VERTEX_ARRAY, false);
+    m_glState.setClientState(GL_NORMAL_ARRAY, false);
+    m_glState.setClientState(GL_TEXTURE_COORD_ARRAY, false);
+    m_glState.bindTexture(GL_TEXTURE_2D, 0);
+    m_glState.setEnabled(GL_TEXTURE_2D, false);
+    m_glState.setEnabled(GL_DEPTH_TEST, false);
+    m_glState.setEnabled(GL_NORMALIZE, false);
+    m_glState.setEnabled(GL_LIGHTING, false);
+    m_glState.setEnabled(GL_LIGHT0, false);
+}
+
+GLStateCache * RenderStateGL1::glState() const
+{
+    return &m_glState;
 }
 
 void RenderStateGL1::setupViewport(int w, int h)
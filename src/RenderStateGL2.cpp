@@ -22,14 +22,55 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cstdio>
+#include <cstring>
 #include "Platform.h"
 #include "RenderStateGL2.h"
 #include "MeshGL2.h"
 
+enum UniformType
+{
+    Int1,
+    Float1,
+    Float2,
+    Float3,
+    Float4,
+    Float4x3,
+    Matrix4
+};
+
+struct UniformInfo
+{
+    const char *name;
+    UniformType type;
+    uint32_t size;      // number of 32-bit values
+};
+
+// indexed by RenderStateGL2::Uniform
+static const UniformInfo UNIFORMS[] =
+{
+    {"u_modelViewRows", Float4x3, 12},
+    {"u_projectionMatrix", Matrix4, 16},
+    {"u_position_offset", Float3, 3},
+    {"u_position_scale", Float3, 3},
+    {"u_texCoords_offset", Float2, 2},
+    {"u_texCoords_scale", Float2, 2},
+    {"u_oct_normals", Int1, 1},
+    {"u_light_ambient", Float4, 4},
+    {"u_light_diffuse", Float4, 4},
+    {"u_light_specular", Float4, 4},
+    {"u_light_pos", Float4, 4},
+    {"u_material_ambient", Float4, 4},
+    {"u_material_diffuse", Float4, 4},
+    {"u_material_specular", Float4, 4},
+    {"u_material_shine", Float1, 1},
+    {"u_material_texture", Int1, 1},
+    {"u_has_texture", Int1, 1}
+};
+
 RenderStateGL2::RenderStateGL2() : RenderState()
 {
     m_matrixMode = ModelView;
-    m_matrix[(int)ModelView].setIdentity();
+    m_modelView.setIdentity();
     m_matrix[(int)Projection].setIdentity();
     m_matrix[(int)Texture].setIdentity();
     m_ambient0 = vec4(1.0, 1.0, 1.0, 1.0);
@@ -39,8 +80,13 @@ RenderStateGL2::RenderStateGL2() : RenderState()
     m_vertexShader = 0;
     m_pixelShader = 0;
     m_program = 0;
-    m_modelViewMatrixLoc = -1;
-    m_projMatrixLoc = -1;
+    for(int i = 0; i < UNIFORM_COUNT; i++)
+    {
+        m_uniforms[i].location = -1;
+        m_uniforms[i].valid = false;
+    }
+    m_uniformUploads = 0;
+    m_skippedUniformUploads = 0;
     m_positionAttr = -1;
     m_normalAttr = -1;
     m_texCoordsAttr = -1;
@@ -65,21 +111,31 @@ void RenderStateGL2::drawMesh(Mesh *m)
 {
     if(!m)
         return;
-    glUniformMatrix4fv(m_modelViewMatrixLoc, 1, GL_FALSE,
-                       (const GLfloat *)m_matrix[(int)ModelView].d);
-    glUniformMatrix4fv(m_projMatrixLoc, 1, GL_FALSE,
-                       (const GLfloat *)m_matrix[(int)Projection].d);
+    // the model-view matrix is affine, only its first three rows are needed
+    setUniformValue(U_MODELVIEW_ROWS, m_modelView.d);
+    setUniformValue(U_PROJECTION_MATRIX, m_matrix[(int)Projection].d);
     m->draw(m_output, this, m_meshOutput);
+    if(m_exporting)
+        addExportMaterials();
     if(m_drawNormals)
         m->drawNormals(this);
 }
 
+uint32_t RenderStateGL2::createTexture(const uint32_t *pixels, uint32_t width, uint32_t height, bool mipmaps)
+{
+    return Material::textureFromPixels(pixels, width, height, mipmaps);
+}
+
 void RenderStateGL2::freeTextures()
 {
     map<string, uint32_t>::iterator it;
     for(it = m_textures.begin(); it != m_textures.end(); it++)
+    {
         glDeleteTextures(1, &it->second);
+        m_glState.deleteTexture(it->second);
+    }
     m_textures.clear();
+    m_texturePaths.clear();
 }
 
 void RenderStateGL2::setMatrixMode(RenderStateGL2::MatrixMode newMode)
@@ -89,46 +145,73 @@ void RenderStateGL2::setMatrixMode(RenderStateGL2::MatrixMode newMode)
 
 void RenderStateGL2::loadIdentity()
 {
-    int i = (int)m_matrixMode;
-    m_matrix[i].setIdentity();
+    if(m_matrixMode == ModelView)
+        m_modelView.setIdentity();
+    else
+        m_matrix[(int)m_matrixMode].setIdentity();
 }
 
 void RenderStateGL2::multiplyMatrix(const matrix4 &m)
 {
     int i = (int)m_matrixMode;
-    m_matrix[i] = m_matrix[i] * m;
+    if(m_matrixMode == ModelView)
+        m_modelView = m_modelView * affine3x4(m);
+    else
+        m_matrix[i] = m_matrix[i] * m;
 }
 
 void RenderStateGL2::pushMatrix()
 {
     int i = (int)m_matrixMode;
-    m_matrixStack[i].push_back(m_matrix[i]);
+    if(m_matrixMode == ModelView)
+        m_modelViewStack.push_back(m_modelView);
+    else
+        m_matrixStack[i].push_back(m_matrix[i]);
 }
 
 void RenderStateGL2::popMatrix()
 {
     int i = (int)m_matrixMode;
-    m_matrix[i] = m_matrixStack[i].back();
-    m_matrixStack[i].pop_back();
+    if(m_matrixMode == ModelView)
+    {
+        m_modelView = m_modelViewStack.back();
+        m_modelViewStack.pop_back();
+    }
+    else
+    {
+        m_matrix[i] = m_matrixStack[i].back();
+        m_matrixStack[i].pop_back();
+    }
 }
 
 void RenderStateGL2::translate(float dx, float dy, float dz)
 {
-    multiplyMatrix(matrix4::translate(dx, dy, dz));
+    if(m_matrixMode == ModelView)
+        m_modelView.translateBy(dx, dy, dz);
+    else
+        m_matrix[(int)m_matrixMode].translateBy(dx, dy, dz);
 }
 
 void RenderStateGL2::rotate(float angle, float rx, float ry, float rz)
 {
-    multiplyMatrix(matrix4::rotate(angle, rx, ry, rz));
+    if(m_matrixMode == ModelView)
+        m_modelView.rotateBy(angle, rx, ry, rz);
+    else
+        m_matrix[(int)m_matrixMode].rotateBy(angle, rx, ry, rz);
 }
 
 void RenderStateGL2::scale(float sx, float sy, float sz)
 {
-    multiplyMatrix(matrix4::scale(sx, sy, sz));
+    if(m_matrixMode == ModelView)
+        m_modelView.scaleBy(sx, sy, sz);
+    else
+        m_matrix[(int)m_matrixMode].scaleBy(sx, sy, sz);
 }
 
 matrix4 RenderStateGL2::currentMatrix() const
 {
+    if(m_matrixMode == ModelView)
+        return m_modelView.toMatrix4();
     return m_matrix[(int)m_matrixMode];
 }
 
@@ -140,48 +223,47 @@ void RenderStateGL2::pushMaterial(const Material &m)
 
 void RenderStateGL2::popMaterial()
 {
-    Material m = m_materialStack.back();
     m_materialStack.pop_back();
-    endApplyMaterial(m);
     if(m_materialStack.size() > 0)
         beginApplyMaterial(m_materialStack.back());
 }
 
 void RenderStateGL2::beginApplyMaterial(const Material &m)
 {
-    setUniformValue("u_material_ambient", m.ambient());
-    setUniformValue("u_material_diffuse", m.diffuse());
-    setUniformValue("u_material_specular", m.specular());
-    setUniformValue("u_material_shine", m.shine());
+    setUniformValue(U_MATERIAL_AMBIENT, m.ambient());
+    setUniformValue(U_MATERIAL_DIFFUSE, m.diffuse());
+    setUniformValue(U_MATERIAL_SPECULAR, m.specular());
+    setUniformValue(U_MATERIAL_SHINE, m.shine());
     if(m.texture() != 0)
     {
-        glActiveTexture(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, m.texture());
-        setUniformValue("u_material_texture", 0);
-        setUniformValue("u_has_texture", 1);
+        m_glState.activeTexture(GL_TEXTURE0);
+        m_glState.bindTexture(GL_TEXTURE_2D, m.texture());
+        setUniformValue(U_MATERIAL_TEXTURE, 0);
+        setUniformValue(U_HAS_TEXTURE, 1);
     }
     else
     {
-        setUniformValue("u_has_texture", 0);
+        // the previous texture can stay bound, it is not sampled
+        setUniformValue(U_HAS_TEXTURE, 0);
     }
 }
 
-void RenderStateGL2::endApplyMaterial(const Material &m)
-{
-    if(m.texture() != 0)
-        glBindTexture(GL_TEXTURE_2D, 0);
-}
-
 void RenderStateGL2::beginFrame(int w, int h)
 {
     glPushAttrib(GL_ENABLE_BIT);
-    glUseProgram(m_program);
+    // the state may have been changed since the last frame, e.g. by Qt
+    m_glState.invalidate();
+    m_glState.resetCounters();
+    m_glState.activeTexture(GL_TEXTURE0);
+    m_glState.useProgram(m_program);
     initShaders();
-    glEnable(GL_DEPTH_TEST);
-    setUniformValue("u_light_ambient", m_ambient0);
-    setUniformValue("u_light_diffuse", m_diffuse0);
-    setUniformValue("u_light_specular", m_specular0);
-    setUniformValue("u_light_pos", m_light0_pos);
+    m_uniformUploads = 0;
+    m_skippedUniformUploads = 0;
+    m_glState.setEnabled(GL_DEPTH_TEST, true);
+    setUniformValue(U_LIGHT_AMBIENT, m_ambient0);
+    setUniformValue(U_LIGHT_DIFFUSE, m_diffuse0);
+    setUniformValue(U_LIGHT_SPECULAR, m_specular0);
+    setUniformValue(U_LIGHT_POS, m_light0_pos);
     setupViewport(w, h);
     setMatrixMode(ModelView);
     pushMatrix();
@@ -195,8 +277,14 @@ void RenderStateGL2::endFrame()
     glFlush();
     setMatrixMode(ModelView);
     popMatrix();
-    glUseProgram(0);
+    // meshes leave their state set for the next one, restore the default state
+    m_glState.disableVertexAttribArrays();
+    m_glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+    m_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    m_glState.bindTexture(GL_TEXTURE_2D, 0);
+    m_glState.useProgram(0);
     glPopAttrib();
+    m_glState.invalidate();
 }
 
 void RenderStateGL2::setupViewport(int w, int h)
@@ -234,6 +322,40 @@ int RenderStateGL2::texCoordsAttr() const
     return m_texCoordsAttr;
 }
 
+void RenderStateGL2::setVertexRange(const PackedRange &range, bool octNormals) const
+{
+    setUniformValue(U_POSITION_OFFSET, &range.positionOffset);
+    setUniformValue(U_POSITION_SCALE, &range.positionScale);
+    setUniformValue(U_TEXCOORDS_OFFSET, &range.texCoordsOffset);
+    setUniformValue(U_TEXCOORDS_SCALE, &range.texCoordsScale);
+    setUniformValue(U_OCT_NORMALS, octNormals ? 1 : 0);
+}
+
+void RenderStateGL2::resetVertexRange() const
+{
+    PackedRange identity;
+    identity.positionOffset = vec3(0.0, 0.0, 0.0);
+    identity.positionScale = vec3(1.0, 1.0, 1.0);
+    identity.texCoordsOffset = vec2(0.0, 0.0);
+    identity.texCoordsScale = vec2(1.0, 1.0);
+    setVertexRange(identity, false);
+}
+
+uint32_t RenderStateGL2::uniformUploads() const
+{
+    return m_uniformUploads;
+}
+
+uint32_t RenderStateGL2::skippedUniformUploads() const
+{
+    return m_skippedUniformUploads;
+}
+
+GLStateCache * RenderStateGL2::glState() const
+{
+    return &m_glState;
+}
+
 uint32_t RenderStateGL2::loadShader(string path, uint32_t type) const
 {
     char *code = loadFileData(path);
@@ -312,8 +434,7 @@ bool RenderStateGL2::loadShaders()
     m_program = program;
     m_vertexShader = vertexShader;
     m_pixelShader = pixelShader;
-    m_modelViewMatrixLoc = glGetUniformLocation(program, "u_modelViewMatrix");
-    m_projMatrixLoc = glGetUniformLocation(program, "u_projectionMatrix");
+    resolveUniforms();
     m_positionAttr = glGetAttribLocation(program, "a_position");
     m_normalAttr = glGetAttribLocation(program, "a_normal");
     m_texCoordsAttr = glGetAttribLocation(program, "a_texCoords");
@@ -324,20 +445,69 @@ void RenderStateGL2::initShaders()
 {
 }
 
-void RenderStateGL2::setUniformValue(string name, const vec4 &v)
+void RenderStateGL2::resolveUniforms()
+{
+    // the values of the uniforms are lost when the program is linked
+    for(int i = 0; i < UNIFORM_COUNT; i++)
+    {
+        m_uniforms[i].location = glGetUniformLocation(m_program, UNIFORMS[i].name);
+        m_uniforms[i].valid = false;
+    }
+}
+
+void RenderStateGL2::setUniformValue(Uniform u, const void *value) const
+{
+    UniformSlot &slot = m_uniforms[(int)u];
+    if(slot.location < 0)
+        return;
+    const UniformInfo &info = UNIFORMS[(int)u];
+    size_t size = info.size * sizeof(uint32_t);
+    if(slot.valid && (memcmp(slot.value, value, size) == 0))
+    {
+        m_skippedUniformUploads++;
+        return;
+    }
+    memcpy(slot.value, value, size);
+    slot.valid = true;
+    m_uniformUploads++;
+    const GLfloat *f = (const GLfloat *)slot.value;
+    switch(info.type)
+    {
+    case Int1:
+        glUniform1i(slot.location, *(const GLint *)slot.value);
+        break;
+    case Float1:
+        glUniform1f(slot.location, *f);
+        break;
+    case Float2:
+        glUniform2fv(slot.location, 1, f);
+        break;
+    case Float3:
+        glUniform3fv(slot.location, 1, f);
+        break;
+    case Float4:
+        glUniform4fv(slot.location, 1, f);
+        break;
+    case Float4x3:
+        glUniform4fv(slot.location, 3, f);
+        break;
+    case Matrix4:
+        glUniformMatrix4fv(slot.location, 1, GL_FALSE, f);
+        break;
+    }
+}
+
+void RenderStateGL2::setUniformValue(Uniform u, const vec4 &v) const
 {
-    int location = glGetUniformLocation(m_program, name.c_str());
-    glUniform4fv(location, 1, (GLfloat *)&v);
+    setUniformValue(u, &v);
 }
 
-void RenderStateGL2::setUniformValue(string name, float f)
+void RenderStateGL2::setUniformValue(Uniform u, float f) const
 {
-    int location = glGetUniformLocation(m_program, name.c_str());
-    glUniform1f(location, f);
+    setUniformValue(u, &f);
 }
 
-void RenderStateGL2::setUniformValue(string name, int i)
+void RenderStateGL2::setUniformValue(Uniform u, int i) const
 {
-    int location = glGetUniformLocation(m_program, name.c_str());
-    glUniform1i(location, i);
+    setUniformValue(u, &i);
 }
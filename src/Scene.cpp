@@ -23,10 +23,14 @@
 
 #include <cmath>
 #include <sstream>
+#include <algorithm>
 #include "Scene.h"
+#include "AnimationCache.h"
 #include "Dragon.h"
 #include "Mesh.h"
 #include "Material.h"
+#include "RenderStateCapture.h"
+#include "Platform.h"
 
 static Material debugMaterial(vec4(0.2, 0.2, 0.2, 1.0),
     vec4(1.0, 4.0/6.0, 0.0, 1.0), vec4(0.2, 0.2, 0.2, 1.0), 20.0);
@@ -36,12 +40,61 @@ static Material floorMaterial(vec4(0.5, 0.5, 0.5, 1.0),
 
 static double currentTime();
 
+// Time during which the status of the last export stays visible, in seconds.
+#define EXPORT_STATUS_TIME 3.0
+
+// Exports an item from a copy of the scene, which is drawn with a capture state.
+class SceneExportTask : public Task
+{
+public:
+    SceneExportTask(Scene *scene, Scene::Item item, string path)
+    {
+        m_scene = scene;
+        m_item = item;
+        m_path = path;
+        m_exported = false;
+    }
+
+    virtual ~SceneExportTask()
+    {
+        delete m_scene;
+    }
+
+    virtual void run()
+    {
+        m_exported = m_scene->exportItem(m_item, m_path);
+    }
+
+    string path() const
+    {
+        return m_path;
+    }
+
+    bool exported() const
+    {
+        return m_exported;
+    }
+
+private:
+    Scene *m_scene;
+    Scene::Item m_item;
+    string m_path;
+    bool m_exported;
+};
+
 Scene::Scene(RenderState *state) : StateObject(state)
 {
     m_camera = Camera_Static;
     m_exportQueued = false;
+    m_exportPool = 0;
+    m_exportState = 0;
+    m_exportFinished = 0.0;
     m_sigma = 1.0;
     m_loaded = false;
+    m_floorMesh = meshHandle("floor");
+    m_letterPMesh = meshHandle("letter_p");
+    m_letterAMesh = meshHandle("letter_a");
+    m_letterSMesh = meshHandle("letter_s");
 
     m_debugDragon = new Dragon(Dragon::Floating, m_state);
     m_debugDragon->scalesMaterial() = debugMaterial;
@@ -53,8 +106,47 @@ Scene::Scene(RenderState *state) : StateObject(state)
     animate();
 }
 
+Scene::Scene(const Scene &source, RenderState *state) : StateObject(state)
+{
+    m_started = source.m_started;
+    m_selected = source.m_selected;
+    m_detailLevel = source.m_detailLevel;
+    m_delta = source.m_delta;
+    m_theta = source.m_theta;
+    m_sigma = source.m_sigma;
+    m_camera = source.m_camera;
+    m_thetaCamera = source.m_thetaCamera;
+    m_exportQueued = false;
+    m_exportPool = 0;
+    m_exportState = 0;
+    m_exportFinished = 0.0;
+    m_loaded = source.m_loaded;
+    // the assets were copied to the state along with the names of the handles
+    m_floorMesh = source.m_floorMesh;
+    m_letterPMesh = source.m_letterPMesh;
+    m_letterAMesh = source.m_letterAMesh;
+    m_letterSMesh = source.m_letterSMesh;
+
+    // the dragons are copied with their animation parameters
+    m_debugDragon = new Dragon(*source.m_debugDragon);
+    m_debugDragon->setState(state);
+    for(uint32_t i = 0; i < source.m_dragons.size(); i++)
+    {
+        Dragon *d = new Dragon(*source.m_dragons[i]);
+        d->setState(state);
+        m_dragons.push_back(d);
+    }
+}
+
 Scene::~Scene()
 {
+    if(m_exportPool)
+    {
+        while(Task *task = m_exportPool->waitForNext())
+            delete task;
+        delete m_exportPool;
+    }
+    delete m_exportState;
     delete m_debugDragon;
     vector<Dragon *>::iterator it;
     for(it = m_dragons.begin(); it != m_dragons.end(); it++)
@@ -66,24 +158,33 @@ void Scene::init()
 {
     if(m_dragons.size() < 3)
         return;
-    m_state->loadMeshFromFile("floor", "meshes/floor.obj");
-    m_state->loadMeshFromFile("letter_p", "meshes/LETTER_P.obj");
-    m_state->loadMeshFromFile("letter_a", "meshes/LETTER_A.obj");
-    m_state->loadMeshFromFile("letter_s", "meshes/LETTER_S.obj");
-    m_state->loadMeshFromFile("wing_membrane", "meshes/dragon_wing_membrane.obj");
-    m_state->loadMeshFromFile("joint", "meshes/dragon_joint_spin.obj");
-    m_state->loadMeshFromFile("dragon_chest", "meshes/dragon_chest.obj");
-    m_state->loadMeshFromFile("dragon_head", "meshes/dragon_head.obj");
-    m_state->loadMeshFromFile("dragon_tail_end", "meshes/dragon_tail_end.obj");
-    m_state->loadTextureFromFile("lava_green", "textures/lava_green.tiff", true);
-    m_state->loadTextureFromFile("scale_gold", "textures/scale_gold.tiff");
-    m_state->loadTextureFromFile("scale_green", "textures/scale_green.tiff");
-    m_state->loadTextureFromFile("scale_black", "textures/scale_black.tiff");
-    m_state->loadTextureFromFile("scale_bronze", "textures/scale_bronze.tiff");
+    m_state->queueMeshFromFile("floor", "meshes/floor.obj");
+    m_state->queueMeshFromFile("letter_p", "meshes/LETTER_P.obj");
+    m_state->queueMeshFromFile("letter_a", "meshes/LETTER_A.obj");
+    m_state->queueMeshFromFile("letter_s", "meshes/LETTER_S.obj");
+    m_state->queueMeshFromFile("wing_membrane", "meshes/dragon_wing_membrane.obj");
+    m_state->queueMeshFromFile("joint", "meshes/dragon_joint_spin.obj");
+    m_state->queueMeshFromFile("dragon_chest", "meshes/dragon_chest.obj");
+    m_state->queueMeshFromFile("dragon_head", "meshes/dragon_head.obj");
+    m_state->queueMeshFromFile("dragon_tail_end", "meshes/dragon_tail_end.obj");
+    m_state->queueTextureFromFile("lava_green", "textures/lava_green.tiff", true);
+    m_state->queueTextureFromFile("scale_gold", "textures/scale_gold.tiff");
+    m_state->queueTextureFromFile("scale_green", "textures/scale_green.tiff");
+    m_state->queueTextureFromFile("scale_black", "textures/scale_black.tiff");
+    m_state->queueTextureFromFile("scale_bronze", "textures/scale_bronze.tiff");
+    m_state->loadQueuedAssets();
     if(m_state->meshes().size() == 0)
         return;
     m_loaded = true;
 
+    // halve the size of the vertex buffers where the renderer supports it
+    map<string, Mesh *>::iterator it;
+    for(it = m_state->meshes().begin(); it != m_state->meshes().end(); it++)
+    {
+        for(int i = 0; i < it->second->lodCount(); i++)
+            it->second->lod(i)->setVertexFormat(VertexPacker::Packed16);
+    }
+
     m_dragons[0]->scalesMaterial().setTexture(m_state->texture("scale_green"));
     m_dragons[0]->wingMaterial().setTexture(m_state->texture("scale_green"));
     m_dragons[1]->scalesMaterial().setTexture(m_state->texture("scale_black"));
@@ -133,11 +234,13 @@ void Scene::draw()
     m_state->scale(m_sigma, m_sigma, m_sigma);
 
     drawItem(i);
-    if(m_exportQueued)
+    finishExport();
+    // only one item is exported at a time, later requests wait for it to finish
+    if(m_exportQueued && (!m_exportPool || (m_exportPool->pendingCount() == 0)))
     {
         stringstream ss;
-        ss << "meshes/" << itemText(i) << ".obj";
-        exportItem(i, ss.str());
+        ss << "meshes/" << itemText(i) << m_exportExtension;
+        startExport(i, ss.str());
         m_exportQueued = false;
     }
 }
@@ -155,13 +258,13 @@ void Scene::drawItem(Scene::Item item)
         switch(item)
         {
         case LETTER_P:
-            drawMesh("letter_p");
+            drawMesh(m_letterPMesh);
             break;
         case LETTER_A:
-            drawMesh("letter_a");
+            drawMesh(m_letterAMesh);
             break;
         case LETTER_S:
-            drawMesh("letter_s");
+            drawMesh(m_letterSMesh);
             break;
         case DRAGON:
             m_debugDragon->draw();
@@ -214,16 +317,76 @@ void Scene::drawItem(Scene::Item item)
     popMatrix();
 }
 
-void Scene::exportItem(Item item, string path)
+bool Scene::exportItem(Item item, string path)
 {
     m_state->beginExportMesh(path);
     drawItem(item);
-    m_state->endExportMesh();
+    return m_state->endExportMesh();
 }
 
-void Scene::exportCurrentItem()
+bool Scene::exportAnimation(Item item, string path, const vector<double> &times)
+{
+    AnimationCacheWriter writer;
+    bool written = writer.open(path);
+    for(uint32_t i = 0; written && (i < times.size()); i++)
+    {
+        animate(times[i]);
+        Mesh *m = captureItem(item);
+        written = writer.addFrame((float)times[i], m);
+        delete m;
+    }
+    return writer.close() && written;
+}
+
+Mesh * Scene::captureItem(Item item)
+{
+    m_state->beginCaptureMesh();
+    drawItem(item);
+    return m_state->endCaptureMesh();
+}
+
+void Scene::exportCurrentItem(string extension)
 {
     m_exportQueued = true;
+    m_exportExtension = extension;
+}
+
+void Scene::startExport(Item item, string path)
+{
+    if(!m_exportPool)
+    {
+        // meshes do not change once loaded, the capture state can keep its copy
+        m_exportPool = new TaskPool(1);
+        m_exportState = new RenderStateCapture();
+        m_state->copyAssetsTo(m_exportState);
+    }
+    m_exportStatus = "Exporting " + path;
+    m_exportPool->start(new SceneExportTask(new Scene(*this, m_exportState), item, path));
+}
+
+void Scene::finishExport()
+{
+    if(!m_exportPool)
+        return;
+    while(Task *task = m_exportPool->nextFinished())
+    {
+        SceneExportTask *exportTask = (SceneExportTask *)task;
+        if(exportTask->exported())
+            m_exportStatus = "Exported " + exportTask->path();
+        else
+            m_exportStatus = "Export failed: " + exportTask->path();
+        m_exportFinished = currentTime();
+        delete exportTask;
+    }
+}
+
+string Scene::exportStatus() const
+{
+    if(m_exportPool && (m_exportPool->pendingCount() > 0))
+        return m_exportStatus;
+    else if((m_exportFinished > 0.0) && ((currentTime() - m_exportFinished) < EXPORT_STATUS_TIME))
+        return m_exportStatus;
+    return string();
 }
 
 string Scene::itemText(Scene::Item item)
@@ -310,7 +473,7 @@ void Scene::drawScene()
 void Scene::drawFloor()
 {
     pushMaterial(floorMaterial);
-    drawMesh("floor");
+    drawMesh(m_floorMesh);
     popMaterial();
 }
 
@@ -327,7 +490,7 @@ void Scene::drawDragonHoldingA(Dragon *d)
             rotate(-d->frontLegsAngle(), 0.0, 0.0, 1.0);
             scale(2.0/3.0, 2.0/3.0, 1.0/3.0);
             pushMaterial(d->tongueMaterial());
-            drawMesh("letter_a");
+            drawMesh(m_letterAMesh);
             popMaterial();
         popMatrix();
     popMatrix();
@@ -344,7 +507,7 @@ void Scene::drawDragonHoldingP(Dragon *d)
             rotate(-170, 0.0, 0.0, 1.0);
             scale(1.0, 1.0, 0.5);
             pushMaterial(d->tongueMaterial());
-            drawMesh("letter_p");
+            drawMesh(m_letterPMesh);
             popMaterial();
         popMatrix();
     popMatrix();
@@ -361,7 +524,7 @@ void Scene::drawDragonHoldingS(Dragon *d)
             translate(-0.4, 0.1, 0.0);
             scale(1.0, 1.0, 0.5);
             pushMaterial(d->tongueMaterial());
-            drawMesh("letter_s");
+            drawMesh(m_letterSMesh);
             popMaterial();
         popMatrix();
     popMatrix();
@@ -404,9 +567,23 @@ void Scene::setCamera(Scene::Camera c)
     m_camera = c;
 }
 
+int Scene::detailLevel() const
+{
+    return m_detailLevel;
+}
+
+void Scene::setDetailLevel(int level)
+{
+    m_detailLevel = max(1, min(level, 4));
+}
+
 void Scene::animate()
 {
-    double t = currentTime() - m_started;
+    animate(currentTime() - m_started);
+}
+
+void Scene::animate(double t)
+{
     double angle = fmod(t * 45.0, 360.0);
 
     // hovering dragon
@@ -82,6 +82,9 @@ void SceneViewport::paintEvent(QPaintEvent *)
     m_frames++;
     if(m_fpsTimer->isActive())
         paintFPS(&painter, m_lastFPS);
+    string status = m_scene->exportStatus();
+    if(!status.empty())
+        paintStatus(&painter, QString::fromLatin1(status.c_str()));
 }
 
 void SceneViewport::paintGL()
@@ -136,6 +139,15 @@ void SceneViewport::paintFPS(QPainter *p, float fps)
     p->drawText(QRectF(QPointF(10, 5), QSizeF(100, 100)), text);
 }
 
+void SceneViewport::paintStatus(QPainter *p, QString text)
+{
+    QFont f;
+    f.setPointSizeF(12.0);
+    p->setFont(f);
+    p->setPen(QPen(Qt::white));
+    p->drawText(QRectF(QPointF(10, height() - 30), QSizeF(width() - 20, 25)), text);
+}
+
 void SceneViewport::updateAnimationState()
 {
     if(m_animate)
@@ -194,12 +206,18 @@ void SceneViewport::keyReleaseEvent(QKeyEvent *e)
         m_scene->setCamera(Scene::Camera_Jumping);
     else if(key == Qt::Key_S)
         m_scene->exportCurrentItem();
+    else if(key == Qt::Key_G)
+        m_scene->exportCurrentItem(".glb");
     else if(key == Qt::Key_Z)
         m_state->toggleWireframe();
     else if(key == Qt::Key_P)
         m_state->toggleProjection();
     else if(key == Qt::Key_Space)
         toggleAnimation();
+    else if(key == Qt::Key_Up)
+        m_scene->setDetailLevel(m_scene->detailLevel() + 1);
+    else if(key == Qt::Key_Down)
+        m_scene->setDetailLevel(m_scene->detailLevel() - 1);
     QGLWidget::keyReleaseEvent(e);
     update();
 }
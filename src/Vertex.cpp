@@ -22,10 +22,15 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cstring>
+#include <cstddef>
 #include "Vertex.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -34,6 +39,68 @@ bool fequal(double a, double b)
     return fabs(a - b) < 1e-16;
 }
 
+#ifdef __SSE__
+// Load four vec3 stride bytes apart as vectors of x, y and z coordinates. None
+// of them can be the last vec3 of the array: each is read with a 16-byte load
+// that ends within the next one.
+static inline void loadVec3x4(const char *p, uint32_t stride, __m128 &x, __m128 &y, __m128 &z)
+{
+    __m128 a = _mm_loadu_ps((const float *)p);
+    __m128 b = _mm_loadu_ps((const float *)(p + stride));
+    __m128 c = _mm_loadu_ps((const float *)(p + 2 * stride));
+    __m128 d = _mm_loadu_ps((const float *)(p + 3 * stride));
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    x = a;
+    y = b;
+    z = c;
+}
+
+// Store the x, y and z lanes of v, leaving the bytes after the vec3 alone.
+static inline void storeVec3(char *p, __m128 v)
+{
+    _mm_storel_pi((__m64 *)p, v);
+    _mm_store_ss((float *)p + 2, _mm_movehl_ps(v, v));
+}
+
+static inline void storeVec3x4(char *p, uint32_t stride, __m128 x, __m128 y, __m128 z)
+{
+    __m128 w = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    storeVec3(p, x);
+    storeVec3(p + stride, y);
+    storeVec3(p + 2 * stride, z);
+    storeVec3(p + 3 * stride, w);
+}
+
+// Matrix elements broadcast to every lane, to transform four elements at once.
+// Broadcasting them before the loop also tells the compiler that the output
+// does not overwrite them.
+typedef struct
+{
+    __m128 e[16];
+} MatrixLanes;
+
+static inline void broadcastMatrix(const float *d, MatrixLanes &m)
+{
+    for(int k = 0; k < 16; k++)
+        m.e[k] = _mm_set1_ps(d[k]);
+}
+
+// Row r of the matrix applied to four points.
+static inline __m128 mapRow4(const MatrixLanes &m, int r, __m128 x, __m128 y, __m128 z)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(m.e[r], x), _mm_mul_ps(m.e[4 + r], y)),
+                      _mm_add_ps(_mm_mul_ps(m.e[8 + r], z), m.e[12 + r]));
+}
+
+// Row r of the upper 3x3 matrix applied to four normals.
+static inline __m128 mapNormalRow4(const MatrixLanes &m, int r, __m128 x, __m128 y, __m128 z)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(m.e[r], x), _mm_mul_ps(m.e[4 + r], y)),
+                      _mm_mul_ps(m.e[8 + r], z));
+}
+#endif
+
 vec3 vec3::normal(const vec3 &a, const vec3 &b, const vec3 &c)
 {
     // calculate the cross-product of AB and AC
@@ -50,6 +117,78 @@ vec3 vec3::normal(const vec3 &a, const vec3 &b, const vec3 &c)
     return n;
 }
 
+void vec3::normals(const vec3 *a, const vec3 *b, const vec3 *c, uint32_t stride,
+                   vec3 *out, uint32_t outStride, uint32_t count)
+{
+    const char *pa = (const char *)a, *pb = (const char *)b, *pc = (const char *)c;
+    char *po = (char *)out;
+    uint32_t i = 0;
+#ifdef __SSE__
+    // four triangles at a time, with the same operations as normal()
+    for(; (i + 4) < count; i += 4)
+    {
+        size_t offset = (size_t)i * stride;
+        __m128 ax, ay, az, bx, by, bz, cx, cy, cz;
+        loadVec3x4(pa + offset, stride, ax, ay, az);
+        loadVec3x4(pb + offset, stride, bx, by, bz);
+        loadVec3x4(pc + offset, stride, cx, cy, cz);
+        __m128 ux = _mm_sub_ps(bx, ax), uy = _mm_sub_ps(by, ay), uz = _mm_sub_ps(bz, az);
+        __m128 vx = _mm_sub_ps(cx, ax), vy = _mm_sub_ps(cy, ay), vz = _mm_sub_ps(cz, az);
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+        __m128 w = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                          _mm_mul_ps(nz, nz)));
+        storeVec3x4(po + (size_t)i * outStride, outStride,
+                    _mm_div_ps(nx, w), _mm_div_ps(ny, w), _mm_div_ps(nz, w));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        size_t offset = (size_t)i * stride;
+        *(vec3 *)(po + (size_t)i * outStride) = normal(*(const vec3 *)(pa + offset),
+            *(const vec3 *)(pb + offset), *(const vec3 *)(pc + offset));
+    }
+}
+
+bool vec3::bounds(const vec3 *points, uint32_t stride, uint32_t count,
+                  vec3 &minPos, vec3 &maxPos)
+{
+    if(count == 0)
+        return false;
+    const char *p = (const char *)points;
+#ifdef __SSE__
+    // start from the last point so that the other ones can be read 16 bytes at
+    // a time, the fourth lane is ignored
+    const vec3 &last = *(const vec3 *)(p + (size_t)(count - 1) * stride);
+    __m128 lo = _mm_setr_ps(last.x, last.y, last.z, 0.0f), hi = lo;
+    for(uint32_t i = 0; (i + 1) < count; i++)
+    {
+        __m128 v = _mm_loadu_ps((const float *)(p + (size_t)i * stride));
+        lo = _mm_min_ps(v, lo);
+        hi = _mm_max_ps(v, hi);
+    }
+    float r[4];
+    _mm_storeu_ps(r, lo);
+    minPos = vec3(r[0], r[1], r[2]);
+    _mm_storeu_ps(r, hi);
+    maxPos = vec3(r[0], r[1], r[2]);
+#else
+    minPos = maxPos = *(const vec3 *)p;
+    for(uint32_t i = 1; i < count; i++)
+    {
+        const vec3 &v = *(const vec3 *)(p + (size_t)i * stride);
+        minPos.x = min(minPos.x, v.x);
+        minPos.y = min(minPos.y, v.y);
+        minPos.z = min(minPos.z, v.z);
+        maxPos.x = max(maxPos.x, v.x);
+        maxPos.y = max(maxPos.y, v.y);
+        maxPos.z = max(maxPos.z, v.z);
+    }
+#endif
+    return true;
+}
+
 vec3 operator+(const vec3 &a, const vec3 &b)
 {
     vec3 u;
@@ -70,29 +209,251 @@ vec3 operator-(const vec3 &a, const vec3 &b)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Column of a * b for the column v of b. Both versions add the terms in pairs
+// and give the same results, out can be a column of a.
+static inline void mulColumnScalar(const float *a, const float *v, float *out)
+{
+    for(int r = 0; r < 4; r++)
+        out[r] = (a[r] * v[0] + a[4 + r] * v[1]) + (a[8 + r] * v[2] + a[12 + r] * v[3]);
+}
+
+#ifdef __SSE__
+static inline void mulColumnSSE(const float *a, const float *v, float *out)
+{
+    __m128 col = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(v[0])),
+                                       _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_set1_ps(v[1]))),
+                            _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + 8), _mm_set1_ps(v[2])),
+                                       _mm_mul_ps(_mm_loadu_ps(a + 12), _mm_set1_ps(v[3]))));
+    _mm_storeu_ps(out, col);
+}
+#endif
+
+// operator* and the in-place products share it so that they add the terms in
+// the same order. Compilers vectorize the scalar loop about as well as the SSE
+// version (compare them with 'DragonBench matrix').
+static inline void mulColumn(const float *a, const float *v, float *out)
+{
+    mulColumnScalar(a, v, out);
+}
+
+static void rotationAngle(float angle, float &c, float &s)
+{
+    float theta = angle / 180.0 * M_PI;
+    c = cos(theta);
+    s = sin(theta);
+}
+
+// Columns (axis + 1) % 3 and (axis + 2) % 3 of rotate() for a principal axis,
+// the only ones that differ from the identity.
+static void principalRotation(float angle, int axis, float sign, float *vi, float *vj)
+{
+    float c, s;
+    rotationAngle(angle, c, s);
+    s *= sign;
+    int i = (axis + 1) % 3, j = (axis + 2) % 3;
+    for(int r = 0; r < 4; r++)
+        vi[r] = vj[r] = 0.0f;
+    vi[i] = c;
+    vi[j] = s;
+    vj[i] = -s;
+    vj[j] = c;
+}
+
+// Index of the axis (0 to 2) if only one of its coordinates is non-zero and
+// is 1 or -1, -1 otherwise. sign is set to that coordinate.
+static int principalAxis(float x, float y, float z, float &sign)
+{
+    int axis = -1;
+    if((y == 0.0f) && (z == 0.0f) && (fabs(x) == 1.0f))
+        axis = 0, sign = x;
+    else if((x == 0.0f) && (z == 0.0f) && (fabs(y) == 1.0f))
+        axis = 1, sign = y;
+    else if((x == 0.0f) && (y == 0.0f) && (fabs(z) == 1.0f))
+        axis = 2, sign = z;
+    return axis;
+}
+
 matrix4::matrix4()
 {
     clear();
 }
 
+// Like OpenGL, matrices are stored column by column.
 vec3 matrix4::map(const vec3 &v) const
 {
-    float v_w = 1.0;
-    float x = d[0] * v.x + d[1] * v.y + d[2] * v.z + d[3] * v_w;
-    float y = d[4] * v.x + d[5] * v.y + d[6] * v.z + d[7] * v_w;
-    float z = d[8] * v.x + d[9] * v.y + d[10] * v.z + d[11] * v_w;
-    float w = d[12] * v.x + d[13] * v.y + d[14] * v.z + d[15] * v_w;
+#ifdef __SSE__
+    // the columns are scaled by the coordinates and summed, giving x, y, z and w
+    __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(d), _mm_set1_ps(v.x)),
+                                     _mm_mul_ps(_mm_loadu_ps(d + 4), _mm_set1_ps(v.y))),
+                          _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(d + 8), _mm_set1_ps(v.z)),
+                                     _mm_loadu_ps(d + 12)));
+    p = _mm_div_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+    float r[4];
+    _mm_storeu_ps(r, p);
+    return vec3(r[0], r[1], r[2]);
+#else
+    float x = (d[0] * v.x + d[4] * v.y) + (d[8] * v.z + d[12]);
+    float y = (d[1] * v.x + d[5] * v.y) + (d[9] * v.z + d[13]);
+    float z = (d[2] * v.x + d[6] * v.y) + (d[10] * v.z + d[14]);
+    float w = (d[3] * v.x + d[7] * v.y) + (d[11] * v.z + d[15]);
     return vec3(x / w, y / w, z / w);
+#endif
 }
 
 vec3 matrix4::mapNormal(const vec3 &v) const
 {
-    float v_w = 1.0;
-    float x = d[0] * v.x + d[1] * v.y + d[2] * v.z;
-    float y = d[4] * v.x + d[5] * v.y + d[6] * v.z;
-    float z = d[8] * v.x + d[9] * v.y + d[10] * v.z;
-    float w = d[12] * v.x + d[13] * v.y + d[14] * v.z + v_w;
-    return vec3(x / w, y / w, z / w);
+#ifdef __SSE__
+    __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(d), _mm_set1_ps(v.x)),
+                                     _mm_mul_ps(_mm_loadu_ps(d + 4), _mm_set1_ps(v.y))),
+                          _mm_mul_ps(_mm_loadu_ps(d + 8), _mm_set1_ps(v.z)));
+    float r[4];
+    _mm_storeu_ps(r, n);
+    float x = r[0], y = r[1], z = r[2];
+#else
+    float x = d[0] * v.x + d[4] * v.y + d[8] * v.z;
+    float y = d[1] * v.x + d[5] * v.y + d[9] * v.z;
+    float z = d[2] * v.x + d[6] * v.y + d[10] * v.z;
+#endif
+    float length = sqrt(x * x + y * y + z * z);
+    if(length > 0.0f)
+        return vec3(x / length, y / length, z / length);
+    return vec3(x, y, z);
+}
+
+matrix4 matrix4::normalMatrix() const
+{
+    // inverse of the upper 3x3 matrix, transposed: the cofactors over the determinant
+    float m00 = d[0], m10 = d[1], m20 = d[2];
+    float m01 = d[4], m11 = d[5], m21 = d[6];
+    float m02 = d[8], m12 = d[9], m22 = d[10];
+    float c00 = m11 * m22 - m12 * m21;
+    float c01 = m12 * m20 - m10 * m22;
+    float c02 = m10 * m21 - m11 * m20;
+    float det = m00 * c00 + m01 * c01 + m02 * c02;
+    matrix4 n;
+    if(det == 0.0f)
+        return n;
+    float inv = 1.0f / det;
+    n.d[0] = c00 * inv;
+    n.d[4] = c01 * inv;
+    n.d[8] = c02 * inv;
+    n.d[1] = (m02 * m21 - m01 * m22) * inv;
+    n.d[5] = (m00 * m22 - m02 * m20) * inv;
+    n.d[9] = (m01 * m20 - m00 * m21) * inv;
+    n.d[2] = (m01 * m12 - m02 * m11) * inv;
+    n.d[6] = (m02 * m10 - m00 * m12) * inv;
+    n.d[10] = (m00 * m11 - m01 * m10) * inv;
+    n.d[15] = 1.0f;
+    return n;
+}
+
+void matrix4::mapPoints(const vec3 *in, uint32_t inStride, vec3 *out, uint32_t outStride,
+                        uint32_t count) const
+{
+    const char *src = (const char *)in;
+    char *dst = (char *)out;
+    uint32_t i = 0;
+#ifdef __SSE__
+    // four points at a time, adding the terms in the same order as map()
+    // model-view matrices are usually affine and need no division by w
+    bool affine = (d[3] == 0.0f) && (d[7] == 0.0f) && (d[11] == 0.0f) && (d[15] == 1.0f);
+    MatrixLanes m;
+    broadcastMatrix(d, m);
+    for(; (i + 4) < count; i += 4)
+    {
+        __m128 x, y, z;
+        loadVec3x4(src + (size_t)i * inStride, inStride, x, y, z);
+        __m128 px = mapRow4(m, 0, x, y, z), py = mapRow4(m, 1, x, y, z);
+        __m128 pz = mapRow4(m, 2, x, y, z);
+        if(!affine)
+        {
+            __m128 w = mapRow4(m, 3, x, y, z);
+            px = _mm_div_ps(px, w);
+            py = _mm_div_ps(py, w);
+            pz = _mm_div_ps(pz, w);
+        }
+        storeVec3x4(dst + (size_t)i * outStride, outStride, px, py, pz);
+    }
+#endif
+    for(; i < count; i++)
+        *(vec3 *)(dst + (size_t)i * outStride) = map(*(const vec3 *)(src + (size_t)i * inStride));
+}
+
+void matrix4::mapNormals(const vec3 *in, uint32_t inStride, vec3 *out, uint32_t outStride,
+                         uint32_t count) const
+{
+    const char *src = (const char *)in;
+    char *dst = (char *)out;
+    uint32_t i = 0;
+#ifdef __SSE__
+    // four normals at a time, with the same operations as mapNormal()
+    MatrixLanes m;
+    broadcastMatrix(d, m);
+    for(; (i + 4) < count; i += 4)
+    {
+        __m128 x, y, z;
+        loadVec3x4(src + (size_t)i * inStride, inStride, x, y, z);
+        __m128 nx = mapNormalRow4(m, 0, x, y, z), ny = mapNormalRow4(m, 1, x, y, z);
+        __m128 nz = mapNormalRow4(m, 2, x, y, z);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                               _mm_mul_ps(nz, nz)));
+        // zero-length normals are left as they are
+        __m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+        nx = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(nx, length)), _mm_andnot_ps(valid, nx));
+        ny = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(ny, length)), _mm_andnot_ps(valid, ny));
+        nz = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(nz, length)), _mm_andnot_ps(valid, nz));
+        storeVec3x4(dst + (size_t)i * outStride, outStride, nx, ny, nz);
+    }
+#endif
+    for(; i < count; i++)
+    {
+        *(vec3 *)(dst + (size_t)i * outStride) =
+            mapNormal(*(const vec3 *)(src + (size_t)i * inStride));
+    }
+}
+
+void matrix4::mapVertices(const VertexData *vertices, VertexData *out, uint32_t count) const
+{
+    matrix4 n = normalMatrix();
+#ifdef __SSE__
+    // one vertex per iteration, with the four rows of the result in the lanes
+    __m128 c0 = _mm_loadu_ps(d), c1 = _mm_loadu_ps(d + 4);
+    __m128 c2 = _mm_loadu_ps(d + 8), c3 = _mm_loadu_ps(d + 12);
+    __m128 n0 = _mm_loadu_ps(n.d), n1 = _mm_loadu_ps(n.d + 4), n2 = _mm_loadu_ps(n.d + 8);
+    // model-view matrices are usually affine and need no division by w
+    bool affine = (d[3] == 0.0f) && (d[7] == 0.0f) && (d[11] == 0.0f) && (d[15] == 1.0f);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const VertexData &v = vertices[i];
+        vec2 texCoords = v.texCoords;
+        __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.position.x)),
+                                         _mm_mul_ps(c1, _mm_set1_ps(v.position.y))),
+                              _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.position.z)), c3));
+        if(!affine)
+            p = _mm_div_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+        __m128 m = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n0, _mm_set1_ps(v.normal.x)),
+                                         _mm_mul_ps(n1, _mm_set1_ps(v.normal.y))),
+                              _mm_mul_ps(n2, _mm_set1_ps(v.normal.z)));
+        __m128 dot = _mm_mul_ps(m, m);
+        dot = _mm_add_ss(_mm_add_ss(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(1, 1, 1, 1))),
+                         _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(2, 2, 2, 2)));
+        float length = _mm_cvtss_f32(_mm_sqrt_ss(dot));
+        if(length > 0.0f)
+            m = _mm_mul_ps(m, _mm_set1_ps(1.0f / length));
+        // each store spills into the next member, which is written afterwards
+        _mm_storeu_ps(&out[i].position.x, p);
+        _mm_storeu_ps(&out[i].normal.x, m);
+        out[i].texCoords = texCoords;
+    }
+#else
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const VertexData &v = vertices[i];
+        out[i].position = map(v.position);
+        out[i].normal = n.mapNormal(v.normal);
+        out[i].texCoords = v.texCoords;
+    }
+#endif
 }
 
 void matrix4::clear()
@@ -117,13 +478,65 @@ matrix4 matrix4::translate(float dx, float dy, float dz)
     return m;
 }
 
+void matrix4::translateBy(float dx, float dy, float dz)
+{
+    float v[4] = {dx, dy, dz, 1.0f};
+    mulColumn(d, v, d + 12);
+}
+
+void matrix4::rotateBy(float angle, float rx, float ry, float rz)
+{
+    // a rotation by zero degrees is the identity, even computed by rotate()
+    if(angle == 0.0f)
+        return;
+    float sign = 1.0f;
+    int axis = principalAxis(rx, ry, rz, sign);
+    if(axis < 0)
+    {
+        *this = *this * rotate(angle, rx, ry, rz);
+        return;
+    }
+    // only the columns i and j of rotate() differ from the identity
+    float vi[4], vj[4];
+    principalRotation(angle, axis, sign, vi, vj);
+    int i = (axis + 1) % 3, j = (axis + 2) % 3;
+    float ci[4];
+    mulColumn(d, vi, ci);
+    mulColumn(d, vj, d + j * 4);
+    memcpy(d + i * 4, ci, sizeof(ci));
+}
+
+void matrix4::scaleBy(float sx, float sy, float sz)
+{
+    // the zero terms are added too, they can change the sign of zero results
+    float v[4] = {sx, 0.0f, 0.0f, 0.0f};
+    float columns[12];
+    mulColumn(d, v, columns);
+    v[0] = 0.0f;
+    v[1] = sy;
+    mulColumn(d, v, columns + 4);
+    v[1] = 0.0f;
+    v[2] = sz;
+    mulColumn(d, v, columns + 8);
+    memcpy(d, columns, sizeof(columns));
+}
+
 matrix4 matrix4::rotate(float angle, float x, float y, float z)
 {
-    float theta = angle / 180.0 * M_PI;
-    float c = cos(theta);
-    float s = sin(theta);
-    float t = 1 - c;
+    float sign = 1.0f;
+    int axis = principalAxis(x, y, z, sign);
     matrix4 m;
+    if(axis >= 0)
+    {
+        // only the two other axes, taken in cyclic order, are rotated
+        m.setIdentity();
+        int i = (axis + 1) % 3, j = (axis + 2) % 3;
+        principalRotation(angle, axis, sign, m.d + i * 4, m.d + j * 4);
+        return m;
+    }
+    float c, s;
+    rotationAngle(angle, c, s);
+    float t = 1 - c;
     m.d[0] = t * x * x + c;
     m.d[4] = t * x * y - s * z;
     m.d[8] = t * x * z + s * y;
@@ -218,27 +631,32 @@ matrix4 matrix4::ortho(float left, float right, float bottom, float top, float n
 }
 
 matrix4 operator*(const matrix4 &a, const matrix4 &b)
+{
+    // every column of the product combines the columns of a, weighted by a column of b
+    matrix4 m;
+    for(int i = 0; i < 16; i += 4)
+        mulColumn(a.d, b.d + i, m.d + i);
+    return m;
+}
+
+matrix4 multiplyScalar(const matrix4 &a, const matrix4 &b)
 {
     matrix4 m;
-    m.d[0] = a.d[0] * b.d[0] + a.d[4] * b.d[1] + a.d[8] * b.d[2] + a.d[12] * b.d[3];
-    m.d[1] = a.d[1] * b.d[0] + a.d[5] * b.d[1] + a.d[9] * b.d[2] + a.d[13] * b.d[3];
-    m.d[2] = a.d[2] * b.d[0] + a.d[6] * b.d[1] + a.d[10] * b.d[2] + a.d[14] * b.d[3];
-    m.d[3] = a.d[3] * b.d[0] + a.d[7] * b.d[1] + a.d[11] * b.d[2] + a.d[15] * b.d[3];
-    m.d[4] = a.d[0] * b.d[4] + a.d[4] * b.d[5] + a.d[8] * b.d[6] + a.d[12] * b.d[7];
-    m.d[5] = a.d[1] * b.d[4] + a.d[5] * b.d[5] + a.d[9] * b.d[6] + a.d[13] * b.d[7];
-    m.d[6] = a.d[2] * b.d[4] + a.d[6] * b.d[5] + a.d[10] * b.d[6] + a.d[14] * b.d[7];
-    m.d[7] = a.d[3] * b.d[4] + a.d[7] * b.d[5] + a.d[11] * b.d[6] + a.d[15] * b.d[7];
-    m.d[8] = a.d[0] * b.d[8] + a.d[4] * b.d[9] + a.d[8] * b.d[10] + a.d[12] * b.d[11];
-    m.d[9] = a.d[1] * b.d[8] + a.d[5] * b.d[9] + a.d[9] * b.d[10] + a.d[13] * b.d[11];
-    m.d[10] = a.d[2] * b.d[8] + a.d[6] * b.d[9] + a.d[10] * b.d[10] + a.d[14] * b.d[11];
-    m.d[11] = a.d[3] * b.d[8] + a.d[7] * b.d[9] + a.d[11] * b.d[10] + a.d[15] * b.d[11];
-    m.d[12] = a.d[0] * b.d[12] + a.d[4] * b.d[13] + a.d[8] * b.d[14] + a.d[12] * b.d[15];
-    m.d[13] = a.d[1] * b.d[12] + a.d[5] * b.d[13] + a.d[9] * b.d[14] + a.d[13] * b.d[15];
-    m.d[14] = a.d[2] * b.d[12] + a.d[6] * b.d[13] + a.d[10] * b.d[14] + a.d[14] * b.d[15];
-    m.d[15] = a.d[3] * b.d[12] + a.d[7] * b.d[13] + a.d[11] * b.d[14] + a.d[15] * b.d[15];
+    for(int i = 0; i < 16; i += 4)
+        mulColumnScalar(a.d, b.d + i, m.d + i);
     return m;
 }
 
+#ifdef __SSE__
+matrix4 multiplySSE(const matrix4 &a, const matrix4 &b)
+{
+    matrix4 m;
+    for(int i = 0; i < 16; i += 4)
+        mulColumnSSE(a.d, b.d + i, m.d + i);
+    return m;
+}
+#endif
+
 void matrix4::dump() const
 {
     cout << d[0] << d[1] << d[2] << d[3] << endl;
@@ -249,13 +667,243 @@ void matrix4::dump() const
 
 ////////////////////////////////////////////////////////////////////////////////
 
-VertexGroup::VertexGroup(uint32_t mode, uint32_t count)
+// Dot product of a row and a vector, adding the terms like mulColumn() does for
+// the same row of a matrix4.
+static inline float dotRow(const float *row, float x, float y, float z, float w)
+{
+    return (row[0] * x + row[1] * y) + (row[2] * z + row[3] * w);
+}
+
+// Rows of a * b, where b is given by its upper three rows and its last row is
+// (0, 0, 0, 1). out can be a.
+static inline void mulRows(const float *a, const float *b, float *out)
+{
+#ifdef __SSE__
+    // every row of the product combines the rows of b, weighted by a row of a
+    __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for(int r = 0; r < 12; r += 4)
+    {
+        const float *row = a + r;
+        __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[0]), b0),
+                                         _mm_mul_ps(_mm_set1_ps(row[1]), b1)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[2]), b2),
+                                         _mm_mul_ps(_mm_set1_ps(row[3]), b3)));
+        _mm_storeu_ps(out + r, p);
+    }
+#else
+    for(int r = 0; r < 12; r += 4)
+    {
+        float p[4];
+        for(int c = 0; c < 4; c++)
+            p[c] = dotRow(a + r, b[c], b[4 + c], b[8 + c], (c == 3) ? 1.0f : 0.0f);
+        memcpy(out + r, p, sizeof(p));
+    }
+#endif
+}
+
+affine3x4::affine3x4()
+{
+    clear();
+}
+
+affine3x4::affine3x4(const matrix4 &m)
+{
+#ifdef __SSE__
+    __m128 c0 = _mm_loadu_ps(m.d), c1 = _mm_loadu_ps(m.d + 4);
+    __m128 c2 = _mm_loadu_ps(m.d + 8), c3 = _mm_loadu_ps(m.d + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(d, c0);
+    _mm_storeu_ps(d + 4, c1);
+    _mm_storeu_ps(d + 8, c2);
+#else
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 4; c++)
+            d[r * 4 + c] = m.d[c * 4 + r];
+    }
+#endif
+}
+
+matrix4 affine3x4::toMatrix4() const
+{
+    matrix4 m;
+#ifdef __SSE__
+    __m128 r0 = _mm_loadu_ps(d), r1 = _mm_loadu_ps(d + 4), r2 = _mm_loadu_ps(d + 8);
+    __m128 r3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(m.d, r0);
+    _mm_storeu_ps(m.d + 4, r1);
+    _mm_storeu_ps(m.d + 8, r2);
+    _mm_storeu_ps(m.d + 12, r3);
+#else
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 4; c++)
+            m.d[c * 4 + r] = d[r * 4 + c];
+    }
+    m.d[15] = 1.0f;
+#endif
+    return m;
+}
+
+vec3 affine3x4::map(const vec3 &v) const
+{
+    return vec3(dotRow(d, v.x, v.y, v.z, 1.0f), dotRow(d + 4, v.x, v.y, v.z, 1.0f),
+                dotRow(d + 8, v.x, v.y, v.z, 1.0f));
+}
+
+vec3 affine3x4::mapNormal(const vec3 &v) const
+{
+    float x = d[0] * v.x + d[1] * v.y + d[2] * v.z;
+    float y = d[4] * v.x + d[5] * v.y + d[6] * v.z;
+    float z = d[8] * v.x + d[9] * v.y + d[10] * v.z;
+    float length = sqrt(x * x + y * y + z * z);
+    if(length > 0.0f)
+        return vec3(x / length, y / length, z / length);
+    return vec3(x, y, z);
+}
+
+affine3x4 affine3x4::inverse() const
+{
+    // the inverse of the upper 3x3 matrix is its adjugate over its determinant,
+    // the translation is then undone by the inverse
+    float m00 = d[0], m01 = d[1], m02 = d[2];
+    float m10 = d[4], m11 = d[5], m12 = d[6];
+    float m20 = d[8], m21 = d[9], m22 = d[10];
+    float c00 = m11 * m22 - m12 * m21;
+    float c01 = m12 * m20 - m10 * m22;
+    float c02 = m10 * m21 - m11 * m20;
+    float det = m00 * c00 + m01 * c01 + m02 * c02;
+    affine3x4 n;
+    if(det == 0.0f)
+        return n;
+    float inv = 1.0f / det;
+    n.d[0] = c00 * inv;
+    n.d[4] = c01 * inv;
+    n.d[8] = c02 * inv;
+    n.d[1] = (m02 * m21 - m01 * m22) * inv;
+    n.d[5] = (m00 * m22 - m02 * m20) * inv;
+    n.d[9] = (m01 * m20 - m00 * m21) * inv;
+    n.d[2] = (m01 * m12 - m02 * m11) * inv;
+    n.d[6] = (m02 * m10 - m00 * m12) * inv;
+    n.d[10] = (m00 * m11 - m01 * m10) * inv;
+    for(int r = 0; r < 3; r++)
+    {
+        const float *row = n.d + r * 4;
+        n.d[r * 4 + 3] = -(row[0] * d[3] + row[1] * d[7] + row[2] * d[11]);
+    }
+    return n;
+}
+
+affine3x4 affine3x4::normalMatrix() const
+{
+    // inverse of the upper 3x3 matrix, transposed
+    affine3x4 inv = inverse(), n;
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 3; c++)
+            n.d[r * 4 + c] = inv.d[c * 4 + r];
+    }
+    return n;
+}
+
+void affine3x4::clear()
+{
+    for(int i = 0; i < 12; i++)
+        d[i] = 0.0;
+}
+
+void affine3x4::setIdentity()
+{
+    clear();
+    d[0] = d[5] = d[10] = 1.0;
+}
+
+void affine3x4::translateBy(float dx, float dy, float dz)
+{
+    for(int r = 0; r < 12; r += 4)
+        d[r + 3] = dotRow(d + r, dx, dy, dz, 1.0f);
+}
+
+void affine3x4::rotateBy(float angle, float rx, float ry, float rz)
+{
+    if(angle == 0.0f)
+        return;
+    float sign = 1.0f;
+    int axis = principalAxis(rx, ry, rz, sign);
+    if(axis < 0)
+    {
+        *this = *this * affine3x4(matrix4::rotate(angle, rx, ry, rz));
+        return;
+    }
+    // the rows of the rotation, whose columns i and j are vi and vj
+    float vi[4], vj[4];
+    principalRotation(angle, axis, sign, vi, vj);
+    int i = (axis + 1) % 3, j = (axis + 2) % 3;
+    float rows[12] =
+    {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f
+    };
+    for(int r = 0; r < 3; r++)
+    {
+        rows[r * 4 + i] = vi[r];
+        rows[r * 4 + j] = vj[r];
+    }
+    // like matrix4::rotateBy(), only the columns i and j are replaced
+    float p[12];
+    mulRows(d, rows, p);
+    for(int r = 0; r < 12; r += 4)
+    {
+        d[r + i] = p[r + i];
+        d[r + j] = p[r + j];
+    }
+}
+
+void affine3x4::scaleBy(float sx, float sy, float sz)
+{
+    // the zero terms are added too, they can change the sign of zero results
+    float rows[12] =
+    {
+        sx, 0.0f, 0.0f, 0.0f,
+        0.0f, sy, 0.0f, 0.0f,
+        0.0f, 0.0f, sz, 0.0f
+    };
+    // like matrix4::scaleBy(), the translation is not replaced
+    float p[12];
+    mulRows(d, rows, p);
+    for(int r = 0; r < 12; r += 4)
+    {
+        d[r] = p[r];
+        d[r + 1] = p[r + 1];
+        d[r + 2] = p[r + 2];
+    }
+}
+
+affine3x4 operator*(const affine3x4 &a, const affine3x4 &b)
+{
+    affine3x4 m;
+    mulRows(a.d, b.d, m.d);
+    return m;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VertexGroup::VertexGroup(uint32_t mode, uint32_t count, uint32_t indexCount)
 {
     this->mode = mode;
     this->count = count;
     this->data = new VertexData[count];
+    this->indexCount = indexCount;
+    this->indices = (indexCount > 0) ? new uint32_t[indexCount] : 0;
     this->id = 0;
+    this->indexId = 0;
+    this->lod = 0;
     memset(this->data, 0, sizeof(VertexData) * count);
+    if(this->indices)
+        memset(this->indices, 0, sizeof(uint32_t) * indexCount);
 }
 
 VertexGroup::VertexGroup(uint32_t mode, const vector<VertexData> &data)
@@ -263,12 +911,132 @@ VertexGroup::VertexGroup(uint32_t mode, const vector<VertexData> &data)
     this->mode = mode;
     this->count = data.size();
     this->data = new VertexData[this->count];
+    this->indexCount = 0;
+    this->indices = 0;
     this->id = 0;
+    this->indexId = 0;
+    this->lod = 0;
     for(uint32_t i = 0; i < this->count; i++)
         this->data[i] = data[i];
 }
 
+VertexGroup::VertexGroup(uint32_t mode, vector<VertexData> *data)
+{
+    this->mode = mode;
+    this->count = data->size();
+    this->indexCount = 0;
+    this->indices = 0;
+    this->id = 0;
+    this->indexId = 0;
+    this->lod = 0;
+    m_storage.swap(*data);
+    this->data = m_storage.empty() ? new VertexData[0] : &m_storage[0];
+}
+
 VertexGroup::~VertexGroup()
 {
-    delete [] data;
+    if(m_storage.empty())
+        delete [] data;
+    delete [] indices;
+}
+
+void VertexGroup::setData(VertexData *data, uint32_t count)
+{
+    if(m_storage.empty())
+        delete [] this->data;
+    else
+        vector<VertexData>().swap(m_storage);
+    this->data = data;
+    this->count = count;
+}
+
+bool VertexGroup::bounds(vec3 &minPos, vec3 &maxPos) const
+{
+    return VertexGroupView(this).bounds(minPos, maxPos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VertexGroupView::VertexGroupView()
+{
+    mode = 0;
+    lod = 0;
+}
+
+VertexGroupView::VertexGroupView(const VertexGroup *vg)
+{
+    mode = vg->mode;
+    positions = StridedView<vec3>(&vg->data->position, vg->count, sizeof(VertexData));
+    normals = StridedView<vec3>(&vg->data->normal, vg->count, sizeof(VertexData));
+    texCoords = StridedView<vec2>(&vg->data->texCoords, vg->count, sizeof(VertexData));
+    if(vg->indices)
+        indices = IndexView(vg->indices, vg->indexCount);
+    lod = vg->lod;
+}
+
+VertexData VertexGroupView::vertex(uint32_t i) const
+{
+    VertexData v;
+    v.position = positions[i];
+    v.normal = normals.empty() ? vec3(0.0f, 0.0f, 0.0f) : normals[i];
+    v.texCoords = texCoords.empty() ? vec2(0.0f, 0.0f) : texCoords[i];
+    return v;
+}
+
+const VertexData * VertexGroupView::vertexData() const
+{
+    const char *base = (const char *)positions.data();
+    bool interleaved = (positions.stride() == sizeof(VertexData)) &&
+        (normals.size() == count()) && (normals.stride() == sizeof(VertexData)) &&
+        ((const char *)normals.data() == base + offsetof(VertexData, normal)) &&
+        (texCoords.size() == count()) && (texCoords.stride() == sizeof(VertexData)) &&
+        ((const char *)texCoords.data() == base + offsetof(VertexData, texCoords));
+    return interleaved ? (const VertexData *)base : 0;
+}
+
+bool VertexGroupView::copyTo(VertexGroup *vg) const
+{
+    if((count() > vg->count) || (indices.size() > vg->indexCount))
+        return false;
+    const VertexData *data = vertexData();
+    if(data)
+    {
+        memcpy(vg->data, data, count() * sizeof(VertexData));
+    }
+    else
+    {
+        for(uint32_t i = 0; i < count(); i++)
+            vg->data[i] = vertex(i);
+    }
+    if(indices.indexSize() == sizeof(uint32_t))
+    {
+        if(!indices.empty())
+            memcpy(vg->indices, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+    else
+    {
+        for(uint32_t i = 0; i < indices.size(); i++)
+            vg->indices[i] = indices[i];
+    }
+    return true;
+}
+
+bool VertexGroupView::bounds(vec3 &minPos, vec3 &maxPos) const
+{
+    return vec3::bounds(positions.data(), positions.stride(), positions.size(), minPos, maxPos);
+}
+
+void VertexArraySink::reserve(uint32_t count)
+{
+    m_vertices.reserve(count);
+}
+
+void VertexArraySink::addVertices(const VertexData *vertices, uint32_t count)
+{
+    m_vertices.insert(m_vertices.end(), vertices, vertices + count);
+}
+
+VertexGroup * VertexArraySink::createGroup(uint32_t mode)
+{
+    return new VertexGroup(mode, &m_vertices);
 }
@@ -0,0 +1,295 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "VertexPacker.h"
+
+using namespace std;
+
+typedef struct
+{
+    uint16_t position[4];
+    uint16_t normal[2];
+    uint16_t texCoords[2];
+} PackedVertex16;
+
+typedef struct
+{
+    uint16_t position[3];
+    uint8_t normal[2];
+    uint16_t texCoords[2];
+} PackedVertex12;
+
+uint32_t VertexPacker::vertexSize(Format format)
+{
+    switch(format)
+    {
+    case Packed16:
+        return sizeof(PackedVertex16);
+    case Packed12:
+        return sizeof(PackedVertex12);
+    default:
+        return sizeof(VertexData);
+    }
+}
+
+PackedRange VertexPacker::range(const VertexGroup *vg)
+{
+    PackedRange r;
+    vec3 minPos(0.0, 0.0, 0.0), maxPos(1.0, 1.0, 1.0);
+    vec2 minUV(0.0, 0.0), maxUV(1.0, 1.0);
+    if(vg->bounds(minPos, maxPos))
+    {
+        minUV = maxUV = vg->data[0].texCoords;
+        for(uint32_t i = 1; i < vg->count; i++)
+        {
+            const vec2 &t = vg->data[i].texCoords;
+            minUV.x = min(minUV.x, t.x);
+            minUV.y = min(minUV.y, t.y);
+            maxUV.x = max(maxUV.x, t.x);
+            maxUV.y = max(maxUV.y, t.y);
+        }
+    }
+    // flat axes still need a scale that can be divided by
+    r.positionOffset = minPos;
+    r.positionScale = vec3(max(maxPos.x - minPos.x, 1e-20f), max(maxPos.y - minPos.y, 1e-20f),
+                           max(maxPos.z - minPos.z, 1e-20f));
+    r.texCoordsOffset = minUV;
+    r.texCoordsScale = vec2(max(maxUV.x - minUV.x, 1e-20f), max(maxUV.y - minUV.y, 1e-20f));
+    return r;
+}
+
+static inline uint32_t quantize(float v, float offset, float scale, uint32_t levels)
+{
+    float q = (v - offset) / scale * levels + 0.5f;
+    return (uint32_t)min(max(q, 0.0f), (float)levels);
+}
+
+static inline float dequantize(uint32_t q, float offset, float scale, uint32_t levels)
+{
+    return (float)q / levels * scale + offset;
+}
+
+static vec3 octDecode(uint32_t qx, uint32_t qy, uint32_t levels)
+{
+    float x = (float)qx / levels * 2.0f - 1.0f;
+    float y = (float)qy / levels * 2.0f - 1.0f;
+    float z = 1.0f - fabs(x) - fabs(y);
+    if(z < 0.0f)
+    {
+        float ox = x;
+        x = (1.0f - fabs(y)) * ((ox >= 0.0f) ? 1.0f : -1.0f);
+        y = (1.0f - fabs(ox)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+    }
+    float length = sqrt(x * x + y * y + z * z);
+    return vec3(x / length, y / length, z / length);
+}
+
+// Map the normal to the octahedron, then unfold it onto a square.
+static void octProject(const vec3 &n, uint32_t levels, float &fx, float &fy)
+{
+    float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+    float x = 0.0f, y = 0.0f;
+    if(sum > 0.0f)
+    {
+        x = n.x / sum;
+        y = n.y / sum;
+        if(n.z < 0.0f)
+        {
+            float ox = x;
+            x = (1.0f - fabs(y)) * ((ox >= 0.0f) ? 1.0f : -1.0f);
+            y = (1.0f - fabs(ox)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+        }
+    }
+    fx = (x * 0.5f + 0.5f) * levels;
+    fy = (y * 0.5f + 0.5f) * levels;
+}
+
+// Of the four closest encodings, keep the one that decodes closest to the normal.
+static void octEncode(const vec3 &n, uint32_t levels, uint32_t &qx, uint32_t &qy)
+{
+    float fx, fy;
+    octProject(n, levels, fx, fy);
+    float bestDot = -2.0f;
+    qx = qy = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        uint32_t cx = (uint32_t)min(max((i & 1) ? ceil(fx) : floor(fx), 0.0f), (float)levels);
+        uint32_t cy = (uint32_t)min(max((i & 2) ? ceil(fy) : floor(fy), 0.0f), (float)levels);
+        vec3 d = octDecode(cx, cy, levels);
+        float dot = d.x * n.x + d.y * n.y + d.z * n.z;
+        if(dot > bestDot)
+        {
+            bestDot = dot;
+            qx = cx;
+            qy = cy;
+        }
+    }
+}
+
+void VertexPacker::pack(const VertexData *vertices, uint32_t count, Format format,
+                        const PackedRange &r, void *out)
+{
+    if(format == Float)
+    {
+        memcpy(out, vertices, count * sizeof(VertexData));
+        return;
+    }
+    uint32_t normalLevels = (format == Packed16) ? 0xffff : 0xff;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const VertexData &v = vertices[i];
+        uint16_t position[3], texCoords[2];
+        uint32_t nx, ny;
+        position[0] = quantize(v.position.x, r.positionOffset.x, r.positionScale.x, 0xffff);
+        position[1] = quantize(v.position.y, r.positionOffset.y, r.positionScale.y, 0xffff);
+        position[2] = quantize(v.position.z, r.positionOffset.z, r.positionScale.z, 0xffff);
+        texCoords[0] = quantize(v.texCoords.x, r.texCoordsOffset.x, r.texCoordsScale.x, 0xffff);
+        texCoords[1] = quantize(v.texCoords.y, r.texCoordsOffset.y, r.texCoordsScale.y, 0xffff);
+        octEncode(v.normal, normalLevels, nx, ny);
+        if(format == Packed16)
+        {
+            PackedVertex16 &p = ((PackedVertex16 *)out)[i];
+            memcpy(p.position, position, sizeof(position));
+            p.position[3] = 0;
+            p.normal[0] = (uint16_t)nx;
+            p.normal[1] = (uint16_t)ny;
+            memcpy(p.texCoords, texCoords, sizeof(texCoords));
+        }
+        else
+        {
+            PackedVertex12 &p = ((PackedVertex12 *)out)[i];
+            memcpy(p.position, position, sizeof(position));
+            p.normal[0] = (uint8_t)nx;
+            p.normal[1] = (uint8_t)ny;
+            memcpy(p.texCoords, texCoords, sizeof(texCoords));
+        }
+    }
+}
+
+void VertexPacker::unpack(const void *data, uint32_t count, Format format,
+                          const PackedRange &r, VertexData *out)
+{
+    if(format == Float)
+    {
+        memcpy(out, data, count * sizeof(VertexData));
+        return;
+    }
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const uint16_t *position, *texCoords;
+        uint32_t nx, ny, normalLevels;
+        if(format == Packed16)
+        {
+            const PackedVertex16 &p = ((const PackedVertex16 *)data)[i];
+            position = p.position;
+            texCoords = p.texCoords;
+            nx = p.normal[0];
+            ny = p.normal[1];
+            normalLevels = 0xffff;
+        }
+        else
+        {
+            const PackedVertex12 &p = ((const PackedVertex12 *)data)[i];
+            position = p.position;
+            texCoords = p.texCoords;
+            nx = p.normal[0];
+            ny = p.normal[1];
+            normalLevels = 0xff;
+        }
+        VertexData &v = out[i];
+        v.position.x = dequantize(position[0], r.positionOffset.x, r.positionScale.x, 0xffff);
+        v.position.y = dequantize(position[1], r.positionOffset.y, r.positionScale.y, 0xffff);
+        v.position.z = dequantize(position[2], r.positionOffset.z, r.positionScale.z, 0xffff);
+        v.normal = octDecode(nx, ny, normalLevels);
+        v.texCoords.x = dequantize(texCoords[0], r.texCoordsOffset.x, r.texCoordsScale.x, 0xffff);
+        v.texCoords.y = dequantize(texCoords[1], r.texCoordsOffset.y, r.texCoordsScale.y, 0xffff);
+    }
+}
+
+void VertexPacker::encodeNormals(const vec3 *normals, uint32_t count, uint16_t *out)
+{
+    // with 16 bits the closest encoding is rarely better than the rounded one
+    for(uint32_t i = 0; i < count; i++)
+    {
+        float fx, fy;
+        octProject(normals[i], 0xffff, fx, fy);
+        out[i * 2] = (uint16_t)min(max(fx + 0.5f, 0.0f), 65535.0f);
+        out[i * 2 + 1] = (uint16_t)min(max(fy + 0.5f, 0.0f), 65535.0f);
+    }
+}
+
+void VertexPacker::decodeNormals(const uint16_t *data, uint32_t count, vec3 *out)
+{
+    for(uint32_t i = 0; i < count; i++)
+        out[i] = octDecode(data[i * 2], data[i * 2 + 1], 0xffff);
+}
+
+PackingError VertexPacker::measureError(const VertexGroup *vg, Format format)
+{
+    PackingError e;
+    memset(&e, 0, sizeof(PackingError));
+    if(!vg || (vg->count == 0))
+        return e;
+    PackedRange r = range(vg);
+    vector<char> packed(vg->count * vertexSize(format));
+    vector<VertexData> decoded(vg->count);
+    pack(vg->data, vg->count, format, r, &packed[0]);
+    unpack(&packed[0], vg->count, format, r, &decoded[0]);
+
+    const vec3 &s = r.positionScale;
+    float diagonal = sqrt(s.x * s.x + s.y * s.y + s.z * s.z);
+    uint32_t normals = 0;
+    for(uint32_t i = 0; i < vg->count; i++)
+    {
+        const VertexData &a = vg->data[i];
+        const VertexData &b = decoded[i];
+        vec3 d = a.position - b.position;
+        float position = sqrt(d.x * d.x + d.y * d.y + d.z * d.z) / diagonal;
+        float texCoords = max(fabs(a.texCoords.x - b.texCoords.x), fabs(a.texCoords.y - b.texCoords.y));
+        e.maxPosition = max(e.maxPosition, position);
+        e.meanPosition += position;
+        e.maxTexCoords = max(e.maxTexCoords, texCoords);
+        e.meanTexCoords += texCoords;
+
+        // zero-length normals cannot be encoded, they do not count
+        const vec3 &n = a.normal;
+        float length = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        if(length > 0.0f)
+        {
+            float dot = (n.x * b.normal.x + n.y * b.normal.y + n.z * b.normal.z) / length;
+            float angle = acos(min(max(dot, -1.0f), 1.0f)) * 180.0f / M_PI;
+            e.maxNormalAngle = max(e.maxNormalAngle, angle);
+            e.meanNormalAngle += angle;
+            normals++;
+        }
+    }
+    e.meanPosition /= vg->count;
+    e.meanTexCoords /= vg->count;
+    if(normals > 0)
+        e.meanNormalAngle /= normals;
+    return e;
+}
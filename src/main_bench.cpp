@@ -0,0 +1,537 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+#include "Mesh.h"
+#include "Scene.h"
+#include "VertexPacker.h"
+#include "AnimationCache.h"
+#include "RenderStateCapture.h"
+#include "Platform.h"
+
+// Measures the CPU-side hot paths without a window or a GL context, e.g.:
+// DragonBench obj meshes/dragon_chest.obj meshes/LETTER_S.obj --synthetic 1000
+// DragonBench obj-threads --synthetic 1500 1 2 4 8
+// DragonBench matrix
+// DragonBench packing
+// DragonBench anim 600
+// Every benchmark is run several times and the fastest run is reported.
+
+#ifdef WIN32
+#include <windows.h>
+static double benchTime()
+{
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+}
+#else
+#include <sys/time.h>
+static double benchTime()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return (double)tv.tv_sec + ((double)tv.tv_usec * 1e-6);
+}
+#endif
+
+// Keeps the duration of the fastest run.
+class BenchTimer
+{
+public:
+    BenchTimer()
+    {
+        m_start = 0.0;
+        m_best = 0.0;
+        m_runs = 0;
+    }
+
+    void start()
+    {
+        m_start = benchTime();
+    }
+
+    void stop()
+    {
+        double elapsed = benchTime() - m_start;
+        if((m_runs == 0) || (elapsed < m_best))
+            m_best = elapsed;
+        m_runs++;
+    }
+
+    // Fastest run, in milliseconds.
+    double best() const
+    {
+        return m_best * 1000.0;
+    }
+
+private:
+    double m_start;
+    double m_best;
+    int m_runs;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    int vertexIndex;
+    int normalIndex;
+    int texCoordsIndex;
+} ScanfObjPoint;
+
+static bool parseScanfObjPoint(const char *data, ScanfObjPoint &p)
+{
+    p.vertexIndex = p.normalIndex = p.texCoordsIndex = 0;
+    if(sscanf(data, "%d/%d/%d", &p.vertexIndex, &p.texCoordsIndex, &p.normalIndex) == 3)
+        return true;
+    p.texCoordsIndex = 0;
+    if(sscanf(data, "%d//%d", &p.vertexIndex, &p.normalIndex) == 2)
+        return true;
+    if(sscanf(data, "%d/%d", &p.vertexIndex, &p.texCoordsIndex) == 2)
+        return true;
+    return sscanf(data, "%d", &p.vertexIndex) == 1;
+}
+
+template<class T>
+static T scanfObjValue(const vector<T> &data, int index, const T &missing)
+{
+    if((index < 1) || ((size_t)index > data.size()))
+        return missing;
+    else
+        return data[index - 1];
+}
+
+// The sscanf cascade Mesh::loadObj used before its tokenizer, as a baseline.
+static VertexGroup * loadObjScanf(const char *data, size_t size)
+{
+    const vec3 zero3(0.0, 0.0, 0.0);
+    const vec2 zero2(0.0, 0.0);
+    istringstream s(string(data, size));
+    char line[512];
+    char point1[32], point2[32], point3[32];
+    vector<vec3> vertices;
+    vector<vec3> normals;
+    vector<vec2> texCoords;
+    vector<VertexData> meshVertices;
+    ScanfObjPoint points[3];
+    while(s.getline(line, sizeof(line)))
+    {
+        float v1, v2, v3;
+        if(sscanf(line, "v %f %f %f", &v1, &v2, &v3) == 3)
+            vertices.push_back(vec3(v1, v2, v3));
+        else if(sscanf(line, "vn %f %f %f", &v1, &v2, &v3) == 3)
+            normals.push_back(vec3(v1, v2, v3));
+        else if(sscanf(line, "vt %f %f", &v1, &v2) == 2)
+            texCoords.push_back(vec2(v1, v2));
+        else if((sscanf(line, "f %31s %31s %31s", point1, point2, point3) == 3) &&
+            parseScanfObjPoint(point1, points[0]) && parseScanfObjPoint(point2, points[1]) &&
+            parseScanfObjPoint(point3, points[2]))
+        {
+            vec3 normal = zero3;
+            if(normals.empty())
+            {
+                normal = vec3::normal(scanfObjValue(vertices, points[0].vertexIndex, zero3),
+                                      scanfObjValue(vertices, points[1].vertexIndex, zero3),
+                                      scanfObjValue(vertices, points[2].vertexIndex, zero3));
+            }
+            for(int i = 0; i < 3; i++)
+            {
+                VertexData vd;
+                vd.position = scanfObjValue(vertices, points[i].vertexIndex, zero3);
+                vd.normal = normals.empty() ? normal : scanfObjValue(normals, points[i].normalIndex, zero3);
+                vd.texCoords = scanfObjValue(texCoords, points[i].texCoordsIndex, zero2);
+                meshVertices.push_back(vd);
+            }
+        }
+    }
+    return new VertexGroup(GL_TRIANGLES, meshVertices);
+}
+
+// Write an OBJ file for a side x side grid with positions, normals and texture
+// coordinates, which has 2 * (side - 1)^2 triangles.
+static void syntheticObj(uint32_t side, string &blob)
+{
+    ostringstream s;
+    s.setf(ios::fixed);
+    s.precision(6);
+    for(uint32_t j = 0; j < side; j++)
+    {
+        for(uint32_t i = 0; i < side; i++)
+            s << "v " << (float)i / side << " " << (float)j / side << " " << (float)((i * 7 + j * 13) % 101) * 0.001f << "\n";
+    }
+    for(uint32_t j = 0; j < side; j++)
+    {
+        for(uint32_t i = 0; i < side; i++)
+            s << "vt " << (float)i / side << " " << (float)j / side << "\n";
+    }
+    for(uint32_t j = 0; j < side; j++)
+    {
+        for(uint32_t i = 0; i < side; i++)
+            s << "vn 0.000000 0.000000 1.000000\n";
+    }
+    for(uint32_t j = 0; (j + 1) < side; j++)
+    {
+        for(uint32_t i = 0; (i + 1) < side; i++)
+        {
+            uint32_t a = j * side + i + 1, b = a + 1, c = a + side, d = c + 1;
+            s << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " " << d << "/" << d << "/" << d << "\n";
+            s << "f " << a << "/" << a << "/" << a << " " << d << "/" << d << "/" << d << " " << c << "/" << c << "/" << c << "\n";
+        }
+    }
+    blob = s.str();
+}
+
+// Compare the OBJ tokenizer against the sscanf parser it replaced, on one thread.
+static void benchObjParse(string name, const string &blob)
+{
+    int runs = (blob.size() < (1 << 20)) ? 20 : 3;
+    BenchTimer scanfTimer, tokenizerTimer;
+    uint32_t scanfCount = 0, tokenizerCount = 0;
+    for(int i = 0; i < runs; i++)
+    {
+        scanfTimer.start();
+        VertexGroup *vg = loadObjScanf(blob.data(), blob.size());
+        scanfTimer.stop();
+        scanfCount = vg->count;
+        delete vg;
+
+        tokenizerTimer.start();
+        vg = Mesh::loadObj(blob.data(), blob.size(), 1);
+        tokenizerTimer.stop();
+        tokenizerCount = vg ? vg->count : 0;
+        delete vg;
+    }
+    printf("%-28s %8.2f MB %9u tris   sscanf %9.2f ms   tokenizer %8.2f ms   %5.1fx%s\n",
+           name.c_str(), blob.size() / 1048576.0, tokenizerCount / 3,
+           scanfTimer.best(), tokenizerTimer.best(), scanfTimer.best() / tokenizerTimer.best(),
+           (scanfCount == tokenizerCount) ? "" : "   (vertex count differs)");
+}
+
+static int benchObj(const vector<string> &args)
+{
+    for(uint32_t i = 0; i < args.size(); i++)
+    {
+        string blob;
+        if((args[i] == "--synthetic") && ((i + 1) < args.size()))
+        {
+            uint32_t side = (uint32_t)atoi(args[++i].c_str());
+            if(side < 2)
+            {
+                fprintf(stderr, "Invalid grid size '%s'.\n", args[i].c_str());
+                return 1;
+            }
+            syntheticObj(side, blob);
+            benchObjParse("synthetic grid " + args[i], blob);
+        }
+        else if(loadFileBlob(args[i], blob))
+        {
+            size_t slash = args[i].find_last_of("/\\");
+            benchObjParse((slash == string::npos) ? args[i] : args[i].substr(slash + 1), blob);
+        }
+        else
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Parse one buffer on more and more threads, checking the result does not change.
+static int benchObjThreads(const vector<string> &args)
+{
+    string blob;
+    uint32_t side = 0;
+    if((args[0] == "--synthetic") && (args.size() > 1) && ((side = (uint32_t)atoi(args[1].c_str())) >= 2))
+        syntheticObj(side, blob);
+    else if(!loadFileBlob(args[0], blob))
+        return 1;
+    vector<int> threadCounts;
+    for(uint32_t i = (side > 0) ? 2 : 1; i < args.size(); i++)
+    {
+        int threads = atoi(args[i].c_str());
+        if(threads <= 0)
+        {
+            fprintf(stderr, "Invalid thread count '%s'.\n", args[i].c_str());
+            return 1;
+        }
+        threadCounts.push_back(threads);
+    }
+    if(threadCounts.empty())
+    {
+        static const int DEFAULT_THREAD_COUNTS[] = {1, 2, 4, 8, 16};
+        threadCounts.assign(DEFAULT_THREAD_COUNTS, DEFAULT_THREAD_COUNTS + 5);
+    }
+
+    VertexGroup *reference = Mesh::loadObj(blob.data(), blob.size(), 1);
+    if(!reference)
+        return 1;
+    printf("%.2f MB, %u triangles\n", blob.size() / 1048576.0, reference->count / 3);
+    double singleThread = 0.0;
+    for(uint32_t i = 0; i < threadCounts.size(); i++)
+    {
+        BenchTimer timer;
+        bool identical = true;
+        for(int j = 0; j < 3; j++)
+        {
+            timer.start();
+            VertexGroup *vg = Mesh::loadObj(blob.data(), blob.size(), threadCounts[i]);
+            timer.stop();
+            identical = identical && vg && (vg->count == reference->count) &&
+                (memcmp(vg->data, reference->data, vg->count * sizeof(VertexData)) == 0);
+            delete vg;
+        }
+        if(threadCounts[i] == 1)
+            singleThread = timer.best();
+        printf("%3d threads %9.2f ms %8.1f MB/s", threadCounts[i], timer.best(), blob.size() / 1048576.0 / timer.best() * 1000.0);
+        if(singleThread > 0.0)
+            printf("   %5.2fx", singleThread / timer.best());
+        printf("%s\n", identical ? "" : "   (result differs)");
+    }
+    delete reference;
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static volatile float matrixSink;
+
+// Time a chain of products, each depending on the previous one like the
+// products of a matrix stack, in nanoseconds per product.
+static double benchMultiply(matrix4 (*multiply)(const matrix4 &, const matrix4 &), matrix4 &result)
+{
+    static const int PRODUCTS = 10000000;
+    matrix4 step = matrix4::rotate(-12.0f, 1.0f, 0.0f, 0.0f);
+    BenchTimer timer;
+    for(int i = 0; i < 5; i++)
+    {
+        result = matrix4::rotate(30.0f, 0.0f, 0.6f, 0.8f) * matrix4::translate(1.0f, 2.0f, 3.0f);
+        timer.start();
+        for(int j = 0; j < PRODUCTS; j++)
+            result = multiply(result, step);
+        timer.stop();
+        matrixSink = result.d[0];
+    }
+    return timer.best() * 1e6 / PRODUCTS;
+}
+
+// Compare the matrix4 products, then time the matrix work of whole frames by
+// drawing the scene with a capture state, which does it on the CPU like
+// RenderStateGL2 but draws nothing.
+static int benchMatrix()
+{
+    matrix4 scalar, current;
+    printf("multiply   operator* %6.2f ns\n", benchMultiply(operator*, current));
+    printf("multiply   scalar    %6.2f ns\n", benchMultiply(multiplyScalar, scalar));
+#ifdef __SSE__
+    matrix4 sse;
+    double sseTime = benchMultiply(multiplySSE, sse);
+    printf("multiply   SSE       %6.2f ns%s\n", sseTime,
+           (memcmp(sse.d, scalar.d, sizeof(scalar.d)) == 0) ? "" : "   (result differs)");
+#endif
+
+    RenderStateCapture state;
+    Scene scene(&state);
+    scene.init();
+    if(!scene.isLoaded())
+    {
+        fprintf(stderr, "Could not load the mesh files (they should be in the 'meshes' sub-directory).\n");
+        return 1;
+    }
+    static const int FRAMES = 5000;
+    BenchTimer timer;
+    for(int i = 0; i < 10; i++)
+    {
+        timer.start();
+        for(int j = 0; j < FRAMES; j++)
+        {
+            scene.animate(j * 0.016);
+            scene.draw();
+        }
+        timer.stop();
+    }
+    printf("scene      frame     %6.2f us (animate and draw)\n", timer.best() * 1000.0 / FRAMES);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Report how far the packed vertex formats are from the original vertices,
+// once decoded like the vertex shader does.
+static int benchPacking(vector<string> args)
+{
+    if(args.empty())
+    {
+        QStringList files = QDir("meshes").entryList(QStringList() << "*.obj", QDir::Files, QDir::Name);
+        for(int i = 0; i < files.size(); i++)
+            args.push_back("meshes/" + files[i].toStdString());
+    }
+    if(args.empty())
+    {
+        fprintf(stderr, "Could not find the mesh files (they should be in the 'meshes' sub-directory).\n");
+        return 1;
+    }
+    printf("%-28s %8s %-9s %21s %21s %9s\n", "", "vertices", "format",
+           "position max / mean", "normal max / mean", "UV max");
+    static const VertexPacker::Format FORMATS[] = {VertexPacker::Packed16, VertexPacker::Packed12};
+    static const char *FORMAT_NAMES[] = {"Packed16", "Packed12"};
+    for(uint32_t i = 0; i < args.size(); i++)
+    {
+        VertexGroup *vg = Mesh::loadObj(args[i]);
+        if(!vg)
+            return 1;
+        size_t slash = args[i].find_last_of("/\\");
+        string name = (slash == string::npos) ? args[i] : args[i].substr(slash + 1);
+        for(int j = 0; j < 2; j++)
+        {
+            PackingError e = VertexPacker::measureError(vg, FORMATS[j]);
+            printf("%-28s %8u %-9s %10.2e %10.2e %8.4f %8.4f deg %9.2e\n",
+                   (j == 0) ? name.c_str() : "", vg->count, FORMAT_NAMES[j],
+                   e.maxPosition, e.meanPosition, e.maxNormalAngle, e.meanNormalAngle, e.maxTexCoords);
+        }
+        delete vg;
+    }
+    printf("Position errors are relative to the diagonal of the mesh bounds.\n");
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Export the scene to an animation cache, then time reading it back forwards,
+// which only decodes the differences, and backwards, which starts from the
+// closest key frame every time.
+static int benchAnimation(const vector<string> &args)
+{
+    uint32_t frames = args.empty() ? 300 : (uint32_t)atoi(args[0].c_str());
+    if(frames < 1)
+    {
+        fprintf(stderr, "Invalid frame count '%s'.\n", args[0].c_str());
+        return 1;
+    }
+    RenderStateCapture state;
+    Scene scene(&state);
+    scene.init();
+    if(!scene.isLoaded())
+    {
+        fprintf(stderr, "Could not load the mesh files (they should be in the 'meshes' sub-directory).\n");
+        return 1;
+    }
+    vector<double> times;
+    for(uint32_t i = 0; i < frames; i++)
+        times.push_back(i / 60.0);
+    string path = temporaryFilePath("DragonBench.anim");
+    BenchTimer exportTimer;
+    exportTimer.start();
+    bool exported = scene.exportAnimation(Scene::SCENE, path, times);
+    exportTimer.stop();
+    AnimationCacheReader reader;
+    if(!exported || !reader.open(path))
+    {
+        fprintf(stderr, "Could not export the animation to '%s'.\n", path.c_str());
+        remove(path.c_str());
+        return 1;
+    }
+
+    vector<VertexGroup *> groups;
+    reader.createGroups(groups);
+    uint32_t vertices = 0;
+    for(uint32_t i = 0; i < groups.size(); i++)
+        vertices += groups[i]->count;
+    BenchTimer forward, backward;
+    bool read = true;
+    for(int i = 0; i < 5; i++)
+    {
+        forward.start();
+        for(uint32_t j = 0; j < frames; j++)
+            read = reader.readFrame(j, groups) && read;
+        forward.stop();
+        backward.start();
+        for(uint32_t j = frames; j > 0; j--)
+            read = reader.readFrame(j - 1, groups) && read;
+        backward.stop();
+    }
+    for(uint32_t i = 0; i < groups.size(); i++)
+        delete groups[i];
+    reader.close();
+    remove(path.c_str());
+    if(!read)
+    {
+        fprintf(stderr, "Could not read the animation back.\n");
+        return 1;
+    }
+    printf("%u frames of %u vertices\n", frames, vertices);
+    printf("export     %8.3f ms per frame\n", exportTimer.best() / frames);
+    printf("forward    %8.3f ms per frame\n", forward.best() / frames);
+    printf("backward   %8.3f ms per frame\n", backward.best() / frames);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s BENCHMARK [arguments]\n", program);
+    fprintf(stderr, "  obj [FILE...] [--synthetic SIDE]\n");
+    fprintf(stderr, "      parse OBJ files with the tokenizer and with the sscanf parser it\n");
+    fprintf(stderr, "      replaced, --synthetic generates a SIDE x SIDE grid in memory\n");
+    fprintf(stderr, "  obj-threads FILE|--synthetic SIDE [THREADS...]\n");
+    fprintf(stderr, "      parse one OBJ file on each number of threads (default: 1 2 4 8 16)\n");
+    fprintf(stderr, "  matrix\n");
+    fprintf(stderr, "      time the matrix products, then the matrix work of a scene frame\n");
+    fprintf(stderr, "      (the mesh files should be in the 'meshes' sub-directory)\n");
+    fprintf(stderr, "  packing [FILE...]\n");
+    fprintf(stderr, "      decoding error of the packed vertex formats, for the given OBJ files\n");
+    fprintf(stderr, "      or every OBJ file in the 'meshes' sub-directory\n");
+    fprintf(stderr, "  anim [FRAMES]\n");
+    fprintf(stderr, "      export FRAMES frames of the scene to an animation cache (default: 300),\n");
+    fprintf(stderr, "      then time playing them forwards and backwards\n");
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    string benchmark = (argc > 1) ? argv[1] : "";
+    vector<string> args;
+    for(int i = 2; i < argc; i++)
+        args.push_back(argv[i]);
+    if((benchmark == "obj") && !args.empty())
+        return benchObj(args);
+    else if((benchmark == "obj-threads") && !args.empty())
+        return benchObjThreads(args);
+    else if(benchmark == "matrix")
+        return benchMatrix();
+    else if(benchmark == "packing")
+        return benchPacking(args);
+    else if(benchmark == "anim")
+        return benchAnimation(args);
+    printUsage(argv[0]);
+    return 1;
+}
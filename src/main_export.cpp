@@ -0,0 +1,312 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <QCoreApplication>
+#include <QDir>
+#include "Scene.h"
+#include "RenderStateCapture.h"
+#include "Platform.h"
+
+// Exports posed scene items without a window or a GL context, e.g.:
+// DragonExport --items SCENE,DRAGON_HEAD --times 0,0.5,2:4:0.25 --format glb --output poses
+// With the 'anim' format every item is recorded over all the times into one file.
+// Otherwise the files are named after the item and the index of the time, e.g. SCENE_0003.glb.
+
+class ExportJob
+{
+public:
+    Scene::Item item;
+    vector<double> times;
+    string path;
+    bool animation;
+};
+
+// Exports every n-th job with its own copy of the scene and its own state.
+class ExportWorker : public Task
+{
+public:
+    ExportWorker(const Scene *scene, const RenderState *assets,
+                 const vector<ExportJob> &jobs, uint32_t first, uint32_t step)
+        : m_jobs(jobs)
+    {
+        m_state = new RenderStateCapture();
+        assets->copyAssetsTo(m_state);
+        m_scene = new Scene(*scene, m_state);
+        m_first = first;
+        m_step = step;
+        m_exported = 0;
+    }
+
+    virtual ~ExportWorker()
+    {
+        delete m_scene;
+        delete m_state;
+    }
+
+    virtual void run()
+    {
+        for(uint32_t i = m_first; i < m_jobs.size(); i += m_step)
+        {
+            const ExportJob &job = m_jobs[i];
+            bool exported;
+            if(job.animation)
+            {
+                exported = m_scene->exportAnimation(job.item, job.path, job.times);
+            }
+            else
+            {
+                m_scene->animate(job.times[0]);
+                exported = m_scene->exportItem(job.item, job.path);
+            }
+            if(exported)
+                m_exported++;
+            else
+                fprintf(stderr, "Could not export '%s'.\n", job.path.c_str());
+        }
+    }
+
+    uint32_t exported() const
+    {
+        return m_exported;
+    }
+
+private:
+    const vector<ExportJob> &m_jobs;
+    RenderStateCapture *m_state;
+    Scene *m_scene;
+    uint32_t m_first;
+    uint32_t m_step;
+    uint32_t m_exported;
+};
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  --items NAME,...    items to export, or 'all' (default: SCENE)\n");
+    fprintf(stderr, "  --times T,...       animation times in seconds, each either a single time\n");
+    fprintf(stderr, "                      or START:END:STEP (default: 0)\n");
+    fprintf(stderr, "  --format obj|glb|anim  file format, 'anim' records each item over all\n");
+    fprintf(stderr, "                      the times in one animation cache (default: obj)\n");
+    fprintf(stderr, "  --detail LEVEL      level of detail of the dragons, 1 to 4 (default: 4)\n");
+    fprintf(stderr, "  --output DIR        directory to export to (default: export)\n");
+    fprintf(stderr, "  --threads N         number of threads, 0 for one per core (default: 0)\n");
+}
+
+static vector<string> splitList(string text)
+{
+    vector<string> parts;
+    stringstream ss(text);
+    string part;
+    while(getline(ss, part, ','))
+    {
+        if(!part.empty())
+            parts.push_back(part);
+    }
+    return parts;
+}
+
+static bool parseItems(string text, vector<Scene::Item> &items)
+{
+    vector<string> names = splitList(text);
+    for(uint32_t i = 0; i < names.size(); i++)
+    {
+        bool found = false;
+        for(int item = Scene::SCENE; item <= Scene::LAST; item++)
+        {
+            if((names[i] == "all") || (names[i] == Scene::itemText((Scene::Item)item)))
+            {
+                items.push_back((Scene::Item)item);
+                found = true;
+            }
+        }
+        if(!found)
+        {
+            fprintf(stderr, "Unknown item '%s'.\n", names[i].c_str());
+            return false;
+        }
+    }
+    return items.size() > 0;
+}
+
+static bool parseInt(string text, int minValue, int maxValue, int &value)
+{
+    const char *start = text.c_str();
+    char *end = 0;
+    long parsed = strtol(start, &end, 10);
+    if((end == start) || (*end != '\0') || (parsed < minValue) || (parsed > maxValue))
+    {
+        fprintf(stderr, "Invalid number '%s', it should be between %d and %d.\n",
+                text.c_str(), minValue, maxValue);
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+static bool parseTimes(string text, vector<double> &times)
+{
+    vector<string> parts = splitList(text);
+    for(uint32_t i = 0; i < parts.size(); i++)
+    {
+        double start = 0.0, end = 0.0, step = 0.0;
+        char extra;
+        if(sscanf(parts[i].c_str(), "%lf:%lf:%lf%c", &start, &end, &step, &extra) == 3)
+        {
+            if(step <= 0.0)
+            {
+                fprintf(stderr, "Invalid time step in '%s'.\n", parts[i].c_str());
+                return false;
+            }
+            // count the samples rather than adding up steps, which drifts
+            uint32_t count = (uint32_t)floor((end - start) / step + 1e-6) + 1;
+            for(uint32_t j = 0; j < count; j++)
+                times.push_back(start + j * step);
+        }
+        else if(sscanf(parts[i].c_str(), "%lf%c", &start, &extra) == 1)
+        {
+            times.push_back(start);
+        }
+        else
+        {
+            fprintf(stderr, "Invalid time '%s'.\n", parts[i].c_str());
+            return false;
+        }
+    }
+    return times.size() > 0;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    vector<Scene::Item> items;
+    vector<double> times;
+    string format = "obj";
+    string output = "export";
+    int detail = 4;
+    int threads = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1) < argc;
+        string value = hasValue ? argv[i + 1] : "";
+        bool valid = hasValue;
+        if(arg == "--items")
+            valid = valid && parseItems(value, items);
+        else if(arg == "--times")
+            valid = valid && parseTimes(value, times);
+        else if(arg == "--format")
+        {
+            format = value;
+            valid = valid && ((format == "obj") || (format == "glb") || (format == "anim"));
+        }
+        else if(arg == "--detail")
+            valid = valid && parseInt(value, 1, 4, detail);
+        else if(arg == "--output")
+            output = value;
+        else if(arg == "--threads")
+            valid = valid && parseInt(value, 0, 1024, threads);
+        else
+            valid = false;
+        if(!valid)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if(items.empty())
+        items.push_back(Scene::SCENE);
+    if(times.empty())
+        times.push_back(0.0);
+    if(!QDir().mkpath(QString::fromStdString(output)))
+    {
+        fprintf(stderr, "Could not create directory '%s'.\n", output.c_str());
+        return 1;
+    }
+
+    // the assets are loaded once then copied to the state of every worker
+    RenderStateCapture assets;
+    Scene scene(&assets);
+    scene.init();
+    if(!scene.isLoaded())
+    {
+        fprintf(stderr, "Could not load the mesh files (they should be in the 'meshes' sub-directory).\n");
+        return 1;
+    }
+    scene.setDetailLevel(detail);
+
+    vector<ExportJob> jobs;
+    if(format == "anim")
+    {
+        for(uint32_t j = 0; j < items.size(); j++)
+        {
+            ExportJob job;
+            job.item = items[j];
+            job.times = times;
+            job.path = output + "/" + Scene::itemText(items[j]) + ".anim";
+            job.animation = true;
+            jobs.push_back(job);
+        }
+    }
+    for(uint32_t i = 0; (format != "anim") && (i < times.size()); i++)
+    {
+        for(uint32_t j = 0; j < items.size(); j++)
+        {
+            // times that only differ after a few decimals must not share a file
+            char frame[16];
+            snprintf(frame, sizeof(frame), "%04u", i);
+            ExportJob job;
+            job.item = items[j];
+            job.times.push_back(times[i]);
+            job.path = output + "/" + Scene::itemText(items[j]) + "_" + frame + "." + format;
+            job.animation = false;
+            jobs.push_back(job);
+        }
+    }
+
+    TaskPool pool(threads);
+    uint32_t workers = min((uint32_t)pool.threadCount(), (uint32_t)jobs.size());
+    for(uint32_t i = 0; i < workers; i++)
+        pool.start(new ExportWorker(&scene, &assets, jobs, i, workers));
+    uint32_t exported = 0;
+    while(Task *task = pool.waitForNext())
+    {
+        ExportWorker *worker = (ExportWorker *)task;
+        exported += worker->exported();
+        delete worker;
+    }
+    printf("Exported %u files to '%s' on %u threads.\n", exported, output.c_str(), workers);
+    if(exported < jobs.size())
+    {
+        fprintf(stderr, "Could not export %u of %u files.\n",
+                (uint32_t)jobs.size() - exported, (uint32_t)jobs.size());
+        return 1;
+    }
+    return 0;
+}
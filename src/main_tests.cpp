@@ -0,0 +1,313 @@
+// Copyright (c) 2009-2015, Pierre-Andre Saulais <pasaulais@free.fr>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer. 
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <QCoreApplication>
+#include "Vertex.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "RenderStateCapture.h"
+#include "AnimationCache.h"
+#include "Platform.h"
+
+using namespace std;
+
+// DragonTests [transforms|animation]
+// Runs the given test, or all of them.
+
+static int failures = 0;
+static int checks = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks that the in-place transforms of matrix4 and affine3x4 give exactly the
+// same bits as multiplying by the matrices built by translate(), rotate() and
+// scale(). The base matrices are affine, so both can be compared to one product.
+
+static void checkSame(const char *what, const float *base, const float *inPlace,
+                      const float *product, int size)
+{
+    checks++;
+    if(memcmp(inPlace, product, size * sizeof(float)) == 0)
+        return;
+    failures++;
+    fprintf(stderr, "%s differs from operator*\n", what);
+    for(int i = 0; i < size; i++)
+    {
+        if(memcmp(&inPlace[i], &product[i], sizeof(float)) != 0)
+            fprintf(stderr, "  d[%d] = %g: %g instead of %g\n", i, base[i], inPlace[i], product[i]);
+    }
+}
+
+static void checkTransform(const char *what, const matrix4 &base, const matrix4 &inPlace,
+                           const affine3x4 &affineInPlace, const matrix4 &transform)
+{
+    matrix4 product = base * transform;
+    checkSame(what, base.d, inPlace.d, product.d, 16);
+    string affineWhat = string("affine3x4::") + what;
+    checkSame(affineWhat.c_str(), affine3x4(base).d, affineInPlace.d, affine3x4(product).d, 12);
+}
+
+// Matrices to transform: the identity, a general one and one with zeros and
+// negative values, which show differences in the sign of zero results. None of
+// them has a negative zero, which operator* could change in the columns that
+// the in-place transforms keep.
+static void baseMatrices(matrix4 *bases, int &count)
+{
+    static const float GENERAL[16] =
+    {
+        0.8f, -0.3f, 0.52f, 0.0f,
+        0.27f, 0.91f, -0.14f, 0.0f,
+        -0.6f, 0.2f, 0.77f, 0.0f,
+        3.5f, -1.25f, -7.0f, 1.0f
+    };
+    static const float SPARSE[16] =
+    {
+        -2.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, -1.5f, 0.0f,
+        0.0f, 3.0f, 0.0f, 0.0f,
+        0.0f, -4.0f, 0.25f, 1.0f
+    };
+    bases[0].setIdentity();
+    memcpy(bases[1].d, GENERAL, sizeof(GENERAL));
+    memcpy(bases[2].d, SPARSE, sizeof(SPARSE));
+    count = 3;
+}
+
+static void testTranslate(const matrix4 &base)
+{
+    static const float OFFSETS[][3] =
+    {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 3.0f}, {-0.5f, 0.0f, 12.25f}
+    };
+    for(int i = 0; i < 3; i++)
+    {
+        const float *v = OFFSETS[i];
+        matrix4 m = base;
+        affine3x4 a(base);
+        m.translateBy(v[0], v[1], v[2]);
+        a.translateBy(v[0], v[1], v[2]);
+        checkTransform("translateBy", base, m, a, matrix4::translate(v[0], v[1], v[2]));
+    }
+}
+
+static void testScale(const matrix4 &base)
+{
+    static const float FACTORS[][3] =
+    {
+        {1.0f, 1.0f, 1.0f}, {2.0f, 0.5f, 3.0f}, {-1.0f, 1.0f, -2.5f}
+    };
+    for(int i = 0; i < 3; i++)
+    {
+        const float *v = FACTORS[i];
+        matrix4 m = base;
+        affine3x4 a(base);
+        m.scaleBy(v[0], v[1], v[2]);
+        a.scaleBy(v[0], v[1], v[2]);
+        checkTransform("scaleBy", base, m, a, matrix4::scale(v[0], v[1], v[2]));
+    }
+}
+
+static void testRotate(const matrix4 &base)
+{
+    // the principal axes both ways, which take the fast path, and other axes
+    static const float AXES[][3] =
+    {
+        {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f},
+        {0.0f, 1.0f, 0.0f}, {0.0f, -1.0f, 0.0f},
+        {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f},
+        {0.6f, 0.0f, 0.8f}, {0.48f, 0.6f, 0.64f}
+    };
+    static const float ANGLES[] = {0.0f, 90.0f, -90.0f, 30.0f, 180.0f, 405.0f};
+    for(int i = 0; i < 8; i++)
+    {
+        const float *v = AXES[i];
+        for(int j = 0; j < 6; j++)
+        {
+            char what[96];
+            snprintf(what, sizeof(what), "rotateBy(%g, %g, %g, %g)", ANGLES[j], v[0], v[1], v[2]);
+            matrix4 m = base;
+            affine3x4 a(base);
+            m.rotateBy(ANGLES[j], v[0], v[1], v[2]);
+            a.rotateBy(ANGLES[j], v[0], v[1], v[2]);
+            checkTransform(what, base, m, a, matrix4::rotate(ANGLES[j], v[0], v[1], v[2]));
+        }
+    }
+}
+
+static bool testTransforms()
+{
+    matrix4 bases[3];
+    int count = 0;
+    baseMatrices(bases, count);
+    failures = checks = 0;
+    for(int i = 0; i < count; i++)
+    {
+        testTranslate(bases[i]);
+        testScale(bases[i]);
+        testRotate(bases[i]);
+    }
+    printf("%d of %d transforms match operator*.\n", checks - failures, checks);
+    return (failures == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks that the frames read back from an animation cache are the meshes the
+// scene captured at the same times. Delta frames are quantized to 1/32767 of the
+// largest difference and normals to 16 bits per component, hence the tolerance.
+
+static const float ANIMATION_POSITION_TOLERANCE = 1e-4f;
+static const float ANIMATION_NORMAL_TOLERANCE = 1e-3f;
+
+static float maxDifference(vec3 a, vec3 b)
+{
+    return max((float)fabs(a.x - b.x), max((float)fabs(a.y - b.y), (float)fabs(a.z - b.z)));
+}
+
+static void checkFrame(uint32_t frame, const Mesh *captured, const vector<VertexGroup *> &groups,
+                       float &maxPosition, float &maxNormal)
+{
+    checks++;
+    if(captured->groupCount() != (int)groups.size())
+    {
+        failures++;
+        fprintf(stderr, "frame %u has %u groups instead of %d\n", frame,
+                (uint32_t)groups.size(), captured->groupCount());
+        return;
+    }
+    bool same = true;
+    for(uint32_t i = 0; same && (i < groups.size()); i++)
+    {
+        VertexGroupView view;
+        captured->groupView(i, view);
+        const VertexGroup *vg = groups[i];
+        same = (view.mode == vg->mode) && (view.count() == vg->count) &&
+            (view.indices.size() == vg->indexCount);
+        for(uint32_t j = 0; same && (j < vg->indexCount); j++)
+            same = (view.indices[j] == vg->indices[j]);
+        for(uint32_t j = 0; same && (j < vg->count); j++)
+        {
+            VertexData v = view.vertex(j);
+            float position = maxDifference(v.position, vg->data[j].position);
+            float normal = maxDifference(v.normal, vg->data[j].normal);
+            maxPosition = max(maxPosition, position);
+            maxNormal = max(maxNormal, normal);
+            same = (position <= ANIMATION_POSITION_TOLERANCE) && (normal <= ANIMATION_NORMAL_TOLERANCE) &&
+                (v.texCoords.x == vg->data[j].texCoords.x) && (v.texCoords.y == vg->data[j].texCoords.y);
+        }
+        if(!same)
+        {
+            failures++;
+            fprintf(stderr, "frame %u differs from the captured mesh in group %u\n", frame, i);
+        }
+    }
+}
+
+static bool testAnimation()
+{
+    RenderStateCapture state;
+    Scene scene(&state);
+    scene.init();
+    if(!scene.isLoaded())
+    {
+        fprintf(stderr, "Could not load the mesh files.\n");
+        return false;
+    }
+
+    // two key intervals of the whole scene, where the dragons move, to read
+    // key frames and delta frames after them
+    static const uint32_t FRAMES = 61;
+    vector<double> times;
+    for(uint32_t i = 0; i < FRAMES; i++)
+        times.push_back(i / 30.0);
+    string path = temporaryFilePath("DragonTests.anim");
+    AnimationCacheReader reader;
+    if(!scene.exportAnimation(Scene::SCENE, path, times) || !reader.open(path) ||
+        (reader.frameCount() != FRAMES))
+    {
+        fprintf(stderr, "Could not write and read back '%s'.\n", path.c_str());
+        remove(path.c_str());
+        return false;
+    }
+
+    // read the frames in order, then backwards which starts from key frames
+    failures = checks = 0;
+    float maxPosition = 0.0f, maxNormal = 0.0f;
+    vector<VertexGroup *> groups;
+    reader.createGroups(groups);
+    for(uint32_t i = 0; i < 2 * FRAMES; i++)
+    {
+        uint32_t frame = (i < FRAMES) ? i : (2 * FRAMES - 1 - i);
+        scene.animate(times[frame]);
+        Mesh *captured = scene.captureItem(Scene::SCENE);
+        if(!reader.readFrame(frame, groups) || (reader.frameTime(frame) != (float)times[frame]))
+        {
+            checks++;
+            failures++;
+            fprintf(stderr, "Could not read frame %u.\n", frame);
+        }
+        else
+        {
+            checkFrame(frame, captured, groups, maxPosition, maxNormal);
+        }
+        delete captured;
+    }
+    for(uint32_t i = 0; i < groups.size(); i++)
+        delete groups[i];
+    reader.close();
+    remove(path.c_str());
+    printf("%d of %d animation frames match the captured meshes (error %.2e, normals %.2e).\n",
+           checks - failures, checks, maxPosition, maxNormal);
+    return (failures == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    string test = (argc > 1) ? argv[1] : "";
+    bool passed = true;
+    bool found = false;
+    if(test.empty() || (test == "transforms"))
+    {
+        passed = testTransforms() && passed;
+        found = true;
+    }
+    if(test.empty() || (test == "animation"))
+    {
+        passed = testAnimation() && passed;
+        found = true;
+    }
+    if(!found)
+    {
+        fprintf(stderr, "Usage: %s [transforms|animation]\n", argv[0]);
+        return 1;
+    }
+    return passed ? 0 : 1;
+}
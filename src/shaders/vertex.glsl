@@ -2,9 +2,17 @@ attribute vec3 a_position;
 attribute vec3 a_normal;
 attribute vec2 a_texCoords;
 
-uniform mat4 u_modelViewMatrix;
+// rows of the model-view matrix, which is affine
+uniform vec4 u_modelViewRows[3];
 uniform mat4 u_projectionMatrix;
 
+// packed vertices are normalized, they are mapped back to the mesh bounds
+uniform vec3 u_position_offset;
+uniform vec3 u_position_scale;
+uniform vec2 u_texCoords_offset;
+uniform vec2 u_texCoords_scale;
+uniform bool u_oct_normals;
+
 uniform vec4 u_light_ambient;
 uniform vec4 u_light_diffuse;
 uniform vec4 u_light_specular;
@@ -18,19 +26,35 @@ uniform float u_material_shine;
 varying vec4 v_color;
 varying vec2 v_texCoords;
 
+// unfold a normal stored as a point on an octahedron
+vec3 decodeNormal(vec3 n)
+{
+    if(!u_oct_normals)
+        return n;
+    vec2 e = n.xy * 2.0 - 1.0;
+    vec3 d = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(d.z < 0.0)
+    {
+        vec2 s = vec2((e.x >= 0.0) ? 1.0 : -1.0, (e.y >= 0.0) ? 1.0 : -1.0);
+        d.xy = (1.0 - abs(e.yx)) * s;
+    }
+    return d;
+}
+
 void main()
 {
-    gl_Position = u_projectionMatrix * u_modelViewMatrix * vec4(a_position, 1.0);
-    v_texCoords = a_texCoords;
+    vec3 position = a_position * u_position_scale + u_position_offset;
+    vec4 p = vec4(position, 1.0);
+    vec3 eyePosition = vec3(dot(u_modelViewRows[0], p), dot(u_modelViewRows[1], p),
+                            dot(u_modelViewRows[2], p));
+    gl_Position = u_projectionMatrix * vec4(eyePosition, 1.0);
+    v_texCoords = a_texCoords * u_texCoords_scale + u_texCoords_offset;
 
     vec3 normal, lightDir, halfVector;
     vec4 diffuse, ambient, specular;
-    mat3 normalMatrix;
-    normalMatrix[0] = vec3(u_modelViewMatrix[0]);
-    normalMatrix[1] = vec3(u_modelViewMatrix[1]);
-    normalMatrix[2] = vec3(u_modelViewMatrix[2]);
-
-    normal = normalize(normalMatrix * a_normal);
+    vec3 n = decodeNormal(a_normal);
+    normal = normalize(vec3(dot(u_modelViewRows[0].xyz, n), dot(u_modelViewRows[1].xyz, n),
+                            dot(u_modelViewRows[2].xyz, n)));
     lightDir = normalize(u_light_pos.xyz);
     halfVector = normalize(lightDir + vec3(0, 0, 1));
 
@@ -1,4 +1,5 @@
-uniform mat4 u_modelViewMatrix;
+// rows of the model-view matrix, which is affine
+uniform vec4 u_modelViewRows[3];
 uniform mat4 u_projectionMatrix;
 
 uniform vec4 u_light_pos;
@@ -7,15 +8,14 @@ varying vec3 normal, lightDir, halfVector;
 
 void main()
 {
-    mat3 normalMatrix;
-    normalMatrix[0] = vec3(u_modelViewMatrix[0]);
-    normalMatrix[1] = vec3(u_modelViewMatrix[1]);
-    normalMatrix[2] = vec3(u_modelViewMatrix[2]);
-
-    normal = normalize(normalMatrix * gl_Normal);
+    normal = normalize(vec3(dot(u_modelViewRows[0].xyz, gl_Normal),
+                            dot(u_modelViewRows[1].xyz, gl_Normal),
+                            dot(u_modelViewRows[2].xyz, gl_Normal)));
     lightDir = normalize(u_light_pos.xyz);
     halfVector = normalize(lightDir + vec3(0, 0, 1));
 
-    gl_Position = u_projectionMatrix * u_modelViewMatrix * gl_Vertex;
+    vec3 eyePosition = vec3(dot(u_modelViewRows[0], gl_Vertex), dot(u_modelViewRows[1], gl_Vertex),
+                            dot(u_modelViewRows[2], gl_Vertex));
+    gl_Position = u_projectionMatrix * vec4(eyePosition, 1.0);
     gl_TexCoord[0] = gl_MultiTexCoord0;
 }